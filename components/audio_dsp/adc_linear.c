@@ -0,0 +1,34 @@
+#include "adc_linear.h"
+
+void adc_linear_normalize(uint16_t * lut)
+{
+    int32_t mv_lo = lut[0];
+    int32_t mv_span = lut[ADC_CODES - 1] - mv_lo;
+    int32_t last = 0;
+
+    for (int i = 0; i < ADC_CODES; i++) {
+        int32_t code = mv_span > 0 ? ((int32_t) lut[i] - mv_lo) * (ADC_CODES - 1) / mv_span : i;
+        // the characterization is monotonic, rounding in it must not make a reversed step
+        if (code < last) code = last;
+        if (code > ADC_CODES - 1) code = ADC_CODES - 1;
+        lut[i] = last = code;
+    }
+}
+
+void adc_unpack(const uint16_t * lut, const uint16_t * raw, int16_t * out, int len, AdcFrame * frame)
+{
+    const int32_t offset = frame -> mean;
+    int32_t sum = 0, lo = ADC_CODES, hi = -1;
+
+    for (int i = 0; i < len; i++) {
+        int32_t x = lut[raw[i] & ADC_CODE_MASK];
+        if (x < lo) lo = x;
+        if (x > hi) hi = x;
+        sum += x;
+        out[i] = x - offset;
+    }
+
+    frame -> mean = sum / len;
+    frame -> lo = lo;
+    frame -> hi = hi;
+}
@@ -0,0 +1,24 @@
+#ifndef ADC_LINEAR_H
+#define ADC_LINEAR_H
+
+#include <stdint.h>
+
+/* 12 bit codes, the I2S ADC mode puts the channel number in the upper 4 bits */
+#define ADC_CODES      (4096)
+#define ADC_CODE_MASK  (ADC_CODES - 1)
+
+typedef struct {
+
+    int32_t mean;           // of the frame, its offset is removed from the next one
+    int32_t lo;             // extremes of the frame in linear codes
+    int32_t hi;
+
+} AdcFrame;
+
+// Turns a table of calibrated millivolts per raw code into linear codes on the same 0 - 4095 scale in place
+void adc_linear_normalize(uint16_t * lut);
+
+// Masks the channel bits, linearizes and removes the previous frame's mean in one pass, out may alias raw
+void adc_unpack(const uint16_t * lut, const uint16_t * raw, int16_t * out, int len, AdcFrame * frame);
+
+#endif /* ADC_LINEAR_H */
@@ -0,0 +1,40 @@
+#include "band_balance.h"
+
+// keeps the middle band at least this wide, in bins
+#define BALANCE_MIN_WIDTH (1.0f)
+
+void band_balance_reset(BandBalance * balance, float edge_lo, float edge_hi)
+{
+    balance -> edge[0] = edge_lo;
+    balance -> edge[1] = edge_hi;
+}
+
+static float clampf(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+void band_balance_add(BandBalance * balance, const FFT_PRECISION * magnitudes, int bin_lo, int bin_hi)
+{
+    float total = 0, below[2] = {0, 0};
+
+    for (int k = bin_lo; k <= bin_hi; k++) {
+        float mag = magnitudes[k];
+        total += mag;
+        for (int j = 0; j < 2; j++) {
+            below[j] += mag * clampf(balance -> edge[j] - (k - 0.5f), 0, 1);
+        }
+    }
+    // silence says nothing about the distribution
+    if (total <= 0) return;
+
+    // stochastic approximation of the quantile, each frame weighs the same whatever its loudness
+    float step = BALANCE_RATE * (bin_hi - bin_lo + 1);
+    for (int j = 0; j < 2; j++) {
+        float target = (j + 1) / 3.0f;
+        balance -> edge[j] += step * (target - below[j] / total);
+    }
+
+    balance -> edge[0] = clampf(balance -> edge[0], bin_lo + 0.5f, bin_hi - 0.5f - BALANCE_MIN_WIDTH);
+    balance -> edge[1] = clampf(balance -> edge[1], balance -> edge[0] + BALANCE_MIN_WIDTH, bin_hi - 0.5f);
+}
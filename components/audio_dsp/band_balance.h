@@ -0,0 +1,27 @@
+#ifndef BAND_BALANCE_H
+#define BAND_BALANCE_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/* Edge step per frame, in bins of the balanced range per unit of share error.
+ * Small enough to follow the long-term distribution rather than single notes */
+#define BALANCE_RATE    (0.005f)
+
+/* Streaming estimate of the 1/3 and 2/3 quantiles of the magnitude
+ * distribution over frequency, as fractional bins. Each bin's magnitude
+ * is spread evenly over [k - 0.5, k + 0.5] */
+typedef struct {
+
+    float edge[2];
+
+} BandBalance;
+
+// Starts the quantile estimates at the given fractional bins
+void band_balance_reset(BandBalance * balance, float edge_lo, float edge_hi);
+
+// Moves both edges towards equal thirds of this frame's magnitude between bin_lo and bin_hi
+void band_balance_add(BandBalance * balance, const FFT_PRECISION * magnitudes, int bin_lo, int bin_hi);
+
+#endif /* BAND_BALANCE_H */
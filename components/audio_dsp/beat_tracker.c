@@ -0,0 +1,153 @@
+#include <math.h>
+#include <string.h>
+#include "beat_tracker.h"
+
+// weight of a new sample in the flux and frame period averages
+#define BEAT_AVG_RATE (0.05f)
+// share of the phase error corrected by an onset close to the predicted beat
+#define BEAT_PHASE_GAIN (0.25f)
+
+BeatTracker * create_beat_tracker(int bins)
+{
+    BeatTracker * tracker = (BeatTracker *) calloc(1, sizeof(BeatTracker));
+    if (!tracker) return NULL;
+    tracker -> bins = bins;
+    tracker -> previous = (FFT_PRECISION *) calloc(bins, sizeof(FFT_PRECISION));
+    tracker -> envelope = (float *) calloc(BEAT_ENVELOPE_LEN, sizeof(float));
+    tracker -> work = (FFT_PRECISION *) calloc(2 * BEAT_ENVELOPE_LEN, sizeof(FFT_PRECISION));
+    tracker -> fft = create_fft_transformer(2 * BEAT_ENVELOPE_LEN, FFT_UNSCALED_OUTPUT);
+    if (!tracker -> previous || !tracker -> envelope || !tracker -> work || !tracker -> fft) {
+        free_beat_tracker(tracker);
+        return NULL;
+    }
+    return tracker;
+}
+
+void free_beat_tracker(BeatTracker * tracker)
+{
+    if (tracker -> fft) free_fft_transformer(tracker -> fft);
+    free(tracker -> previous);
+    free(tracker -> envelope);
+    free(tracker -> work);
+    free(tracker);
+}
+
+/**
+ * Autocorrelates the onset envelope through the FFT (Wiener-Khinchin) and picks
+ * the strongest lag in the BPM range, weighted towards BEAT_BPM_PRIOR, then
+ * realigns the beat phase to the envelope
+ */
+static void estimate_tempo(BeatTracker * tracker, int64_t now_us)
+{
+    const int n = 2 * BEAT_ENVELOPE_LEN;
+    FFT_PRECISION * work = tracker -> work;
+
+    float mean = 0;
+    for (int i = 0; i < BEAT_ENVELOPE_LEN; i++) mean += tracker -> envelope[i];
+    mean /= BEAT_ENVELOPE_LEN;
+    for (int i = 0; i < BEAT_ENVELOPE_LEN; i++) {
+        work[i] = tracker -> envelope[(tracker -> head + i) % BEAT_ENVELOPE_LEN] - mean;
+    }
+    memset(work + BEAT_ENVELOPE_LEN, 0, BEAT_ENVELOPE_LEN * sizeof(FFT_PRECISION));
+
+    fft_forward(tracker -> fft, work);
+    // power spectrum in fftpack's packed real layout: dc, (re, im) pairs, nyquist
+    work[0] = work[0] * work[0];
+    for (int i = 1; i < n - 1; i += 2) {
+        work[i] = work[i] * work[i] + work[i + 1] * work[i + 1];
+        work[i + 1] = 0;
+    }
+    work[n - 1] = work[n - 1] * work[n - 1];
+    fft_backward(tracker -> fft, work);
+
+    int lag_min = (int) (60e6f / (BEAT_BPM_MAX * tracker -> frame_us));
+    int lag_max = (int) (60e6f / (BEAT_BPM_MIN * tracker -> frame_us)) + 1;
+    if (lag_min < 2) lag_min = 2;
+    if (lag_max > BEAT_ENVELOPE_LEN - 2) lag_max = BEAT_ENVELOPE_LEN - 2;
+    if (lag_max <= lag_min || work[0] <= 0) return;
+
+    int best = 0;
+    float best_score = 0;
+    float prior_lag = 60e6f / (BEAT_BPM_PRIOR * tracker -> frame_us);
+    float current_lag = tracker -> period_us / tracker -> frame_us;
+    for (int lag = lag_min; lag <= lag_max; lag++) {
+        // log-gaussian prior, one octave away halves the score
+        float octaves = log2f(lag / prior_lag);
+        // neighbouring lags share the peak when the period isn't a whole number of frames
+        float score = (work[lag - 1] + 2 * work[lag] + work[lag + 1]) * exp2f(-octaves * octaves);
+        if (current_lag > 0 && fabsf(log2f(lag / current_lag)) < BEAT_HOLD_OCTAVES) score *= BEAT_HOLD_GAIN;
+        if (score > best_score) {
+            best_score = score;
+            best = lag;
+        }
+    }
+    if (!best) return;
+
+    FFT_PRECISION a = work[best - 1], b = work[best], c = work[best + 1];
+    FFT_PRECISION denom = a - 2 * b + c;
+    FFT_PRECISION lag = best + (denom < 0 ? 0.5 * (a - c) / denom : 0);
+    tracker -> period_us = (int64_t) (lag * tracker -> frame_us);
+    tracker -> bpm = 60e6f / tracker -> period_us;
+
+    // phase: the offset whose comb through the envelope, one tooth per period, is strongest
+    int newest = tracker -> head + BEAT_ENVELOPE_LEN - 1;
+    int best_offset = 0;
+    float best_comb = -1;
+    for (int offset = 0; offset < best; offset++) {
+        float comb = 0;
+        for (FFT_PRECISION back = offset; back < BEAT_ENVELOPE_LEN; back += lag) {
+            comb += tracker -> envelope[(newest - (int) back) % BEAT_ENVELOPE_LEN];
+        }
+        if (comb > best_comb) {
+            best_comb = comb;
+            best_offset = offset;
+        }
+    }
+    tracker -> next_beat_us = now_us - (int64_t) (best_offset * tracker -> frame_us) + tracker -> period_us;
+}
+
+int beat_tracker_add(BeatTracker * tracker, const FFT_PRECISION * magnitudes, int64_t now_us)
+{
+    // half wave rectified spectral flux
+    float flux = 0;
+    for (int k = 1; k < tracker -> bins; k++) {
+        FFT_PRECISION rise = magnitudes[k] - tracker -> previous[k];
+        if (rise > 0) flux += rise;
+    }
+    memcpy(tracker -> previous, magnitudes, tracker -> bins * sizeof(FFT_PRECISION));
+
+    if (tracker -> last_frame_us) {
+        float frame_us = now_us - tracker -> last_frame_us;
+        tracker -> frame_us = tracker -> frame_us ? tracker -> frame_us + BEAT_AVG_RATE * (frame_us - tracker -> frame_us)
+                                                  : frame_us;
+    }
+    tracker -> last_frame_us = now_us;
+
+    int onset = flux > tracker -> flux_mean + BEAT_ONSET_DEVS * tracker -> flux_dev;
+    tracker -> flux_mean += BEAT_AVG_RATE * (flux - tracker -> flux_mean);
+    tracker -> flux_dev += BEAT_AVG_RATE * (fabsf(flux - tracker -> flux_mean) - tracker -> flux_dev);
+
+    tracker -> envelope[tracker -> head] = flux;
+    tracker -> head = (tracker -> head + 1) % BEAT_ENVELOPE_LEN;
+    if (tracker -> filled < BEAT_ENVELOPE_LEN) tracker -> filled++;
+
+    if (++tracker -> frames_since_tempo >= BEAT_TEMPO_INTERVAL
+        && tracker -> filled == BEAT_ENVELOPE_LEN && tracker -> frame_us > 0) {
+        tracker -> frames_since_tempo = 0;
+        estimate_tempo(tracker, now_us);
+    }
+
+    if (!tracker -> period_us) return onset;
+
+    // keep the prediction ahead of the audio, then pull it towards nearby onsets
+    int64_t period = tracker -> period_us;
+    while (tracker -> next_beat_us < now_us - period / 2) {
+        tracker -> next_beat_us += period;
+        tracker -> beats++;
+    }
+    int64_t error = now_us - tracker -> next_beat_us;
+    if (onset && error > -period / 4 && error < period / 4) {
+        tracker -> next_beat_us += (int64_t) (BEAT_PHASE_GAIN * error);
+    }
+    return onset;
+}
@@ -0,0 +1,51 @@
+#ifndef BEAT_TRACKER_H
+#define BEAT_TRACKER_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/* Onset envelope frames kept for the tempo estimate */
+#define BEAT_ENVELOPE_LEN   (256)
+/* Frames between tempo estimates */
+#define BEAT_TEMPO_INTERVAL (32)
+#define BEAT_BPM_MIN        (60)
+#define BEAT_BPM_MAX        (180)
+/* Tempo the autocorrelation is weighted towards, against half / double tempo errors */
+#define BEAT_BPM_PRIOR      (120)
+/* Lags within BEAT_HOLD_OCTAVES of the current period score BEAT_HOLD_GAIN times higher,
+ * so music that fits two tempo octaves about equally doesn't flip between them */
+#define BEAT_HOLD_OCTAVES   (0.06f)
+#define BEAT_HOLD_GAIN      (1.5f)
+/* Onsets stronger than mean + BEAT_ONSET_DEVS mean deviations of the flux */
+#define BEAT_ONSET_DEVS     (2.0f)
+
+typedef struct {
+
+    int bins;
+    FFT_PRECISION * previous;   // magnitudes of the previous frame
+    float * envelope;           // onset strength ring
+    int head;
+    int filled;
+    FFTTransformer * fft;       // 2 * BEAT_ENVELOPE_LEN, zero padded for a linear autocorrelation
+    FFT_PRECISION * work;
+    int frames_since_tempo;
+    int64_t last_frame_us;
+    float frame_us;             // smoothed frame period
+    float flux_mean;
+    float flux_dev;
+    float bpm;                  // 0 until the first estimate
+    int64_t period_us;
+    int64_t next_beat_us;       // predicted time of the next beat
+    uint32_t beats;
+
+} BeatTracker;
+
+BeatTracker * create_beat_tracker(int bins);
+
+void free_beat_tracker(BeatTracker * tracker);
+
+// Adds one frame of magnitudes taken at now_us, returns 1 if the frame is an onset
+int beat_tracker_add(BeatTracker * tracker, const FFT_PRECISION * magnitudes, int64_t now_us);
+
+#endif /* BEAT_TRACKER_H */
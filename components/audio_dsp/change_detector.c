@@ -0,0 +1,45 @@
+#include <math.h>
+#include "change_detector.h"
+
+static int within(float value, float reference, float tolerance, float slack)
+{
+    return fabsf(value - reference) <= tolerance * reference + slack;
+}
+
+int change_detector_check(ChangeDetector * detector, const int16_t * samples, int len, int p2p)
+{
+    int64_t sum = 0, sum_sq = 0;
+    for (int i = 0; i < len; i++) {
+        sum += samples[i];
+        sum_sq += (int64_t) samples[i] * samples[i];
+    }
+    int32_t mean = sum / len;
+    // in integers, what is left of the ADC offset can still dwarf the variance of quiet signals
+    float rms = sqrtf((float) ((sum_sq - sum * sum / len) / len));
+
+    // crossings of the mean
+    int crossings = 0;
+    int above = samples[0] > mean;
+    for (int i = 1; i < len; i++) {
+        int now_above = samples[i] > mean;
+        crossings += now_above != above;
+        above = now_above;
+    }
+
+    detector -> frames++;
+    if (detector -> valid && detector -> since_refresh < CHANGE_REFRESH_FRAMES - 1
+        && within(rms, detector -> rms, CHANGE_RMS_TOL, 0)
+        && within(crossings, detector -> crossings, CHANGE_ZCR_TOL, CHANGE_ZCR_SLACK)
+        && within(p2p, detector -> p2p, CHANGE_P2P_TOL, 0)) {
+        detector -> since_refresh++;
+        detector -> skipped++;
+        return 1;
+    }
+
+    detector -> rms = rms;
+    detector -> crossings = crossings;
+    detector -> p2p = p2p;
+    detector -> valid = 1;
+    detector -> since_refresh = 0;
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CHANGE_DETECTOR_H
+#define CHANGE_DETECTOR_H
+
+#include <stdint.h>
+
+/* Frames whose statistics are all within these relative tolerances of the last
+ * transformed frame reuse its spectrum */
+#define CHANGE_RMS_TOL        (0.05f)
+#define CHANGE_ZCR_TOL        (0.10f)
+/* Zero crossings of low pitched frames vary by a few counts from the frame phase alone */
+#define CHANGE_ZCR_SLACK      (6)
+#define CHANGE_P2P_TOL        (0.05f)
+/* A frame is transformed at least every CHANGE_REFRESH_FRAMES frames */
+#define CHANGE_REFRESH_FRAMES (8)
+
+typedef struct {
+
+    // statistics of the last transformed frame
+    float rms;
+    int crossings;
+    int p2p;
+    int valid;
+    int since_refresh;
+    uint32_t frames;
+    uint32_t skipped;
+
+} ChangeDetector;
+
+// Returns 1 if the frame is stationary and the previous spectrum can be reused, else takes it as the new reference
+int change_detector_check(ChangeDetector * detector, const int16_t * samples, int len, int p2p);
+
+#endif /* CHANGE_DETECTOR_H */
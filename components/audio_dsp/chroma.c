@@ -0,0 +1,171 @@
+#include <math.h>
+#include <string.h>
+#include "chroma.h"
+
+/**
+ * Spreads the taps of a decimating FIR over its phases: the input sample at phase p adds
+ * taps[p][j] of itself to the output j decimated samples ahead
+ */
+static void split_phases(const float * taps, int decimation, int phase_taps, float * phases)
+{
+    for (int p = 0; p < decimation; p++) {
+        for (int j = 0; j < phase_taps; j++) phases[p * phase_taps + j] = taps[decimation - 1 - p + j * decimation];
+    }
+}
+
+/**
+ * Adds x to the partial sums of a decimating FIR, returns 1 and the finished output in out on its last phase
+ */
+static inline int decimate(float * acc, const float * phase_taps, int count, int * phase, int decimation, float x,
+                           float * out)
+{
+    for (int j = 0; j < count; j++) acc[j] += phase_taps[j] * x;
+    if (++*phase < decimation) return 0;
+    *phase = 0;
+    *out = acc[0];
+    memmove(acc, acc + 1, (count - 1) * sizeof(float));
+    acc[count - 1] = 0;
+    return 1;
+}
+
+static void build_decimators(ChromaPlan * plan)
+{
+    // second order CIC, a triangle over two phases. Its gain of R * R also takes the ADC codes to about 1
+    float stage1[CHROMA_STAGE1_DECIMATION * CHROMA_STAGE1_PHASE_TAPS] = {0};
+    for (int i = 0; i < 2 * CHROMA_STAGE1_DECIMATION - 1; i++) {
+        int rise = i < CHROMA_STAGE1_DECIMATION ? i + 1 : 2 * CHROMA_STAGE1_DECIMATION - 1 - i;
+        stage1[i] = rise / (float) (CHROMA_STAGE1_DECIMATION * CHROMA_STAGE1_DECIMATION) / 2048.0f;
+    }
+    split_phases(stage1, CHROMA_STAGE1_DECIMATION, CHROMA_STAGE1_PHASE_TAPS, plan -> stage1_taps[0]);
+
+    // hamming windowed sinc, cut off at the decimated nyquist
+    float stage2[CHROMA_STAGE2_TAPS];
+    float sum = 0;
+    for (int i = 0; i < CHROMA_STAGE2_TAPS; i++) {
+        float x = i - (CHROMA_STAGE2_TAPS - 1) / 2.0f;
+        float sinc = x == 0 ? 1 : sinf(M_PI * x / CHROMA_STAGE2_DECIMATION) / (M_PI * x / CHROMA_STAGE2_DECIMATION);
+        stage2[i] = sinc * (0.54f - 0.46f * cosf(2 * M_PI * i / (CHROMA_STAGE2_TAPS - 1)));
+        sum += stage2[i];
+    }
+    for (int i = 0; i < CHROMA_STAGE2_TAPS; i++) stage2[i] /= sum;
+    split_phases(stage2, CHROMA_STAGE2_DECIMATION, CHROMA_STAGE2_TAPS / CHROMA_STAGE2_DECIMATION,
+                 plan -> stage2_taps[0]);
+}
+
+ChromaPlan * create_chroma_plan(FFT_PRECISION sample_hz)
+{
+    ChromaPlan * plan = (ChromaPlan *) calloc(1, sizeof(ChromaPlan));
+    if (!plan) return NULL;
+    int bins = CHROMA_FFT_LEN / 2;
+    FFT_PRECISION bin_hz = sample_hz / CHROMA_DECIMATION / CHROMA_FFT_LEN;
+    plan -> bin_hz = bin_hz;
+    plan -> due = CHROMA_HOP;
+    plan -> decimated = (float *) calloc(CHROMA_FFT_LEN, sizeof(float));
+    plan -> window = (float *) malloc(CHROMA_FFT_LEN * sizeof(float));
+    plan -> fft = create_fft_transformer(CHROMA_FFT_LEN, FFT_SCALED_OUTPUT);
+    plan -> work = (FFT_PRECISION *) malloc(CHROMA_FFT_LEN * sizeof(FFT_PRECISION));
+    plan -> magnitudes = (FFT_PRECISION *) malloc(bins * sizeof(FFT_PRECISION));
+    // every bin lands in at most two rows
+    plan -> cols = (int *) malloc(2 * bins * sizeof(int));
+    plan -> weights = (float *) malloc(2 * bins * sizeof(float));
+    if (!plan -> decimated || !plan -> window || !plan -> fft || !plan -> work || !plan -> magnitudes
+        || !plan -> cols || !plan -> weights) {
+        free_chroma_plan(plan);
+        return NULL;
+    }
+    for (int i = 0; i < CHROMA_FFT_LEN; i++) plan -> window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / CHROMA_FFT_LEN);
+    build_decimators(plan);
+
+    // folded bins, only their magnitudes are computed
+    plan -> bin_lo = bins;
+    plan -> bin_hi = 0;
+    for (int k = 1; k < bins; k++) {
+        FFT_PRECISION freq = k * bin_hz;
+        if (freq < CHROMA_FREQ_LO || freq > CHROMA_FREQ_HI || bin_hz > freq * CHROMA_SEMITONE) continue;
+        if (k < plan -> bin_lo) plan -> bin_lo = k;
+        plan -> bin_hi = k;
+    }
+
+    // one pass per row keeps the CSR build free of scratch buffers, it only runs once per plan
+    int nnz = 0;
+    for (int pc = 0; pc < CHROMA_BINS; pc++) {
+        plan -> row_start[pc] = nnz;
+        for (int k = plan -> bin_lo; k <= plan -> bin_hi; k++) {
+            FFT_PRECISION midi = 69 + 12 * log2(k * bin_hz / 440.0);
+            int lower = (int) floor(midi);
+            FFT_PRECISION frac = midi - lower;
+            float weight = 0;
+            if (lower % 12 == pc) weight += 1 - frac;
+            if ((lower + 1) % 12 == pc) weight += frac;
+            if (weight <= 0) continue;
+            plan -> cols[nnz] = k;
+            plan -> weights[nnz] = weight;
+            nnz++;
+        }
+    }
+    plan -> row_start[CHROMA_BINS] = nnz;
+    plan -> nnz = nnz;
+    return plan;
+}
+
+void free_chroma_plan(ChromaPlan * plan)
+{
+    if (plan -> fft) free_fft_transformer(plan -> fft);
+    free(plan -> decimated);
+    free(plan -> window);
+    free(plan -> work);
+    free(plan -> magnitudes);
+    free(plan -> cols);
+    free(plan -> weights);
+    free(plan);
+}
+
+/**
+ * Transforms the newest decimated window and folds its magnitudes into the smoothed chroma
+ */
+static void chroma_forward(ChromaPlan * plan)
+{
+    FFT_PRECISION * work = plan -> work;
+    int at = plan -> decimated_head;
+    for (int i = 0; i < CHROMA_FFT_LEN; i++) {
+        work[i] = plan -> decimated[at] * plan -> window[i];
+        at = at + 1 < CHROMA_FFT_LEN ? at + 1 : 0;
+    }
+    fft_forward(plan -> fft, work);
+    // packed real layout: dc, then (re, im) pairs
+    for (int k = plan -> bin_lo; k <= plan -> bin_hi; k++) {
+        FFT_PRECISION re = work[2 * k - 1], im = work[2 * k];
+        plan -> magnitudes[k] = sqrtf(re * re + im * im);
+    }
+
+    int dominant = 0;
+    for (int pc = 0; pc < CHROMA_BINS; pc++) {
+        FFT_PRECISION sum = 0;
+        for (int j = plan -> row_start[pc]; j < plan -> row_start[pc + 1]; j++) {
+            sum += plan -> weights[j] * plan -> magnitudes[plan -> cols[j]];
+        }
+        plan -> chroma[pc] += (sum - plan -> chroma[pc]) / CHROMA_SMOOTHING;
+        if (plan -> chroma[pc] > plan -> chroma[dominant]) dominant = pc;
+    }
+    plan -> dominant = dominant;
+}
+
+int chroma_push(ChromaPlan * plan, const int16_t * samples, int len)
+{
+    float stage1_out, stage2_out;
+    for (int i = 0; i < len; i++) {
+        if (!decimate(plan -> stage1_acc, plan -> stage1_taps[plan -> stage1_phase], CHROMA_STAGE1_PHASE_TAPS,
+                      &plan -> stage1_phase, CHROMA_STAGE1_DECIMATION, samples[i], &stage1_out)) continue;
+        if (!decimate(plan -> stage2_acc, plan -> stage2_taps[plan -> stage2_phase],
+                      CHROMA_STAGE2_TAPS / CHROMA_STAGE2_DECIMATION, &plan -> stage2_phase, CHROMA_STAGE2_DECIMATION,
+                      stage1_out, &stage2_out)) continue;
+        plan -> decimated[plan -> decimated_head] = stage2_out;
+        plan -> decimated_head = (plan -> decimated_head + 1) % CHROMA_FFT_LEN;
+    }
+    plan -> due -= len;
+    if (plan -> due <= 0) {
+        plan -> due = CHROMA_HOP;
+        chroma_forward(plan);
+    }
+    return plan -> dominant;
+}
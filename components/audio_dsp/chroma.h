@@ -0,0 +1,74 @@
+#ifndef CHROMA_H
+#define CHROMA_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+#define CHROMA_BINS     (12)
+/* Musical range folded into the chroma, A1 to C8 */
+#define CHROMA_FREQ_LO  (55.0)
+#define CHROMA_FREQ_HI  (4186.0)
+/* Semitones are 5.9 % of their frequency apart, bins wider than that can't tell
+ * neighbouring pitch classes apart and are left out of the chroma */
+#define CHROMA_SEMITONE  (0.0595)
+/* Weight of the new spectrum in the smoothed chroma, 1/CHROMA_SMOOTHING */
+#define CHROMA_SMOOTHING (2)
+
+/* The chroma is folded from a CHROMA_FFT_LEN point transform of the input decimated
+ * CHROMA_DECIMATION times, whose bins of about 11 Hz resolve semitones from F#3 up.
+ * Decimation runs in two stages: a triangle CHROMA_STAGE1_DECIMATION taps per phase wide
+ * (a second order CIC), whose aliases only land far above the chroma, then a windowed
+ * sinc of CHROMA_STAGE2_TAPS cut off at the decimated nyquist */
+#define CHROMA_STAGE1_DECIMATION (8)
+#define CHROMA_STAGE1_PHASE_TAPS (2)
+#define CHROMA_STAGE2_DECIMATION (4)
+#define CHROMA_STAGE2_TAPS       (64)
+#define CHROMA_DECIMATION        (CHROMA_STAGE1_DECIMATION * CHROMA_STAGE2_DECIMATION)
+#define CHROMA_FFT_LEN           (1024)
+/* Input samples between transforms. The window spans CHROMA_FFT_LEN * CHROMA_DECIMATION
+ * samples, a quarter of it keeps consecutive spectra overlapping by three quarters */
+#define CHROMA_HOP               (CHROMA_FFT_LEN * CHROMA_DECIMATION / 4)
+
+typedef struct {
+
+    FFT_PRECISION bin_hz;
+    // decimators in transposed polyphase form: each input sample is added, weighted by the
+    // taps of its phase, to the partial sums of the outputs it takes part in
+    float stage1_taps[CHROMA_STAGE1_DECIMATION][CHROMA_STAGE1_PHASE_TAPS];
+    float stage1_acc[CHROMA_STAGE1_PHASE_TAPS];
+    int stage1_phase;
+    float stage2_taps[CHROMA_STAGE2_DECIMATION][CHROMA_STAGE2_TAPS / CHROMA_STAGE2_DECIMATION];
+    float stage2_acc[CHROMA_STAGE2_TAPS / CHROMA_STAGE2_DECIMATION];
+    int stage2_phase;
+    float * decimated;          // ring of the newest CHROMA_FFT_LEN decimated samples
+    int decimated_head;
+    int due;                    // input samples until the next transform
+    float * window;
+    FFTTransformer * fft;
+    FFT_PRECISION * work;
+    FFT_PRECISION * magnitudes; // of the bins from bin_lo to bin_hi, the others aren't folded
+    int bin_lo;
+    int bin_hi;
+    int nnz;
+    // bin to pitch class weights in CSR layout, one row per pitch class (C = 0)
+    int row_start[CHROMA_BINS + 1];
+    int * cols;
+    float * weights;
+    FFT_PRECISION chroma[CHROMA_BINS];  // smoothed across spectra
+    int dominant;
+
+} ChromaPlan;
+
+// Builds the decimators, the transform and the weight table for input sampled at sample_hz,
+// in the same frequency units as the chroma range. Each bin is split between its two nearest
+// pitch classes, only bins narrower than a semitone count
+ChromaPlan * create_chroma_plan(FFT_PRECISION sample_hz);
+
+void free_chroma_plan(ChromaPlan * plan);
+
+// Appends raw samples, with the DC offset already removed. Every CHROMA_HOP samples the
+// newest window is transformed and folded into the smoothed chroma. Returns the dominant pitch class
+int chroma_push(ChromaPlan * plan, const int16_t * samples, int len);
+
+#endif /* CHROMA_H */
@@ -0,0 +1,93 @@
+#include <math.h>
+#include <string.h>
+#include "classifier.h"
+#include "fast_math.h"
+
+static inline int8_t clamp_i8(int32_t v)
+{
+    return v < -127 ? -127 : (v > 127 ? 127 : (int8_t) v);
+}
+
+void mood_features_add(MoodFeatures * features, const Mfcc * mfcc, const FFT_PRECISION bands[3])
+{
+    for (int i = 0; i < CLASSIFIER_MFCCS && i < mfcc -> coeffs; i++) {
+        features -> sum[i] += mfcc -> mfcc[i];
+    }
+    for (int i = 0; i < 3; i++) {
+        features -> sum[CLASSIFIER_MFCCS + i] += fast_logf(bands[i] + 1.0f);
+    }
+    if (features -> frames) {
+        features -> sum[CLASSIFIER_FEATURES - 1] += fabs(mfcc -> mfcc[0] - features -> last_c0);
+    }
+    features -> last_c0 = mfcc -> mfcc[0];
+    features -> frames++;
+}
+
+int mood_features_take(MoodFeatures * features, float out[CLASSIFIER_FEATURES])
+{
+    int frames = features -> frames;
+    for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+        out[i] = frames ? features -> sum[i] / frames : 0;
+        features -> sum[i] = 0;
+    }
+    features -> frames = 0;
+    return frames;
+}
+
+void classifier_quantize(const ClassifierModel * model, const float features[CLASSIFIER_FEATURES],
+                         int8_t q[CLASSIFIER_FEATURES])
+{
+    for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+        q[i] = clamp_i8((int32_t) lrintf(features[i] / model -> input_scale[i]));
+    }
+}
+
+int classifier_forward(const ClassifierModel * model, const int8_t q[CLASSIFIER_FEATURES],
+                       int32_t scores[moods_size])
+{
+    int8_t hidden[CLASSIFIER_HIDDEN];
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        int32_t acc = model -> b1[h];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+            acc += (int32_t) model -> w1[h][i] * q[i];
+        }
+        acc = acc < 0 ? 0 : (acc * model -> hidden_mult) >> model -> hidden_shift;
+        hidden[h] = clamp_i8(acc);
+    }
+
+    int best = 0;
+    for (int c = 0; c < moods_size; c++) {
+        int32_t acc = model -> b2[c];
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+            acc += (int32_t) model -> w2[c][h] * hidden[h];
+        }
+        scores[c] = acc;
+        if (acc > scores[best]) best = c;
+    }
+    return best;
+}
+
+int classifier_reference(const ClassifierModel * model, const float features[CLASSIFIER_FEATURES],
+                         float scores[moods_size])
+{
+    float hidden[CLASSIFIER_HIDDEN];
+    float hidden_scale = (float) model -> hidden_mult / (1 << model -> hidden_shift);
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        float acc = model -> b1[h];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+            acc += model -> w1[h][i] * (features[i] / model -> input_scale[i]);
+        }
+        hidden[h] = acc < 0 ? 0 : acc * hidden_scale;
+    }
+
+    int best = 0;
+    for (int c = 0; c < moods_size; c++) {
+        float acc = model -> b2[c];
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+            acc += model -> w2[c][h] * hidden[h];
+        }
+        scores[c] = acc;
+        if (acc > scores[best]) best = c;
+    }
+    return best;
+}
@@ -0,0 +1,76 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <stdint.h>
+
+#include "fft.h"
+#include "mfcc.h"
+
+/* Mood features, averaged over a window of frames:
+ * 0 - 7  MFCC c0 - c7
+ * 8 - 10 log band energies red, green, blue
+ * 11     mean absolute frame to frame change of c0 */
+#define CLASSIFIER_FEATURES  (12)
+#define CLASSIFIER_MFCCS     (8)
+#define CLASSIFIER_HIDDEN    (6)
+
+#define FOREACH_MOOD(MOOD) \
+        MOOD(mood_calm)   \
+        MOOD(mood_energetic)  \
+        MOOD(mood_bass)  \
+        MOOD(mood_bright) \
+        MOOD(moods_size)  \
+
+#define GENERATE_MOOD_ENUM(ENUM) ENUM,
+
+enum moods_enum {
+    FOREACH_MOOD(GENERATE_MOOD_ENUM)
+};
+
+/* Two layer perceptron with int8 weights and int32 accumulators.
+ * Inputs are quantized as x / input_scale, the hidden layer is requantized
+ * to int8 as (acc * hidden_mult) >> hidden_shift after a ReLU. */
+typedef struct {
+
+    float input_scale[CLASSIFIER_FEATURES];
+    int8_t w1[CLASSIFIER_HIDDEN][CLASSIFIER_FEATURES];
+    int32_t b1[CLASSIFIER_HIDDEN];
+    int32_t hidden_mult;
+    int hidden_shift;
+    int8_t w2[moods_size][CLASSIFIER_HIDDEN];
+    int32_t b2[moods_size];
+
+} ClassifierModel;
+
+typedef struct {
+
+    float sum[CLASSIFIER_FEATURES];
+    float last_c0;
+    int frames;
+
+} MoodFeatures;
+
+/* Baked into flash by mood_model.c */
+extern const ClassifierModel mood_model;
+
+/* Stop colors of the palette picked for each mood */
+extern const uint8_t mood_palettes[moods_size][4][3];
+
+// Adds one frame to the feature window, `bands` are the red, green and blue band magnitudes
+void mood_features_add(MoodFeatures * features, const Mfcc * mfcc, const FFT_PRECISION bands[3]);
+
+// Writes the window means to `out` and starts a new window, returns the frames averaged
+int mood_features_take(MoodFeatures * features, float out[CLASSIFIER_FEATURES]);
+
+void classifier_quantize(const ClassifierModel * model, const float features[CLASSIFIER_FEATURES],
+                         int8_t q[CLASSIFIER_FEATURES]);
+
+// Integer inference, returns the winning class
+int classifier_forward(const ClassifierModel * model, const int8_t q[CLASSIFIER_FEATURES],
+                       int32_t scores[moods_size]);
+
+// Float reference of classifier_forward without input or hidden rounding, for parity checks
+int classifier_reference(const ClassifierModel * model, const float features[CLASSIFIER_FEATURES],
+                         float scores[moods_size]);
+
+#endif /* CLASSIFIER_H */
@@ -0,0 +1,27 @@
+#include "fast_math.h"
+
+// log2(1 + i / 128) for i = 0 .. 128
+const float fast_log2_lut[FAST_LOG2_LUT_LEN + 1] = {
+    0.00000000f, 0.01122726f, 0.02236781f, 0.03342300f, 0.04439412f, 0.05528244f,
+    0.06608919f, 0.07681560f, 0.08746284f, 0.09803208f, 0.10852446f, 0.11894107f,
+    0.12928302f, 0.13955135f, 0.14974712f, 0.15987134f, 0.16992500f, 0.17990909f,
+    0.18982456f, 0.19967234f, 0.20945337f, 0.21916852f, 0.22881869f, 0.23840474f,
+    0.24792751f, 0.25738784f, 0.26678654f, 0.27612441f, 0.28540222f, 0.29462075f,
+    0.30378075f, 0.31288296f, 0.32192809f, 0.33091688f, 0.33985000f, 0.34872815f,
+    0.35755200f, 0.36632221f, 0.37503943f, 0.38370429f, 0.39231742f, 0.40087944f,
+    0.40939094f, 0.41785251f, 0.42626475f, 0.43462823f, 0.44294350f, 0.45121111f,
+    0.45943162f, 0.46760555f, 0.47573343f, 0.48381578f, 0.49185310f, 0.49984589f,
+    0.50779464f, 0.51569984f, 0.52356196f, 0.53138146f, 0.53915881f, 0.54689446f,
+    0.55458885f, 0.56224242f, 0.56985561f, 0.57742883f, 0.58496250f, 0.59245704f,
+    0.59991284f, 0.60733031f, 0.61470984f, 0.62205182f, 0.62935662f, 0.63662462f,
+    0.64385619f, 0.65105169f, 0.65821148f, 0.66533592f, 0.67242534f, 0.67948010f,
+    0.68650053f, 0.69348696f, 0.70043972f, 0.70735913f, 0.71424552f, 0.72109919f,
+    0.72792045f, 0.73470962f, 0.74146699f, 0.74819285f, 0.75488750f, 0.76155123f,
+    0.76818432f, 0.77478706f, 0.78135971f, 0.78790256f, 0.79441587f, 0.80089990f,
+    0.80735492f, 0.81378119f, 0.82017896f, 0.82654849f, 0.83289001f, 0.83920379f,
+    0.84549005f, 0.85174904f, 0.85798100f, 0.86418614f, 0.87036472f, 0.87651695f,
+    0.88264305f, 0.88874325f, 0.89481776f, 0.90086681f, 0.90689060f, 0.91288934f,
+    0.91886324f, 0.92481250f, 0.93073734f, 0.93663794f, 0.94251451f, 0.94836723f,
+    0.95419631f, 0.96000193f, 0.96578428f, 0.97154355f, 0.97727992f, 0.98299357f,
+    0.98868469f, 0.99435344f, 1.00000000f
+};
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include "hpss.h"
+
+// weight of a new frame in the percussive energy average
+#define HPSS_AVG_RATE (0.05f)
+
+Hpss * create_hpss(int bins)
+{
+    Hpss * hpss = (Hpss *) calloc(1, sizeof(Hpss));
+    if (!hpss) return NULL;
+    hpss -> bins = bins;
+    hpss -> history = (float *) calloc(bins * HPSS_TIME_LEN, sizeof(float));
+    hpss -> sorted = (float *) calloc(bins * HPSS_TIME_LEN, sizeof(float));
+    hpss -> harmonic = (FFT_PRECISION *) calloc(bins, sizeof(FFT_PRECISION));
+    hpss -> percussive = (FFT_PRECISION *) calloc(bins, sizeof(FFT_PRECISION));
+    if (!hpss -> history || !hpss -> sorted || !hpss -> harmonic || !hpss -> percussive) {
+        free_hpss(hpss);
+        return NULL;
+    }
+    return hpss;
+}
+
+void free_hpss(Hpss * hpss)
+{
+    free(hpss -> history);
+    free(hpss -> sorted);
+    free(hpss -> harmonic);
+    free(hpss -> percussive);
+    free(hpss);
+}
+
+/**
+ * Replaces one value of a sorted array by another, shifting only the elements
+ * between the old and new positions, O(n) without a full sort
+ */
+static void sorted_replace(float * sorted, int n, float old, float value)
+{
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (sorted[mid] < old) lo = mid + 1;
+        else hi = mid;
+    }
+    int i = lo;
+    if (value > old) {
+        for (; i < n - 1 && sorted[i + 1] < value; i++) sorted[i] = sorted[i + 1];
+    } else {
+        for (; i > 0 && sorted[i - 1] > value; i--) sorted[i] = sorted[i - 1];
+    }
+    sorted[i] = value;
+}
+
+static int clamp_bin(int bin, int bins)
+{
+    return bin < 0 ? 0 : (bin >= bins ? bins - 1 : bin);
+}
+
+int hpss_forward(Hpss * hpss, const FFT_PRECISION * magnitudes)
+{
+    const int bins = hpss -> bins;
+    const int half = HPSS_FREQ_LEN / 2;
+    float * window = hpss -> window;
+
+    // frequency window over the edge replicated spectrum, starts sorted around bin 0
+    for (int i = 0; i < HPSS_FREQ_LEN; i++) {
+        float value = magnitudes[clamp_bin(i - half, bins)];
+        int j = i;
+        for (; j > 0 && window[j - 1] > value; j--) window[j] = window[j - 1];
+        window[j] = value;
+    }
+
+    hpss -> harmonic_energy = 0;
+    hpss -> percussive_energy = 0;
+    for (int bin = 0; bin < bins; bin++) {
+        float mag = magnitudes[bin];
+        float * history = hpss -> history + bin * HPSS_TIME_LEN;
+        float * sorted = hpss -> sorted + bin * HPSS_TIME_LEN;
+
+        sorted_replace(sorted, HPSS_TIME_LEN, history[hpss -> head], mag);
+        history[hpss -> head] = mag;
+        float h = sorted[HPSS_TIME_LEN / 2];
+        float p = window[half];
+        sorted_replace(window, HPSS_FREQ_LEN, magnitudes[clamp_bin(bin - half, bins)],
+                       magnitudes[clamp_bin(bin + half + 1, bins)]);
+
+        // wiener-like soft mask, the stronger median takes the larger share
+        float hh = h * h, pp = p * p;
+        float mask = hh + pp > 0 ? hh / (hh + pp) : 0.5f;
+        hpss -> harmonic[bin] = mag * mask;
+        hpss -> percussive[bin] = mag - hpss -> harmonic[bin];
+        hpss -> harmonic_energy += hpss -> harmonic[bin];
+        hpss -> percussive_energy += hpss -> percussive[bin];
+    }
+    hpss -> head = (hpss -> head + 1) % HPSS_TIME_LEN;
+
+    int hit = hpss -> percussive_energy > HPSS_HIT_RATIO * hpss -> percussive_mean;
+    hpss -> percussive_mean += HPSS_AVG_RATE * (hpss -> percussive_energy - hpss -> percussive_mean);
+    return hit;
+}
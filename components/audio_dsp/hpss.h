@@ -0,0 +1,37 @@
+#ifndef HPSS_H
+#define HPSS_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/* Frames in the per bin time median, sustained tones survive it */
+#define HPSS_TIME_LEN       (7)
+/* Bins in the per frame frequency median, broadband hits survive it */
+#define HPSS_FREQ_LEN       (9)
+/* Percussive energy above this multiple of its running mean is a hit */
+#define HPSS_HIT_RATIO      (2.5f)
+
+typedef struct {
+
+    int bins;
+    float * history;            // bins x HPSS_TIME_LEN ring of past magnitudes
+    float * sorted;             // bins x HPSS_TIME_LEN, the same values kept sorted
+    int head;
+    float window[HPSS_FREQ_LEN];
+    FFT_PRECISION * harmonic;   // magnitudes after the soft masks
+    FFT_PRECISION * percussive;
+    float harmonic_energy;
+    float percussive_energy;
+    float percussive_mean;
+
+} Hpss;
+
+Hpss * create_hpss(int bins);
+
+void free_hpss(Hpss * hpss);
+
+// Splits one frame of magnitudes, returns 1 if the frame is a percussive hit
+int hpss_forward(Hpss * hpss, const FFT_PRECISION * magnitudes);
+
+#endif /* HPSS_H */
@@ -0,0 +1,55 @@
+#include "intensity.h"
+
+// squared deviations are scaled down so 1024 full scale samples fit in int32
+#define INTENSITY_SQ_SHIFT (4)
+
+static int32_t isqrt(int32_t x)
+{
+    int32_t root = 0, bit = 1 << 30;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+void intensity_features(const int16_t * samples, int len, IntensityFeatures * features)
+{
+    int32_t max = samples[0], min = samples[0], sum_sq = 0, crossings = 0;
+    int above = samples[0] > 0;
+
+    for (int i = 0; i < len; i++) {
+        int32_t x = samples[i];
+        if (x > max) max = x;
+        if (x < min) min = x;
+        sum_sq += (x * x) >> INTENSITY_SQ_SHIFT;
+        int now_above = x > 0;
+        crossings += now_above != above;
+        above = now_above;
+    }
+
+    features -> peak_to_peak = max - min;
+    features -> rms = isqrt((sum_sq / len) << INTENSITY_SQ_SHIFT);
+    features -> crossings = crossings;
+}
+
+void intensity_map_build(IntensityMap * map, uint16_t amp_min, uint16_t amp_max)
+{
+    map -> amp_min = amp_min;
+    map -> amp_max = amp_max;
+    for (int i = 0; i < INTENSITY_LUT_LEN; i++) {
+        // same curve as the generic loop, at the bucket's lowest peak-to-peak
+        int32_t range = (i << INTENSITY_LUT_SHIFT) - amp_min;
+        if (range <= 0) {
+            map -> lut[i] = 0;
+        } else {
+            map -> lut[i] = range > amp_max || amp_max == 0 ? 100 : 100 * range / amp_max;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef INTENSITY_H
+#define INTENSITY_H
+
+#include <stdint.h>
+
+/* Peak-to-peak buckets of the intensity table, 12 bit ADC samples give 16 counts per bucket */
+#define INTENSITY_LUT_LEN    (256)
+#define INTENSITY_LUT_SHIFT  (4)
+
+typedef struct {
+
+    int32_t peak_to_peak;
+    int32_t rms;
+    int32_t crossings;      // zero crossings
+
+} IntensityFeatures;
+
+typedef struct {
+
+    uint16_t amp_min;       // thresholds the table was built for
+    uint16_t amp_max;
+    uint8_t lut[INTENSITY_LUT_LEN];
+
+} IntensityMap;
+
+// Peak-to-peak, RMS and zero crossings of DC free 12 bit samples in one int32 pass
+void intensity_features(const int16_t * samples, int len, IntensityFeatures * features);
+
+// Tabulates the 0-100 intensity of every peak-to-peak bucket, only call it when the thresholds change
+void intensity_map_build(IntensityMap * map, uint16_t amp_min, uint16_t amp_max);
+
+static inline uint8_t intensity_map_level(const IntensityMap * map, int32_t peak_to_peak)
+{
+    int32_t bucket = peak_to_peak >> INTENSITY_LUT_SHIFT;
+    return map -> lut[bucket < INTENSITY_LUT_LEN ? bucket : INTENSITY_LUT_LEN - 1];
+}
+
+#endif /* INTENSITY_H */
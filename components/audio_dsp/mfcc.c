@@ -0,0 +1,110 @@
+#include <math.h>
+#include <string.h>
+#include "mfcc.h"
+#include "fast_math.h"
+
+// keeps silent filters finite in the log domain
+#define MFCC_ENERGY_FLOOR (1e-10f)
+
+static FFT_PRECISION hz_to_mel(FFT_PRECISION hz)
+{
+    return 2595.0 * log10(1.0 + hz / 700.0);
+}
+
+static FFT_PRECISION mel_to_hz(FFT_PRECISION mel)
+{
+    return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+Mfcc * create_mfcc(int bins, FFT_PRECISION bin_hz, int filters, int coeffs,
+                   FFT_PRECISION freq_lo, FFT_PRECISION freq_hi)
+{
+    Mfcc * mfcc = (Mfcc *) calloc(1, sizeof(Mfcc));
+    if (!mfcc) return NULL;
+    mfcc -> bins = bins;
+    mfcc -> filters = filters;
+    mfcc -> coeffs = coeffs > filters ? filters : coeffs;
+    mfcc -> row_start = (int *) calloc(filters + 1, sizeof(int));
+    // overlapping triangles: every bin lands in at most two filters
+    mfcc -> cols = (int *) malloc((2 * bins + filters) * sizeof(int));
+    mfcc -> weights = (float *) malloc((2 * bins + filters) * sizeof(float));
+    mfcc -> energies = (FFT_PRECISION *) calloc(filters, sizeof(FFT_PRECISION));
+    mfcc -> mfcc = (FFT_PRECISION *) calloc(filters, sizeof(FFT_PRECISION));
+    mfcc -> mean = (FFT_PRECISION *) calloc(filters, sizeof(FFT_PRECISION));
+    mfcc -> dev = (FFT_PRECISION *) calloc(filters, sizeof(FFT_PRECISION));
+    mfcc -> dct = create_fft_cosq_transformer(filters, FFT_UNSCALED_OUTPUT);
+    if (!mfcc -> row_start || !mfcc -> cols || !mfcc -> weights || !mfcc -> energies
+        || !mfcc -> mfcc || !mfcc -> mean || !mfcc -> dev || !mfcc -> dct) {
+        free_mfcc(mfcc);
+        return NULL;
+    }
+
+    FFT_PRECISION mel_lo = hz_to_mel(freq_lo);
+    FFT_PRECISION mel_step = (hz_to_mel(freq_hi) - mel_lo) / (filters + 1);
+    int nnz = 0;
+    for (int f = 0; f < filters; f++) {
+        FFT_PRECISION left = mel_to_hz(mel_lo + f * mel_step);
+        FFT_PRECISION center = mel_to_hz(mel_lo + (f + 1) * mel_step);
+        FFT_PRECISION right = mel_to_hz(mel_lo + (f + 2) * mel_step);
+        mfcc -> row_start[f] = nnz;
+        for (int k = (int) (left / bin_hz); k < bins && k * bin_hz < right; k++) {
+            FFT_PRECISION freq = k * bin_hz;
+            FFT_PRECISION weight = freq <= center ? (freq - left) / (center - left)
+                                                  : (right - freq) / (right - center);
+            if (weight <= 0) continue;
+            mfcc -> cols[nnz] = k;
+            mfcc -> weights[nnz] = weight;
+            nnz++;
+        }
+        // filters narrower than a bin still get the nearest one
+        if (mfcc -> row_start[f] == nnz) {
+            int k = (int) (center / bin_hz + 0.5);
+            mfcc -> cols[nnz] = k < bins ? k : bins - 1;
+            mfcc -> weights[nnz] = 1;
+            nnz++;
+        }
+    }
+    mfcc -> row_start[filters] = nnz;
+    return mfcc;
+}
+
+void free_mfcc(Mfcc * mfcc)
+{
+    if (mfcc -> dct) free_cosq_fft_transformer(mfcc -> dct);
+    free(mfcc -> row_start);
+    free(mfcc -> cols);
+    free(mfcc -> weights);
+    free(mfcc -> energies);
+    free(mfcc -> mfcc);
+    free(mfcc -> mean);
+    free(mfcc -> dev);
+    free(mfcc);
+}
+
+void mfcc_forward(Mfcc * mfcc, const FFT_PRECISION * magnitudes)
+{
+    FFT_PRECISION * energies = mfcc -> energies;
+    for (int f = 0; f < mfcc -> filters; f++) {
+        float energy = MFCC_ENERGY_FLOOR;
+        for (int j = mfcc -> row_start[f]; j < mfcc -> row_start[f + 1]; j++) {
+            FFT_PRECISION mag = magnitudes[mfcc -> cols[j]];
+            energy += mfcc -> weights[j] * mag * mag;
+        }
+        energies[f] = fast_logf(energy);
+    }
+
+    // the quarter-wave backward transform is 4x a DCT-II
+    fft_cosq_backward(mfcc -> dct, energies);
+    for (int i = 0; i < mfcc -> coeffs; i++) {
+        FFT_PRECISION c = energies[i] / 4;
+        mfcc -> mfcc[i] = c;
+        mfcc -> mean[i] += (c - mfcc -> mean[i]) / MFCC_STATS_RATE;
+        mfcc -> dev[i] += (fabs(c - mfcc -> mean[i]) - mfcc -> dev[i]) / MFCC_STATS_RATE;
+    }
+}
+
+FFT_PRECISION mfcc_normalized(const Mfcc * mfcc, int i)
+{
+    if (mfcc -> dev[i] <= 0) return 0;
+    return (mfcc -> mfcc[i] - mfcc -> mean[i]) / mfcc -> dev[i];
+}
@@ -0,0 +1,39 @@
+#ifndef MFCC_H
+#define MFCC_H
+
+#include "fft.h"
+
+/* Weight of the new frame in the running coefficient statistics, 1/MFCC_STATS_RATE */
+#define MFCC_STATS_RATE (64)
+
+typedef struct {
+
+    int bins;
+    int filters;
+    int coeffs;
+    // triangular mel filters in CSR layout, one row per filter
+    int * row_start;
+    int * cols;
+    float * weights;
+    FFT_PRECISION * energies;  // log filter energies, transformed in place by the DCT
+    FFTCosqTransformer * dct;
+    FFT_PRECISION * mfcc;
+    FFT_PRECISION * mean;      // running statistics used to normalize the coefficients
+    FFT_PRECISION * dev;
+
+} Mfcc;
+
+// Builds `filters` mel filters between freq_lo and freq_hi over `bins` magnitude bins
+// spaced `bin_hz` apart, keeping the first `coeffs` cepstral coefficients
+Mfcc * create_mfcc(int bins, FFT_PRECISION bin_hz, int filters, int coeffs,
+                   FFT_PRECISION freq_lo, FFT_PRECISION freq_hi);
+
+void free_mfcc(Mfcc * mfcc);
+
+// Computes the coefficients of one frame of magnitudes into mfcc -> mfcc
+void mfcc_forward(Mfcc * mfcc, const FFT_PRECISION * magnitudes);
+
+// Coefficient i relative to its running mean, in running mean absolute deviations
+FFT_PRECISION mfcc_normalized(const Mfcc * mfcc, int i);
+
+#endif /* MFCC_H */
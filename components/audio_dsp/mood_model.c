@@ -0,0 +1,42 @@
+/*
+ * Mood classifier weights.
+ *
+ * Trained by host/mood_train on 600 windows of synthesized clips, 50 per mood
+ * from host/mood_windows, whose features come out of the audio task's
+ * pipeline. On 300 windows of 25 other clips per mood the int8 model picks
+ * the labelled mood 95 % of the time, host/classifier_test checks that next
+ * to its parity with the float reference. The clips are synthetic, accuracy
+ * on real music is unmeasured. To train on music, log windows with
+ * DEBUG_MOOD_FEATURES while playing music of a known mood, label them and run
+ * host/mood_train, which prints a replacement for mood_model below.
+ */
+#include "classifier.h"
+
+const ClassifierModel mood_model = {
+    .input_scale = { 2.56435f, 0.706334f, 0.654919f, 0.442129f, 0.386771f, 0.308252f, 0.241636f, 0.243363f, 0.0213919f, 0.0197363f, 0.0163884f, 1.4109f },
+    .w1 = {
+        { -29,  -2, -38, -23, -14, -19, -25, -14, -25, -21,  12,  11 },
+        { -25,  19,  -5,   2,   3, -14,  11,  18,   4,  38, -13,   2 },
+        {   3,   1, -27,  -3,  22,   4,  15,   7, -71,   0, 105,  24 },
+        {  20,  18,  -5, -19,  19,  24, -15,  23,  -3,   2, -25,  15 },
+        { -54, -13,  14,  -5,  35,  13,  -2,   0,  38, 127,   0,  14 },
+        { -18, -13,  10,  11,   5,  14,  -5,  -6,  48,  98,  44, -19 },
+    },
+    .b1 = { -1466, -1062, 1164, 1303, -7564, -3439 },
+    .hidden_mult = 926,
+    .hidden_shift = 17,
+    .w2 = {
+        {   0,  29,  33, -27, 127,  12 },  // mood_calm
+        { -37,  23, -42,  64, -26,  89 },  // mood_energetic
+        {  65, -12, 102,  -1, -66,  12 },  // mood_bass
+        { -36, -42, -15,  -4,  -9, -73 },  // mood_bright
+    },
+    .b2 = { -539, -120, -508, 1167 },
+};
+
+const uint8_t mood_palettes[moods_size][4][3] = {
+    { {  0,  20, 80 }, {  0,  80, 120 }, { 40, 120, 140 }, { 90,  60, 160 } },  // mood_calm
+    { {255,   0,  0 }, {255, 120,   0 }, {255, 255,   0 }, {255,   0, 120 } },  // mood_energetic
+    { { 80,   0, 160}, {160,   0, 255 }, {  0,   0, 255 }, {255,   0,  80 } },  // mood_bass
+    { {  0, 255, 255}, {120, 255, 120 }, {255, 255, 160 }, {255, 255, 255 } },  // mood_bright
+};
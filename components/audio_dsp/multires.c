@@ -0,0 +1,146 @@
+#include <math.h>
+#include <string.h>
+#include "multires.h"
+
+#define MULTIRES_RING_LEN (MULTIRES_SHORT_LEN > MULTIRES_TAPS ? MULTIRES_SHORT_LEN : MULTIRES_TAPS)
+
+static float * hann_window(int len)
+{
+    float * window = (float *) malloc(len * sizeof(float));
+    if (!window) return NULL;
+    for (int i = 0; i < len; i++) window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / len);
+    return window;
+}
+
+MultiRes * create_multires(FFT_PRECISION sample_hz)
+{
+    MultiRes * mr = (MultiRes *) calloc(1, sizeof(MultiRes));
+    if (!mr) return NULL;
+    mr -> sample_hz = sample_hz;
+    mr -> ring = (float *) calloc(MULTIRES_RING_LEN, sizeof(float));
+    mr -> decimated = (float *) calloc(MULTIRES_LONG_LEN, sizeof(float));
+    mr -> short_window = hann_window(MULTIRES_SHORT_LEN);
+    mr -> long_window = hann_window(MULTIRES_LONG_LEN);
+    mr -> short_fft = create_fft_transformer(MULTIRES_SHORT_LEN, FFT_SCALED_OUTPUT);
+    mr -> long_fft = create_fft_transformer(MULTIRES_LONG_LEN, FFT_SCALED_OUTPUT);
+    mr -> work = (FFT_PRECISION *) malloc(MULTIRES_LONG_LEN * sizeof(FFT_PRECISION));
+    mr -> short_band = (uint8_t *) malloc(MULTIRES_SHORT_LEN / 2);
+    mr -> long_band = (uint8_t *) malloc(MULTIRES_LONG_LEN / 2);
+    if (!mr -> ring || !mr -> decimated || !mr -> short_window || !mr -> long_window || !mr -> short_fft
+        || !mr -> long_fft || !mr -> work || !mr -> short_band || !mr -> long_band) {
+        free_multires(mr);
+        return NULL;
+    }
+    memset(mr -> short_band, MULTIRES_NO_BAND, MULTIRES_SHORT_LEN / 2);
+    memset(mr -> long_band, MULTIRES_NO_BAND, MULTIRES_LONG_LEN / 2);
+
+    // hamming windowed sinc, cut off at the decimated nyquist
+    float sum = 0;
+    for (int i = 0; i < MULTIRES_TAPS; i++) {
+        float x = i - (MULTIRES_TAPS - 1) / 2.0f;
+        float sinc = x == 0 ? 1 : sinf(M_PI * x / MULTIRES_DECIMATION) / (M_PI * x / MULTIRES_DECIMATION);
+        mr -> taps[i] = sinc * (0.54f - 0.46f * cosf(2 * M_PI * i / (MULTIRES_TAPS - 1)));
+        sum += mr -> taps[i];
+    }
+    for (int i = 0; i < MULTIRES_TAPS; i++) mr -> taps[i] /= sum;
+    return mr;
+}
+
+void free_multires(MultiRes * mr)
+{
+    if (mr -> short_fft) free_fft_transformer(mr -> short_fft);
+    if (mr -> long_fft) free_fft_transformer(mr -> long_fft);
+    free(mr -> ring);
+    free(mr -> decimated);
+    free(mr -> short_window);
+    free(mr -> long_window);
+    free(mr -> work);
+    free(mr -> short_band);
+    free(mr -> long_band);
+    free(mr);
+}
+
+static void map_bins(uint8_t * table, int bins, FFT_PRECISION bin_hz, const uint16_t * edges, int bands,
+                     FFT_PRECISION from_hz, FFT_PRECISION to_hz)
+{
+    for (int k = 0; k < bins; k++) {
+        FFT_PRECISION freq = k * bin_hz;
+        table[k] = MULTIRES_NO_BAND;
+        if (freq < from_hz || freq >= to_hz) continue;
+        for (int b = 0; b < bands; b++) {
+            if (edges[b] < freq && freq < edges[b + 1]) {
+                table[k] = b;
+                break;
+            }
+        }
+    }
+}
+
+void multires_set_bands(MultiRes * mr, const uint16_t * edges, int bands, FFT_PRECISION crossover_hz)
+{
+    if (bands > MULTIRES_MAX_BANDS) bands = MULTIRES_MAX_BANDS;
+    mr -> bands = bands;
+    mr -> long_due = 0;
+    map_bins(mr -> long_band, MULTIRES_LONG_LEN / 2, mr -> sample_hz / MULTIRES_DECIMATION / MULTIRES_LONG_LEN,
+             edges, bands, 0, crossover_hz);
+    map_bins(mr -> short_band, MULTIRES_SHORT_LEN / 2, mr -> sample_hz / MULTIRES_SHORT_LEN,
+             edges, bands, crossover_hz, mr -> sample_hz);
+}
+
+void multires_push(MultiRes * mr, const float * samples, int len)
+{
+    mr -> long_due -= len;
+    for (int i = 0; i < len; i++) {
+        mr -> ring[mr -> ring_head] = samples[i];
+        mr -> ring_head = (mr -> ring_head + 1) % MULTIRES_RING_LEN;
+        // the FIR only runs for the samples that are kept
+        if (++mr -> phase < MULTIRES_DECIMATION) continue;
+        mr -> phase = 0;
+        float acc = 0;
+        int at = mr -> ring_head;
+        for (int t = 0; t < MULTIRES_TAPS; t++) {
+            at = at ? at - 1 : MULTIRES_RING_LEN - 1;
+            acc += mr -> taps[t] * mr -> ring[at];
+        }
+        mr -> decimated[mr -> decimated_head] = acc;
+        mr -> decimated_head = (mr -> decimated_head + 1) % MULTIRES_LONG_LEN;
+    }
+}
+
+/**
+ * Windows the newest len samples of a ring into the work buffer, transforms
+ * them and adds each bin's power to its band
+ */
+static void accumulate(MultiRes * mr, FFTTransformer * fft, const float * ring, int ring_len, int head,
+                       const float * window, int len, const uint8_t * table, FFT_PRECISION * power)
+{
+    FFT_PRECISION * work = mr -> work;
+    int at = (head - len + ring_len) % ring_len;
+    for (int i = 0; i < len; i++) {
+        work[i] = ring[at] * window[i];
+        at = at + 1 < ring_len ? at + 1 : 0;
+    }
+    fft_forward(fft, work);
+    // packed real layout: dc, then (re, im) pairs
+    for (int k = 1; k < len / 2; k++) {
+        if (table[k] == MULTIRES_NO_BAND) continue;
+        FFT_PRECISION re = work[2 * k - 1], im = work[2 * k];
+        power[table[k]] += re * re + im * im;
+    }
+}
+
+void multires_bands(MultiRes * mr, FFT_PRECISION * out)
+{
+    // with 1/n scaled transforms, band power doesn't depend on the transform length or decimation
+    FFT_PRECISION power[MULTIRES_MAX_BANDS];
+    if (mr -> long_due <= 0) {
+        memset(mr -> long_power, 0, sizeof(mr -> long_power));
+        accumulate(mr, mr -> long_fft, mr -> decimated, MULTIRES_LONG_LEN, mr -> decimated_head,
+                   mr -> long_window, MULTIRES_LONG_LEN, mr -> long_band, mr -> long_power);
+        mr -> long_due = MULTIRES_LONG_HOP;
+    }
+    memcpy(power, mr -> long_power, sizeof(power));
+    accumulate(mr, mr -> short_fft, mr -> ring, MULTIRES_RING_LEN, mr -> ring_head,
+               mr -> short_window, MULTIRES_SHORT_LEN, mr -> short_band, power);
+    for (int b = 0; b < mr -> bands; b++) out[b] = sqrt(power[b]);
+}
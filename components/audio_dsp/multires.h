@@ -0,0 +1,58 @@
+#ifndef MULTIRES_H
+#define MULTIRES_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/* Short transform over the newest samples, for the high bands */
+#define MULTIRES_SHORT_LEN   (256)
+/* Long transform over decimated samples, for the low bands: MULTIRES_LONG_LEN * MULTIRES_DECIMATION
+ * input samples, MULTIRES_DECIMATION times finer bins than a MULTIRES_LONG_LEN transform */
+#define MULTIRES_LONG_LEN    (1024)
+#define MULTIRES_DECIMATION  (4)
+/* Input samples between long transforms, its band power is reused in between */
+#define MULTIRES_LONG_HOP    (1024)
+/* Low pass FIR taps of the decimator */
+#define MULTIRES_TAPS        (32)
+/* Bins outside every band */
+#define MULTIRES_NO_BAND     (0xFF)
+#define MULTIRES_MAX_BANDS   (8)
+
+typedef struct {
+
+    FFT_PRECISION sample_hz;
+    float * ring;               // newest input samples, shared by the short transform and the decimator
+    int ring_head;
+    float * decimated;          // decimated samples ring for the long transform
+    int decimated_head;
+    int phase;                  // input samples until the next decimated output
+    float taps[MULTIRES_TAPS];
+    float * short_window;
+    float * long_window;
+    FFTTransformer * short_fft;
+    FFTTransformer * long_fft;
+    FFT_PRECISION * work;       // MULTIRES_LONG_LEN transform buffer
+    uint8_t * short_band;       // band of each short transform bin, MULTIRES_NO_BAND below the crossover
+    uint8_t * long_band;        // band of each long transform bin, MULTIRES_NO_BAND above the crossover
+    int bands;
+    int long_due;               // input samples until the long transform is recomputed
+    FFT_PRECISION long_power[MULTIRES_MAX_BANDS];
+
+} MultiRes;
+
+// Analyzer for input sampled at sample_hz, in the same frequency units as the band edges
+MultiRes * create_multires(FFT_PRECISION sample_hz);
+
+void free_multires(MultiRes * mr);
+
+// Bands are edges[i] to edges[i + 1], bands below crossover_hz come from the long transform. Only call it when they change
+void multires_set_bands(MultiRes * mr, const uint16_t * edges, int bands, FFT_PRECISION crossover_hz);
+
+// Appends raw samples, with the DC offset already removed
+void multires_push(MultiRes * mr, const float * samples, int len);
+
+// Runs the short transform, and the long one when due, then merges the root of each band's power into out
+void multires_bands(MultiRes * mr, FFT_PRECISION * out);
+
+#endif /* MULTIRES_H */
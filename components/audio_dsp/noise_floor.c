@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include "noise_floor.h"
+
+NoiseFloor * create_noise_floor(int bins)
+{
+    NoiseFloor * noise = (NoiseFloor *) calloc(1, sizeof(NoiseFloor));
+    if (!noise) return NULL;
+    noise -> bins = bins;
+    noise -> smoothed = (float *) calloc(bins, sizeof(float));
+    noise -> current_min = (float *) calloc(bins, sizeof(float));
+    noise -> window_min = (float *) calloc(bins * NOISE_SUBWINDOWS, sizeof(float));
+    noise -> stored_min = (float *) calloc(bins, sizeof(float));
+    if (!noise -> smoothed || !noise -> current_min || !noise -> window_min || !noise -> stored_min) {
+        free_noise_floor(noise);
+        return NULL;
+    }
+    return noise;
+}
+
+void free_noise_floor(NoiseFloor * noise)
+{
+    free(noise -> smoothed);
+    free(noise -> current_min);
+    free(noise -> window_min);
+    free(noise -> stored_min);
+    free(noise);
+}
+
+void noise_floor_reset(NoiseFloor * noise)
+{
+    noise -> started = 0;
+}
+
+float noise_floor_level(const NoiseFloor * noise, int bin)
+{
+    if (!noise -> started) return 0;
+    float current = noise -> current_min[bin];
+    return current < noise -> stored_min[bin] ? current : noise -> stored_min[bin];
+}
+
+/**
+ * Starts every minimum at the first frame, so the floor is usable right away
+ * and drops to the real minimum within a window
+ */
+static void noise_floor_start(NoiseFloor * noise, const FFT_PRECISION * magnitudes)
+{
+    for (int bin = 0; bin < noise -> bins; bin++) {
+        float mag = magnitudes[bin];
+        noise -> smoothed[bin] = mag;
+        noise -> current_min[bin] = mag;
+        noise -> stored_min[bin] = mag;
+        for (int i = 0; i < NOISE_SUBWINDOWS; i++) noise -> window_min[bin * NOISE_SUBWINDOWS + i] = mag;
+    }
+    noise -> frame = 0;
+    noise -> slot = 0;
+    noise -> started = 1;
+}
+
+/**
+ * Closes the running subwindow: its minimum replaces the oldest one
+ * and the window minimum is recomputed from the subwindow minima
+ */
+static void noise_floor_rotate(NoiseFloor * noise)
+{
+    for (int bin = 0; bin < noise -> bins; bin++) {
+        float * window = noise -> window_min + bin * NOISE_SUBWINDOWS;
+        window[noise -> slot] = noise -> current_min[bin];
+        noise -> current_min[bin] = noise -> smoothed[bin];
+        float min = window[0];
+        for (int i = 1; i < NOISE_SUBWINDOWS; i++) {
+            if (window[i] < min) min = window[i];
+        }
+        noise -> stored_min[bin] = min;
+    }
+    noise -> slot = (noise -> slot + 1) % NOISE_SUBWINDOWS;
+    noise -> frame = 0;
+}
+
+void noise_floor_apply(NoiseFloor * noise, FFT_PRECISION * magnitudes)
+{
+    if (!noise -> started) {
+        if (noise -> frozen) return;
+        noise_floor_start(noise, magnitudes);
+    }
+
+    for (int bin = 0; bin < noise -> bins; bin++) {
+        if (!noise -> frozen) {
+            float smoothed = NOISE_SMOOTHING * noise -> smoothed[bin] + (1 - NOISE_SMOOTHING) * magnitudes[bin];
+            noise -> smoothed[bin] = smoothed;
+            if (smoothed < noise -> current_min[bin]) noise -> current_min[bin] = smoothed;
+        }
+        FFT_PRECISION clean = magnitudes[bin] - NOISE_OVERSUBTRACT * noise_floor_level(noise, bin);
+        magnitudes[bin] = clean > 0 ? clean : 0;
+    }
+
+    if (!noise -> frozen && ++noise -> frame == NOISE_SUBWINDOW_LEN) noise_floor_rotate(noise);
+}
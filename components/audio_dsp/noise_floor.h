@@ -0,0 +1,44 @@
+#ifndef NOISE_FLOOR_H
+#define NOISE_FLOOR_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/* Minimum statistics over NOISE_SUBWINDOWS x NOISE_SUBWINDOW_LEN frames (about 3 s),
+ * the window minimum is kept per subwindow so sliding it costs no rescans */
+#define NOISE_SUBWINDOWS     (8)
+#define NOISE_SUBWINDOW_LEN  (16)
+/* Weight of the previous smoothed magnitude */
+#define NOISE_SMOOTHING      (0.7f)
+/* The minimum sits below the mean noise level, subtract this multiple of it */
+#define NOISE_OVERSUBTRACT   (2.0f)
+
+typedef struct {
+
+    int bins;
+    float * smoothed;       // recursively smoothed magnitudes
+    float * current_min;    // minimum of the running subwindow
+    float * window_min;     // bins x NOISE_SUBWINDOWS, minima of the finished subwindows
+    float * stored_min;     // minimum of window_min per bin
+    int frame;              // frames into the running subwindow
+    int slot;               // window_min slot the running subwindow goes to
+    int started;
+    int frozen;             // keeps subtracting without updating the floor
+
+} NoiseFloor;
+
+NoiseFloor * create_noise_floor(int bins);
+
+void free_noise_floor(NoiseFloor * noise);
+
+// Forgets the floor, the next frame starts a new estimate
+void noise_floor_reset(NoiseFloor * noise);
+
+// Updates the floor with the frame unless frozen, then subtracts it from the magnitudes in place
+void noise_floor_apply(NoiseFloor * noise, FFT_PRECISION * magnitudes);
+
+// Current floor estimate of a bin
+float noise_floor_level(const NoiseFloor * noise, int bin);
+
+#endif /* NOISE_FLOOR_H */
@@ -0,0 +1,126 @@
+#include <math.h>
+#include <string.h>
+#include "spectral_hue.h"
+
+HueMap * create_hue_map(int bins, FFT_PRECISION bin_hz)
+{
+    HueMap * map = (HueMap *) calloc(1, sizeof(HueMap));
+    if (!map) return NULL;
+    map -> bin_pos = (uint16_t *) calloc(bins, sizeof(uint16_t));
+    if (!map -> bin_pos) {
+        free(map);
+        return NULL;
+    }
+    map -> bins = bins;
+    map -> bin_hz = bin_hz;
+    hue_map_default_palette(map);
+    return map;
+}
+
+void free_hue_map(HueMap * map)
+{
+    free(map -> bin_pos);
+    free(map);
+}
+
+void hue_map_set_range(HueMap * map, FFT_PRECISION freq_lo, FFT_PRECISION freq_hi)
+{
+    if (freq_lo < map -> bin_hz) freq_lo = map -> bin_hz;
+    if (freq_hi <= freq_lo) freq_hi = freq_lo + map -> bin_hz;
+
+    map -> bin_lo = (int) ceil(freq_lo / map -> bin_hz);
+    map -> bin_hi = (int) floor(freq_hi / map -> bin_hz);
+    // keep a neighbour on each side for the interpolation
+    if (map -> bin_lo < 1) map -> bin_lo = 1;
+    if (map -> bin_hi > map -> bins - 2) map -> bin_hi = map -> bins - 2;
+    if (map -> bin_hi < map -> bin_lo) map -> bin_hi = map -> bin_lo;
+
+    FFT_PRECISION span = log(freq_hi / freq_lo);
+    for (int k = 0; k < map -> bins; k++) {
+        FFT_PRECISION freq = k * map -> bin_hz;
+        FFT_PRECISION pos = k == 0 ? 0 : (HUE_PALETTE_LEN - 1) * log(freq / freq_lo) / span;
+        if (pos < 0) pos = 0;
+        if (pos > HUE_PALETTE_LEN - 1) pos = HUE_PALETTE_LEN - 1;
+        map -> bin_pos[k] = (uint16_t) (pos * 256);
+    }
+}
+
+int hue_map_set_palette(HueMap * map, const uint8_t * stops, size_t len)
+{
+    int count = len / 3;
+    if (len % 3 || count < HUE_STOPS_MIN || count > HUE_STOPS_MAX) return -1;
+
+    for (int i = 0; i < HUE_PALETTE_LEN; i++) {
+        int pos = i * (count - 1) * 256 / (HUE_PALETTE_LEN - 1);
+        int seg = pos >> 8;
+        int frac = pos & 0xFF;
+        if (seg >= count - 1) {
+            seg = count - 2;
+            frac = 256;
+        }
+        for (int c = 0; c < 3; c++) {
+            int from = stops[3 * seg + c];
+            int to = stops[3 * (seg + 1) + c];
+            map -> palette[i][c] = (uint8_t) (from + (((to - from) * frac) >> 8));
+        }
+    }
+    return 0;
+}
+
+void hue_map_default_palette(HueMap * map)
+{
+    // hue 0 (red) to 270 degrees (violet), full saturation and value
+    for (int i = 0; i < HUE_PALETTE_LEN; i++) {
+        int hue = i * 270 * 256 / ((HUE_PALETTE_LEN - 1) * 60);
+        int sector = hue >> 8;
+        uint8_t rise = hue & 0xFF;
+        uint8_t fall = 255 - rise;
+        uint8_t * rgb = map -> palette[i];
+        switch (sector) {
+            case 0: rgb[0] = 255;  rgb[1] = rise; rgb[2] = 0;    break;
+            case 1: rgb[0] = fall; rgb[1] = 255;  rgb[2] = 0;    break;
+            case 2: rgb[0] = 0;    rgb[1] = 255;  rgb[2] = rise; break;
+            case 3: rgb[0] = 0;    rgb[1] = fall; rgb[2] = 255;  break;
+            default: rgb[0] = rise; rgb[1] = 0;   rgb[2] = 255;  break;
+        }
+    }
+}
+
+FFT_PRECISION spectral_peak(const HueMap * map, const FFT_PRECISION * magnitudes)
+{
+    int peak = map -> bin_lo;
+    for (int k = map -> bin_lo + 1; k <= map -> bin_hi; k++) {
+        if (magnitudes[k] > magnitudes[peak]) peak = k;
+    }
+
+    // vertex of the parabola through the peak and its neighbours
+    FFT_PRECISION a = magnitudes[peak - 1];
+    FFT_PRECISION b = magnitudes[peak];
+    FFT_PRECISION c = magnitudes[peak + 1];
+    FFT_PRECISION denom = a - 2 * b + c;
+    if (denom >= 0) return peak;
+
+    FFT_PRECISION delta = 0.5 * (a - c) / denom;
+    if (delta > 0.5) delta = 0.5;
+    if (delta < -0.5) delta = -0.5;
+    return peak + delta;
+}
+
+void hue_map_color(const HueMap * map, FFT_PRECISION bin, uint8_t rgb[3])
+{
+    int k = (int) bin;
+    if (k < 0) k = 0;
+    if (k > map -> bins - 2) k = map -> bins - 2;
+    int frac = (int) ((bin - k) * 256);
+    if (frac < 0) frac = 0;
+    if (frac > 256) frac = 256;
+
+    int pos = map -> bin_pos[k] + (((map -> bin_pos[k + 1] - map -> bin_pos[k]) * frac) >> 8);
+    int idx = pos >> 8;
+    int mix = pos & 0xFF;
+    int next = idx < HUE_PALETTE_LEN - 1 ? idx + 1 : idx;
+    for (int c = 0; c < 3; c++) {
+        int from = map -> palette[idx][c];
+        rgb[c] = (uint8_t) (from + (((map -> palette[next][c] - from) * mix) >> 8));
+    }
+}
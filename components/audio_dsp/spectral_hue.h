@@ -0,0 +1,45 @@
+#ifndef SPECTRAL_HUE_H
+#define SPECTRAL_HUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "fft.h"
+
+#define HUE_PALETTE_LEN   (256)
+/* Custom palettes are uploaded as 2 to HUE_PALETTE_LEN rgb stops */
+#define HUE_STOPS_MIN     (2)
+#define HUE_STOPS_MAX     (HUE_PALETTE_LEN)
+
+typedef struct {
+
+    int bins;
+    FFT_PRECISION bin_hz;
+    int bin_lo;          // first bin searched for the peak
+    int bin_hi;          // last bin searched for the peak
+    uint16_t * bin_pos;  // log-frequency palette position of each bin, 8.8 fixed point
+    uint8_t palette[HUE_PALETTE_LEN][3];
+
+} HueMap;
+
+// Allocates a map for `bins` magnitude bins spaced `bin_hz` apart, with the default palette
+HueMap * create_hue_map(int bins, FFT_PRECISION bin_hz);
+
+void free_hue_map(HueMap * map);
+
+// Rebuilds the bin to palette position table for a new frequency range, only call it when the range changes
+void hue_map_set_range(HueMap * map, FFT_PRECISION freq_lo, FFT_PRECISION freq_hi);
+
+// Expands `len / 3` rgb stops into the palette, returns 0 or -1 if len isn't a valid stop count
+int hue_map_set_palette(HueMap * map, const uint8_t * stops, size_t len);
+
+// Fills the palette with a red to violet hue wheel
+void hue_map_default_palette(HueMap * map);
+
+// Dominant peak between bin_lo and bin_hi, refined with parabolic interpolation. Returns a fractional bin
+FFT_PRECISION spectral_peak(const HueMap * map, const FFT_PRECISION * magnitudes);
+
+// Palette color of a fractional bin
+void hue_map_color(const HueMap * map, FFT_PRECISION bin, uint8_t rgb[3]);
+
+#endif /* SPECTRAL_HUE_H */
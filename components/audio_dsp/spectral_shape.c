@@ -0,0 +1,64 @@
+#include <math.h>
+#include "spectral_shape.h"
+#include "fast_math.h"
+
+// keeps log2 finite on silent bins
+#define SHAPE_POWER_FLOOR (1e-12f)
+
+void spectral_shape(const FFT_PRECISION * magnitudes, int bin_lo, int bin_hi, FFT_PRECISION bin_hz,
+                    SpectralShape * shape)
+{
+    const int n = bin_hi - bin_lo + 1;
+    const int block_len = (n + SHAPE_ROLLOFF_BLOCKS - 1) / SHAPE_ROLLOFF_BLOCKS;
+    float cumulative[SHAPE_ROLLOFF_BLOCKS + 1];
+    float sum = 0, sum_f = 0, sum_ff = 0, power = 0, log_power = 0;
+
+    cumulative[0] = 0;
+    for (int k = bin_lo, i = 0; k <= bin_hi; k++, i++) {
+        float mag = magnitudes[k];
+        float freq = k * bin_hz;
+        float p = mag * mag;
+        sum += mag;
+        sum_f += mag * freq;
+        sum_ff += mag * freq * freq;
+        power += p;
+        log_power += fast_log2f(p + SHAPE_POWER_FLOOR);
+        // energy checkpoint at the end of every block, for the rolloff search below
+        if ((i + 1) % block_len == 0 || k == bin_hi) cumulative[i / block_len + 1] = power;
+    }
+
+    if (n <= 0 || sum <= 0) {
+        *shape = (SpectralShape) {0};
+        return;
+    }
+
+    shape -> centroid = sum_f / sum;
+    float variance = sum_ff / sum - shape -> centroid * shape -> centroid;
+    shape -> bandwidth = variance > 0 ? sqrtf(variance) : 0;
+    shape -> flatness = exp2f(log_power / n) / (power / n);
+
+    // block crossing the rolloff share, linearly interpolated inside it
+    float target = SHAPE_ROLLOFF_SHARE * power;
+    int block = 0;
+    while (cumulative[block + 1] < target) block++;
+    float in_block = cumulative[block + 1] - cumulative[block];
+    float frac = in_block > 0 ? (target - cumulative[block]) / in_block : 0;
+    int first = bin_lo + block * block_len;
+    int len = bin_hi - first + 1 < block_len ? bin_hi - first + 1 : block_len;
+    shape -> rolloff = (first + frac * len) * bin_hz;
+}
+
+float spectral_shape_level(const SpectralShape * shape, int feature, float freq_lo, float freq_hi)
+{
+    float freq;
+    switch (feature) {
+        case shape_centroid: freq = shape -> centroid; break;
+        case shape_bandwidth: freq = shape -> bandwidth; break;
+        case shape_rolloff: freq = shape -> rolloff; break;
+        case shape_flatness: return shape -> flatness > 1 ? 1 : shape -> flatness;
+        default: return 0;
+    }
+    if (freq <= freq_lo) return 0;
+    if (freq >= freq_hi) return 1;
+    return fast_log2f(freq / freq_lo) / fast_log2f(freq_hi / freq_lo);
+}
@@ -0,0 +1,42 @@
+#ifndef SPECTRAL_SHAPE_H
+#define SPECTRAL_SHAPE_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/* Share of the spectral energy below the rolloff frequency */
+#define SHAPE_ROLLOFF_SHARE   (0.85f)
+/* Cumulative energy checkpoints kept for the rolloff, it's interpolated inside one checkpoint block */
+#define SHAPE_ROLLOFF_BLOCKS  (64)
+
+#define FOREACH_SHAPE_FEATURE(FEATURE) \
+        FEATURE(shape_centroid) \
+        FEATURE(shape_bandwidth) \
+        FEATURE(shape_rolloff) \
+        FEATURE(shape_flatness) \
+        FEATURE(shape_features_size) \
+
+#define GENERATE_SHAPE_ENUM(ENUM) ENUM,
+
+enum shape_feature_enum {
+    FOREACH_SHAPE_FEATURE(GENERATE_SHAPE_ENUM)
+};
+
+typedef struct {
+
+    float centroid;     // Hz, magnitude weighted mean frequency
+    float bandwidth;    // Hz, magnitude weighted deviation around the centroid
+    float rolloff;      // Hz, frequency below which SHAPE_ROLLOFF_SHARE of the energy lies
+    float flatness;     // geometric over arithmetic mean of the power, 0 tonal to 1 noise-like
+
+} SpectralShape;
+
+// All four features of bins bin_lo to bin_hi in a single pass over the magnitudes
+void spectral_shape(const FFT_PRECISION * magnitudes, int bin_lo, int bin_hi, FFT_PRECISION bin_hz,
+                    SpectralShape * shape);
+
+// A feature scaled to 0..1, frequencies on a log scale between freq_lo and freq_hi
+float spectral_shape_level(const SpectralShape * shape, int feature, float freq_lo, float freq_hi);
+
+#endif /* SPECTRAL_SHAPE_H */
@@ -0,0 +1,45 @@
+#include "spectrum_frame.h"
+#include "fast_math.h"
+
+// half dB steps per octave of magnitude, 2 * 20 * log10(2)
+#define SPECTRUM_STEPS_PER_LOG2 (12.0412f)
+#define SPECTRUM_FRESH          (4u)
+
+static uint8_t quantize(float magnitude)
+{
+    if (magnitude <= 0) return 0;
+    float level = SPECTRUM_STEPS_PER_LOG2 * fast_log2f_lut(magnitude) - 2 * SPECTRUM_DB_FLOOR;
+    return level <= 0 ? 0 : (level >= 255 ? 255 : (uint8_t)(level + 0.5f));
+}
+
+void spectrum_frame_quantize(SpectrumFrame * frame, const FFT_PRECISION * bands, const FFT_PRECISION * magnitudes)
+{
+    for (int b = 0; b < SPECTRUM_BANDS; b++) {
+        frame -> bands[b] = quantize(bands[b]);
+    }
+    for (int k = 0; k < SPECTRUM_BINS; k++) {
+        const FFT_PRECISION * group = magnitudes + k * SPECTRUM_GROUP;
+        FFT_PRECISION peak = group[0];
+        for (int i = 1; i < SPECTRUM_GROUP; i++) {
+            if (group[i] > peak) peak = group[i];
+        }
+        frame -> bins[k] = quantize(peak);
+    }
+}
+
+SpectrumFrame * spectrum_mailbox_back(SpectrumMailbox * mailbox)
+{
+    return &mailbox -> slots[mailbox -> back];
+}
+
+void spectrum_mailbox_publish(SpectrumMailbox * mailbox)
+{
+    mailbox -> back = atomic_exchange(&mailbox -> middle, mailbox -> back | SPECTRUM_FRESH) & ~SPECTRUM_FRESH;
+}
+
+const SpectrumFrame * spectrum_mailbox_take(SpectrumMailbox * mailbox)
+{
+    if (!(atomic_load(&mailbox -> middle) & SPECTRUM_FRESH)) return NULL;
+    mailbox -> front = atomic_exchange(&mailbox -> middle, mailbox -> front) & ~SPECTRUM_FRESH;
+    return &mailbox -> slots[mailbox -> front];
+}
@@ -0,0 +1,50 @@
+#ifndef SPECTRUM_FRAME_H
+#define SPECTRUM_FRAME_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "fft.h"
+
+/* Published bins, each the loudest of SPECTRUM_GROUP adjacent magnitude bins,
+ * together they cover the FFT_BINS of the band loop */
+#define SPECTRUM_BINS     (128)
+#define SPECTRUM_GROUP    (4)
+#define SPECTRUM_BANDS    (3)
+/* 8 bit levels in half dB steps, 0 at SPECTRUM_DB_FLOOR (magnitude 1 is 0 dB) or below */
+#define SPECTRUM_DB_FLOOR (-80)
+
+typedef struct {
+
+    uint8_t bands[SPECTRUM_BANDS];  // red, green, blue
+    uint8_t bins[SPECTRUM_BINS];
+
+} SpectrumFrame;
+
+/* Single slot mailbox that always holds the newest frame. One writer and one reader
+ * each own a slot, the third is swapped between them with an atomic exchange, so
+ * neither side ever waits. The fresh flag in middle marks a frame the reader hasn't taken */
+typedef struct {
+
+    SpectrumFrame slots[3];
+    atomic_uint middle;
+    unsigned back;          // writer's slot
+    unsigned front;         // reader's slot
+
+} SpectrumMailbox;
+
+#define SPECTRUM_MAILBOX_INIT { .middle = 1, .back = 0, .front = 2 }
+
+// Quantizes the band energies and SPECTRUM_BINS * SPECTRUM_GROUP magnitude bins
+void spectrum_frame_quantize(SpectrumFrame * frame, const FFT_PRECISION * bands, const FFT_PRECISION * magnitudes);
+
+// Frame the writer fills before publishing it
+SpectrumFrame * spectrum_mailbox_back(SpectrumMailbox * mailbox);
+
+// Makes the filled frame the newest one, replacing a frame the reader didn't take
+void spectrum_mailbox_publish(SpectrumMailbox * mailbox);
+
+// Newest frame if one was published since the last take, else NULL. Valid until the next take
+const SpectrumFrame * spectrum_mailbox_take(SpectrumMailbox * mailbox);
+
+#endif /* SPECTRUM_FRAME_H */
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "audio_share.h"
+
+static void put_le(uint8_t *p, uint64_t value, size_t len)
+{
+    for (size_t i = 0; i < len; i++) p[i] = value >> (8 * i);
+}
+
+static uint64_t get_le(const uint8_t *p, size_t len)
+{
+    uint64_t value = 0;
+    for (size_t i = len; i > 0; i--) value = value << 8 | p[i - 1];
+    return value;
+}
+
+size_t share_encode(uint8_t *packet, uint32_t leader_id, uint8_t flags, const share_frame *frame)
+{
+    packet[0] = SHARE_MAGIC;
+    packet[1] = SHARE_VERSION;
+    packet[2] = flags;
+    packet[3] = frame->seq;
+    put_le(&packet[4], leader_id, 4);
+    put_le(&packet[8], (uint64_t)frame->capture_us, 8);
+    memcpy(&packet[16], frame->rgb, 3);
+    packet[19] = frame->intensity;
+    memcpy(&packet[20], frame->bands, 3);
+    put_le(&packet[23], (uint16_t)frame->beat_ms, 2);
+    put_le(&packet[25], frame->period_ms, 2);
+    return SHARE_PACKET_LEN;
+}
+
+int share_decode(const uint8_t *packet, size_t len, uint32_t *leader_id, uint8_t *flags, share_frame *frame)
+{
+    if (len < 2 || packet[0] != SHARE_MAGIC || packet[1] != SHARE_VERSION)
+        return SHARE_ERR_HEADER;
+    if (len != SHARE_PACKET_LEN)
+        return SHARE_ERR_SIZE;
+    *flags = packet[2];
+    frame->seq = packet[3];
+    *leader_id = (uint32_t)get_le(&packet[4], 4);
+    frame->capture_us = (int64_t)get_le(&packet[8], 8);
+    memcpy(frame->rgb, &packet[16], 3);
+    frame->intensity = packet[19] > 100 ? 100 : packet[19];
+    memcpy(frame->bands, &packet[20], 3);
+    frame->beat_ms = (int16_t)get_le(&packet[23], 2);
+    frame->period_ms = (uint16_t)get_le(&packet[25], 2);
+    return SHARE_OK;
+}
+
+void share_jitter_reset(share_jitter *jitter)
+{
+    jitter->count = 0;
+    jitter->played_us = INT64_MIN;
+}
+
+int share_jitter_push(share_jitter *jitter, const share_frame *frame)
+{
+    if (frame->capture_us <= jitter->played_us)
+        return 0;
+    /* frames mostly arrive in order, search from the newest */
+    int pos = jitter->count;
+    while (pos > 0 && jitter->slots[pos - 1].capture_us > frame->capture_us) pos--;
+    if (pos > 0 && jitter->slots[pos - 1].capture_us == frame->capture_us)
+        return 0;
+    if (jitter->count == SHARE_JITTER_SLOTS) {
+        if (pos == 0)
+            return 0;
+        memmove(&jitter->slots[0], &jitter->slots[1], (SHARE_JITTER_SLOTS - 1) * sizeof(share_frame));
+        jitter->count--;
+        pos--;
+    }
+    memmove(&jitter->slots[pos + 1], &jitter->slots[pos], (jitter->count - pos) * sizeof(share_frame));
+    jitter->slots[pos] = *frame;
+    jitter->count++;
+    return 1;
+}
+
+int share_jitter_pop(share_jitter *jitter, int64_t due_us, share_frame *frame)
+{
+    int due = 0;
+    while (due < jitter->count && jitter->slots[due].capture_us <= due_us) due++;
+    if (!due)
+        return 0;
+    *frame = jitter->slots[due - 1];
+    jitter->played_us = frame->capture_us;
+    jitter->count -= due;
+    memmove(&jitter->slots[0], &jitter->slots[due], jitter->count * sizeof(share_frame));
+    return 1;
+}
+
+void share_election_start(share_election *election, uint32_t self_id, int64_t now_us)
+{
+    election->self_id = self_id;
+    election->leader_id = 0;
+    election->leader_seen_us = now_us;
+}
+
+int share_election_heard(share_election *election, uint32_t leader_id, int64_t now_us)
+{
+    if (leader_id == election->self_id)
+        return 0;
+    int silent = now_us - election->leader_seen_us > SHARE_LEADER_TIMEOUT_US;
+    /* a leading node only gives way to a lower id, the other one steps down when it hears this one */
+    if (election->leader_id == election->self_id && leader_id > election->self_id)
+        return 0;
+    if (election->leader_id == 0 || leader_id <= election->leader_id || silent) {
+        election->leader_id = leader_id;
+        election->leader_seen_us = now_us;
+        return 1;
+    }
+    return 0;
+}
+
+uint32_t share_election_tick(share_election *election, uint8_t role, int64_t now_us)
+{
+    if (election->leader_id != election->self_id
+            && now_us - election->leader_seen_us > SHARE_LEADER_TIMEOUT_US) {
+        election->leader_id = role == SHARE_AUTO ? election->self_id : 0;
+        election->leader_seen_us = now_us;
+    }
+    return election->leader_id;
+}
@@ -0,0 +1,95 @@
+#ifndef AUDIO_SHARE_H
+#define AUDIO_SHARE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* In a group one node, the leader, captures and analyzes audio and sends every color it shows to
+ * the multicast group. The other nodes, followers, show the same colors a fixed delay after their
+ * capture time, so all strips of a room change together.
+ *
+ * Packet layout, integers little endian:
+ * magic, version, flags, sequence, leader id (4 bytes), capture time in the leader's clock (8 bytes, us),
+ * red, green, blue, intensity (0 - 100), red, green and blue band levels (half dB steps, see spectrum_frame.h),
+ * next predicted beat in ms from the capture time (signed) and the beat period in ms, 0 without beats */
+#define SHARE_MAGIC           (0x53)
+#define SHARE_VERSION         (1)
+#define SHARE_PACKET_LEN      (27)
+/* The packet carries a frame, without it it's a heartbeat of the leader */
+#define SHARE_FLAG_AUDIO      (0x01)
+
+/* Frames waiting for their time on a follower */
+#define SHARE_JITTER_SLOTS    (8)
+/* A leader not heard for this long is replaced */
+#define SHARE_LEADER_TIMEOUT_US (1000000)
+/* A leader sends a heartbeat this often, the group link polls for packets every SHARE_POLL_MS */
+#define SHARE_HEARTBEAT_US    (250000)
+#define SHARE_POLL_MS         (10)
+
+enum share_err {
+    SHARE_OK = 0,
+    SHARE_ERR_HEADER = -1,
+    SHARE_ERR_SIZE = -2,
+};
+
+/* Group roles, set through prefs?group */
+enum share_role {
+    SHARE_OFF = 0,     /* no group, the node runs on its own */
+    SHARE_AUTO,        /* leads when no leader is heard */
+    SHARE_FOLLOW,      /* never leads, for nodes without a microphone */
+};
+
+typedef struct share_frame
+{
+  int64_t capture_us;
+  uint8_t rgb[3];
+  uint8_t intensity;
+  uint8_t bands[3];
+  uint8_t seq;
+  int16_t beat_ms;
+  uint16_t period_ms;
+} share_frame;
+
+typedef struct share_jitter
+{
+  share_frame slots[SHARE_JITTER_SLOTS];   /* oldest first */
+  uint8_t count;
+  int64_t played_us;                       /* capture time of the last frame shown */
+} share_jitter;
+
+typedef struct share_election
+{
+  uint32_t self_id;
+  uint32_t leader_id;        /* 0 while there is none */
+  int64_t leader_seen_us;
+} share_election;
+
+/* Writes a packet of SHARE_PACKET_LEN bytes */
+size_t share_encode(uint8_t *packet, uint32_t leader_id, uint8_t flags, const share_frame *frame);
+
+/* Reads a packet, returns SHARE_OK or a negative share_err */
+int share_decode(const uint8_t *packet, size_t len, uint32_t *leader_id, uint8_t *flags, share_frame *frame);
+
+void share_jitter_reset(share_jitter *jitter);
+
+/* Queues a frame by capture time. Frames older than the last one shown and repeats are dropped,
+ * a full buffer drops its oldest frame. Returns 1 if the frame was queued */
+int share_jitter_push(share_jitter *jitter, const share_frame *frame);
+
+/* Takes every frame captured by due_us, the newest of them is left in frame.
+ * Returns 0 if none is due yet */
+int share_jitter_pop(share_jitter *jitter, int64_t due_us, share_frame *frame);
+
+/* Starts over without a leader, nobody is claimed before a timeout so a running leader is heard first */
+void share_election_start(share_election *election, uint32_t self_id, int64_t now_us);
+
+/* Called for every packet of another node. A heard leader is kept while it's alive so joining nodes
+ * don't take over, of two nodes leading at once the lower id wins and a silent leader is replaced
+ * by the next one heard. Returns 1 if the sender is the leader followed now */
+int share_election_heard(share_election *election, uint32_t leader_id, int64_t now_us);
+
+/* Claims the lead once no leader was heard for SHARE_LEADER_TIMEOUT_US, if the role allows it.
+ * Returns the leader id, self_id when this node leads and 0 when there is none */
+uint32_t share_election_tick(share_election *election, uint8_t role, int64_t now_us);
+
+#endif /* AUDIO_SHARE_H */
@@ -1,12 +1,29 @@
 #include <stdio.h>
+#include <stdatomic.h>
 #include "coap_endpoints.h"
 #include "mdns.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "rgb_leds.h"
+#include "group_dedup.h"
 
 #define MAX_LEN_ROOM_NAME 30
 #define MAX_LEN_CTRL_NAME 10
 
+/* /state layout: format, mode, rgb, the prefs settings, room name length and the name without its terminator */
+#define STATE_FORMAT      (1)
+#define STATE_HEADER_LEN  (2 + sizeof(rgb_data) + sizeof(settings.settings_data) + 1)
+
+/* /spectrum layout: format, flags, sequence, band count, bin count, then the bands and bins.
+ * Delta frames hold byte differences to the previous notification, runs of unchanged
+ * values as a 0 and the run length. Every SPECTRUM_KEY_FRAMES-th frame is complete */
+#define SPECTRUM_FORMAT      (1)
+#define SPECTRUM_FLAG_DELTA  (1)
+#define SPECTRUM_HEADER_LEN  (5)
+#define SPECTRUM_KEY_FRAMES  (16)
+/* Observers remembered with the last frame they got, more than this get complete frames */
+#define SPECTRUM_OBSERVERS   (8)
+
 const static char *TAG = "CoAP Endpoints";
 
 EventGroupHandle_t endpoint_events;
@@ -15,6 +32,61 @@ uint8_t rgb_data[3];
 settings_data_t settings;
 control_mode ctrl_mode = manual;
 char ctrl_text[MAX_LEN_CTRL_NAME];
+uint8_t scene_data[SCENE_MAX_LEN];
+size_t scene_len;
+uint32_t scene_version;
+portMUX_TYPE scene_mux = portMUX_INITIALIZER_UNLOCKED;
+uint8_t frames_data[FRAMES_MAX_LEN];
+size_t frames_len;
+uint32_t frames_version;
+portMUX_TYPE frames_mux = portMUX_INITIALIZER_UNLOCKED;
+uint8_t palette_stops[HUE_STOPS_MAX * 3];
+size_t palette_len;
+uint32_t palette_version;
+portMUX_TYPE palette_mux = portMUX_INITIALIZER_UNLOCKED;
+SpectralShape shape_features;
+uint32_t shape_version;
+portMUX_TYPE shape_mux = portMUX_INITIALIZER_UNLOCKED;
+uint8_t shape_drivers[2] = {shape_centroid, SHAPE_DRIVER_AMPLITUDE};
+uint8_t noise_frozen;
+uint32_t noise_reset_version;
+uint8_t band_balance_on;
+/* Edges the audio task balanced, 0 while it hasn't, guarded by config_mux like the writer side config */
+static uint16_t balanced_b_end, balanced_g_end;
+db_scale_storage db_scale = DB_SCALE_DEFAULTS;
+uint8_t group_role = SHARE_OFF;
+uint32_t state_version;
+SpectrumMailbox spectrum_mailbox = SPECTRUM_MAILBOX_INIT;
+uint16_t spectrum_interval_ms = SPECTRUM_INTERVAL_DEFAULT;
+time_sync node_clock;
+portMUX_TYPE clock_mux = portMUX_INITIALIZER_UNLOCKED;
+/* The time source set by each owner and the one in effect, written by the CoAP task and group_link */
+static portMUX_TYPE time_source_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t user_time_source;
+static uint32_t group_time_source = TIME_SOURCE_RELEASED;
+static uint32_t time_source;
+static uint32_t time_source_version;
+dtls_handshake_stats dtls_handshakes;
+/* Frames of the current and the previous notification, only touched by the CoAP task */
+static SpectrumFrame spectrum_current, spectrum_previous;
+static uint8_t spectrum_sequence;
+/* Observations by a hash of session and token, a delta only goes to one that got the previous frame */
+typedef struct spectrum_observer {
+    uint32_t key;
+    uint8_t sequence;
+    uint8_t has_frame;
+} spectrum_observer;
+static spectrum_observer spectrum_observers[SPECTRUM_OBSERVERS];
+static unsigned spectrum_observer_next;
+/* The last group PUTs, only touched by the CoAP task */
+static group_dedup group_requests;
+/* Config snapshots rotate through three slots, a writer fills one that is neither
+ * published nor held by the audio task. config_held is the hazard pointer the audio
+ * task sets before it reads a snapshot, writers are serialized by config_mux */
+static config_snapshot config_slots[3];
+static config_snapshot *_Atomic config_current = &config_slots[0];
+static config_snapshot *_Atomic config_held;
+static portMUX_TYPE config_mux = portMUX_INITIALIZER_UNLOCKED;
 
 const char *MODE_STRING[] = {
     FOREACH_MODE(GENERATE_STRING)
@@ -73,6 +145,36 @@ void initialise_mdns(void)
     free(instanceName);
 }
 
+/** Checks if the request query is exactly the given name, e.g. "palette" for prefs?palette
+ */
+static int is_query(const coap_string_t *query, const char *name)
+{
+    return query && query->length == strlen(name) && memcmp(query->s, name, query->length) == 0;
+}
+
+/** Checks if a request that came in on the multicast group was already seen from the same
+ *  sender with this message ID and token. Unicast requests are never repeats here
+ */
+static int is_repeated(const coap_session_t *session, const coap_pdu_t *request)
+{
+    const coap_address_t *remote = coap_session_get_addr_remote(session);
+    /* libcoap keeps the destination of the request as the local address, as it does to suppress group responses */
+    const coap_address_t *local = coap_session_get_addr_local(session);
+    coap_bin_const_t token = coap_pdu_get_token(request);
+
+    return group_dedup_repeated(&group_requests, local && coap_is_mcast(local),
+                                remote ? (const uint8_t *)&remote->addr : NULL, remote ? remote->size : 0,
+                                (uint16_t)coap_pdu_get_mid(request), token.s, token.length);
+}
+
+/** Tells the observers of resource and of /state about a change, call it once the change is applied
+ */
+static void state_changed(coap_resource_t *resource)
+{
+    coap_resource_notify_observers(resource, NULL);
+    state_version++;
+}
+
 EventGroupHandle_t get_endpoints_event_group() {    
     if(!endpoint_events) {
         initialise_mdns();
@@ -87,20 +189,50 @@ void set_endpoints_handlers(__attribute__((unused)) handlers_t *handlers) {
             hnd_espressif_get_room,
             hnd_espressif_get_rgb,
             hnd_espressif_get_mode, 
-            hnd_espressif_get_settings
+            hnd_espressif_get_settings,
+            hnd_espressif_get_scene,
+            hnd_espressif_get_features,
+            hnd_espressif_get_state,
+            hnd_espressif_get_spectrum,
+            hnd_espressif_get_frames,
+            hnd_espressif_get_timesync
         },
         {
             hnd_espressif_put_room,
             hnd_espressif_put_rgb,
             hnd_espressif_put_mode, 
-            hnd_espressif_put_settings
+            hnd_espressif_put_settings,
+            hnd_espressif_put_scene,
+            NULL,   /* features are read only, libcoap answers 4.05 */
+            NULL,   /* state is changed through its parts */
+            hnd_espressif_put_spectrum,
+            hnd_espressif_put_frames,
+            hnd_espressif_put_timesync
         },
         {
             hnd_espressif_delete_room,
             hnd_espressif_delete_rgb,
             hnd_espressif_delete_mode, 
-            hnd_espressif_delete_settings
-        } 
+            hnd_espressif_delete_settings,
+            hnd_espressif_delete_scene,
+            NULL,
+            NULL,
+            NULL,
+            hnd_espressif_delete_frames,
+            hnd_espressif_delete_timesync
+        },
+        {
+            NULL,
+            NULL,
+            NULL,
+            hnd_espressif_patch_settings,
+            NULL,
+            NULL,
+            NULL,
+            NULL,
+            NULL,
+            NULL
+        }
     };
 }
 
@@ -125,8 +257,6 @@ void hnd_espressif_put_room(coap_resource_t *resource,
     size_t size;
     const uint8_t *data;
 
-    coap_resource_notify_observers(resource, NULL);
-
     if (strcmp (room_name, INITIAL_DATA) == 0) {
         coap_pdu_set_code(response, COAP_RESPONSE_CODE_CREATED);
     } else {
@@ -139,13 +269,15 @@ void hnd_espressif_put_room(coap_resource_t *resource,
     if (size == 0) {      /* re-init */
         ESP_LOGI(TAG, "Room name at init is: %s",room_name);
         snprintf(room_name, strlen(INITIAL_DATA)+1, INITIAL_DATA);
+        state_changed(resource);
     } else {
         size_t maxlen = size >= MAX_LEN_ROOM_NAME ? (size_t) MAX_LEN_ROOM_NAME : size+1;
         memcpy (room_name, data, maxlen);
         room_name[maxlen-1] = '\0';
+        state_changed(resource);
         xEventGroupSetBits(endpoint_events,E_NAME_BIT);
         ESP_ERROR_CHECK( mdns_service_txt_item_set("_http", "_tcp", ENDPOINT_STRING[room], room_name) );
-        ESP_LOGI(TAG, "Copied bytes: %d, data: %s",
+        ESP_LOGI(TAG, "Copied bytes: %zu, data: %s",
                  maxlen, room_name);
     }
 }
@@ -156,8 +288,8 @@ void hnd_espressif_delete_room(coap_resource_t *resource,
                      const coap_string_t *query,
                      coap_pdu_t *response)
 {
-    coap_resource_notify_observers(resource, NULL);
     snprintf(room_name, strlen(room_name)+1, INITIAL_DATA);
+    state_changed(resource);
     ESP_ERROR_CHECK( mdns_service_txt_item_set("_http", "_tcp", ENDPOINT_STRING[room], INITIAL_DATA) );
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
 }
@@ -167,6 +299,57 @@ void hnd_espressif_get_settings(coap_resource_t *resource,
                   const coap_string_t *query, coap_pdu_t *response)
 {
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    if (is_query(query, "palette")) {
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       palette_len,
+                                       (const u_char *)palette_stops);
+        return;
+    }
+    if (is_query(query, "shape")) {
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       sizeof(shape_drivers),
+                                       (const u_char *)shape_drivers);
+        return;
+    }
+    if (is_query(query, "noise")) {
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       sizeof(noise_frozen),
+                                       (const u_char *)&noise_frozen);
+        return;
+    }
+    if (is_query(query, "balance")) {
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       sizeof(band_balance_on),
+                                       (const u_char *)&band_balance_on);
+        return;
+    }
+    if (is_query(query, "db")) {
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       sizeof(db_scale),
+                                       (const u_char *)&db_scale);
+        return;
+    }
+    if (is_query(query, "group")) {
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       sizeof(group_role),
+                                       (const u_char *)&group_role);
+        return;
+    }
+    if (is_query(query, "tlv")) {
+        uint8_t tlv[SETTINGS_TLV_LEN];
+        size_t len = settings_tlv_encode(&settings.settings_st, tlv);
+        coap_add_data_blocked_response(request, response,
+                                       COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                       len,
+                                       (const u_char *)tlv);
+        return;
+    }
     coap_add_data_blocked_response(request, response,
                                    COAP_MEDIATYPE_TEXT_PLAIN, 0,
                                    sizeof(settings.settings_data),
@@ -178,20 +361,114 @@ void hnd_espressif_put_settings(coap_resource_t *resource,
                   const coap_string_t *query,
                   coap_pdu_t *response)
 {
-    size_t size;
+    size_t size, offset, total;
     const uint8_t *data;
-    coap_resource_notify_observers(resource, NULL);
+    /* repeats of group requests are acknowledged without applying them again */
+    if (is_repeated(session, request)) {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+        return;
+    }
 
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
 
+    if (is_query(query, "palette")) {
+        /* Palettes can be uploaded block-wise, libcoap hands over the whole body */
+        if (!coap_get_data_large(request, &size, &data, &offset, &total)
+            || size != total || size % 3 || size / 3 < HUE_STOPS_MIN || size / 3 > HUE_STOPS_MAX) {
+            ESP_LOGE(TAG, "Got unexpected size for palette:%zu", size);
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+        portENTER_CRITICAL(&palette_mux);
+        memcpy(palette_stops, data, size);
+        palette_len = size;
+        palette_version++;
+        portEXIT_CRITICAL(&palette_mux);
+        config_palette_changed();
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_PALETTE_BIT);
+        return;
+    }
+
+    if (is_query(query, "shape")) {
+        (void)coap_get_data(request, &size, &data);
+        if (size != sizeof(shape_drivers) || data[SHAPE_DRIVER_HUE] >= shape_features_size
+            || data[SHAPE_DRIVER_INTENSITY] > SHAPE_DRIVER_AMPLITUDE) {
+            ESP_LOGE(TAG, "Got unexpected shape drivers, size:%zu", size);
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+        config_set_shape_drivers(data);
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_SHAPE_BIT);
+        return;
+    }
+
+    if (is_query(query, "noise")) {
+        /* 1 freezes the noise floor, 0 lets it adapt again */
+        (void)coap_get_data(request, &size, &data);
+        if (size != 1 || data[0] > 1) {
+            ESP_LOGE(TAG, "Got unexpected noise floor state, size:%zu", size);
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+        config_set_noise_frozen(data[0]);
+        coap_resource_notify_observers(resource, NULL);
+        return;
+    }
+
+    if (is_query(query, "balance")) {
+        (void)coap_get_data(request, &size, &data);
+        if (size != 1 || data[0] > 1) {
+            ESP_LOGE(TAG, "Got unexpected band balance state, size:%zu", size);
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+        config_set_band_balance(data[0]);
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_BALANCE_BIT);
+        return;
+    }
+
+    if (is_query(query, "db")) {
+        (void)coap_get_data(request, &size, &data);
+        if (size != sizeof(db_scale) || data[0] > 1 || data[1] <= data[2] || data[3] == 0) {
+            ESP_LOGE(TAG, "Got unexpected dB scale, size:%zu", size);
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+        db_scale_storage update;
+        memcpy(&update, data, size);
+        config_set_db_scale(&update);
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_DB_BIT);
+        return;
+    }
+
+    if (is_query(query, "group")) {
+        (void)coap_get_data(request, &size, &data);
+        if (size != 1 || data[0] > SHARE_FOLLOW) {
+            ESP_LOGE(TAG, "Got unexpected group role, size:%zu", size);
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+        group_role = data[0];
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_GROUP_BIT);
+        return;
+    }
+
     /* coap_get_data() sets size to 0 on error */
     (void)coap_get_data(request, &size, &data);
 
     if (size == sizeof(settings.settings_data)) {
-        memcpy (settings.settings_data, data, size);
+        settings_data_t update;
+        memcpy(update.settings_data, data, size);
+        config_set_settings(&update.settings_st);
+        state_changed(resource);
         xEventGroupSetBits(endpoint_events, E_PREF_BIT);
     } else {
-        ESP_LOGE(TAG, "Got unexpected size for rgb array:%d", size);
+        ESP_LOGE(TAG, "Got unexpected size for rgb array:%zu", size);
     }
 }
 
@@ -201,12 +478,87 @@ void hnd_espressif_delete_settings(coap_resource_t *resource,
                      const coap_string_t *query,
                      coap_pdu_t *response)
 {
-    coap_resource_notify_observers(resource, NULL);
-    const uint8_t empty[12] = {0};
-    memcpy(settings.settings_data, empty, sizeof(empty));
+    if (is_query(query, "palette")) {
+        portENTER_CRITICAL(&palette_mux);
+        palette_len = 0;
+        palette_version++;
+        portEXIT_CRITICAL(&palette_mux);
+        config_palette_changed();
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_PALETTE_BIT);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+    if (is_query(query, "shape")) {
+        const uint8_t defaults[2] = {shape_centroid, SHAPE_DRIVER_AMPLITUDE};
+        config_set_shape_drivers(defaults);
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_SHAPE_BIT);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+    if (is_query(query, "noise")) {
+        noise_reset_version++;
+        coap_resource_notify_observers(resource, NULL);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+    if (is_query(query, "balance")) {
+        config_set_band_balance(0);
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_BALANCE_BIT);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+    if (is_query(query, "db")) {
+        const db_scale_storage defaults = DB_SCALE_DEFAULTS;
+        config_set_db_scale(&defaults);
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_DB_BIT);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+    if (is_query(query, "group")) {
+        group_role = SHARE_OFF;
+        coap_resource_notify_observers(resource, NULL);
+        xEventGroupSetBits(endpoint_events, E_GROUP_BIT);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+    settings_data_t update = settings;
+    memset(update.settings_data, 0, 12);
+    config_set_settings(&update.settings_st);
+    state_changed(resource);
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
 }
 
+void hnd_espressif_patch_settings(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response)
+{
+    size_t size;
+    const uint8_t *data;
+
+    /* coap_get_data() sets size to 0 on error */
+    (void)coap_get_data(request, &size, &data);
+
+    settings_storage update = settings.settings_st;
+    if (query || settings_tlv_apply(data, size, &update) != 0) {
+        ESP_LOGE(TAG, "Got unexpected settings patch, size:%zu", size);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+
+    /* only the fields the patch names changed, the audio task rebuilds what depends on them */
+    if (memcmp(&update, &settings.settings_st, sizeof(update)) == 0) return;
+    config_set_settings(&update);
+    state_changed(resource);
+    xEventGroupSetBits(endpoint_events, E_PREF_BIT);
+}
+
 void hnd_espressif_get_rgb(coap_resource_t *resource,
                   coap_session_t *session, const coap_pdu_t *request, /* coap_binary_t *token, */
                   const coap_string_t *query, coap_pdu_t *response)
@@ -226,7 +578,11 @@ void hnd_espressif_put_rgb(coap_resource_t *resource,
     size_t size;
     const uint8_t *data;
 
-    coap_resource_notify_observers(resource, NULL);
+    /* repeats of group requests are acknowledged without applying them again */
+    if (is_repeated(session, request)) {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+        return;
+    }
 
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
 
@@ -236,10 +592,11 @@ void hnd_espressif_put_rgb(coap_resource_t *resource,
     if (ctrl_mode != manual && ctrl_mode != audio_intensity) {
         ESP_LOGE(TAG, "Cannot set RGB value when not in manual or audio_intensity modes");
     } else if (size == sizeof(rgb_data)) {
-        memcpy (rgb_data, data, size);
+        config_set_rgb(data);
+        state_changed(resource);
         set_rgb(rgb_data[COLOR_R_IDX], rgb_data[COLOR_G_IDX], rgb_data[COLOR_B_IDX], 100);
     } else {
-        ESP_LOGE(TAG, "Got unexpected size for rgb array:%d", size);
+        ESP_LOGE(TAG, "Got unexpected size for rgb array:%zu", size);
     }
 }
 
@@ -249,9 +606,9 @@ void hnd_espressif_delete_rgb(coap_resource_t *resource,
                      const coap_string_t *query,
                      coap_pdu_t *response)
 {
-    coap_resource_notify_observers(resource, NULL);
     const uint8_t empty[3] = {0};
-    memcpy(rgb_data, empty, sizeof(empty));
+    config_set_rgb(empty);
+    state_changed(resource);
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
 }
 
@@ -276,7 +633,11 @@ void hnd_espressif_put_mode(coap_resource_t *resource,
     size_t size;
     const uint8_t *data;
 
-    coap_resource_notify_observers(resource, NULL);
+    /* repeats of group requests are acknowledged without applying them again */
+    if (is_repeated(session, request)) {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+        return;
+    }
 
     if (strcmp (room_name, INITIAL_DATA) == 0) {
         coap_pdu_set_code(response, COAP_RESPONSE_CODE_CREATED);
@@ -288,8 +649,9 @@ void hnd_espressif_put_mode(coap_resource_t *resource,
     (void)coap_get_data(request, &size, &data);
 
     if (size == 1 && data[0] < modes_size) {      /* re-init */
-        ctrl_mode = data[0];
-        snprintf(ctrl_text, sizeof(MODE_STRING[data[0]]), MODE_STRING[data[0]]);
+        config_set_mode(data[0]);
+        state_changed(resource);
+        snprintf(ctrl_text, sizeof(MODE_STRING[data[0]]), "%s", MODE_STRING[data[0]]);
         xEventGroupSetBits(endpoint_events,E_MODE_BIT);
         ESP_ERROR_CHECK( mdns_service_txt_item_set("_http", "_tcp", ENDPOINT_STRING[mode], MODE_STRING[data[0]]) );
         if (ctrl_mode == off) {
@@ -297,7 +659,7 @@ void hnd_espressif_put_mode(coap_resource_t *resource,
             set_rgb(0, 0, 0, 0);
         }
     } else {
-        ESP_LOGE(TAG, "Got unexpected size for mode:%d, data[0]:%d", size, data[0]);
+        ESP_LOGE(TAG, "Got unexpected size for mode:%zu, data[0]:%d", size, data[0]);
     }
 }
 
@@ -307,9 +669,583 @@ void hnd_espressif_delete_mode(coap_resource_t *resource,
                      const coap_string_t *query,
                      coap_pdu_t *response)
 {
+    snprintf(ctrl_text, strlen(ctrl_text)+1, "%s", MODE_STRING[manual]);
+    config_set_mode(manual);
+    state_changed(resource);
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+}
+
+void hnd_espressif_get_scene(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response)
+{
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_blocked_response(request, response,
+                                   COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                   scene_len,
+                                   (const u_char *)scene_data);
+}
+
+void hnd_espressif_put_scene(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response)
+{
+    size_t size, offset, total;
+    const uint8_t *data;
+
+    /* Block1 uploads are reassembled by libcoap (COAP_BLOCK_SINGLE_BODY),
+       so the handler sees the whole scene at once */
+    if (!coap_get_data_large(request, &size, &data, &offset, &total) || size != total) {
+        ESP_LOGE(TAG, "Got incomplete scene: %zu of %zu bytes", size, total);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+
+    int err = scene_vm_validate(data, size);
+    if (err != SCENE_OK) {
+        ESP_LOGE(TAG, "Got invalid scene of %zu bytes, error: %d", size, err);
+        coap_pdu_set_code(response, size > SCENE_MAX_LEN ?
+                          COAP_RESPONSE_CODE_REQUEST_TOO_LARGE : COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+
+    portENTER_CRITICAL(&scene_mux);
+    memcpy(scene_data, data, size);
+    scene_len = size;
+    scene_version++;
+    portEXIT_CRITICAL(&scene_mux);
+    coap_resource_notify_observers(resource, NULL);
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+    xEventGroupSetBits(endpoint_events, E_SCENE_BIT);
+}
+
+void hnd_espressif_delete_scene(coap_resource_t *resource,
+                     coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const coap_string_t *query,
+                     coap_pdu_t *response)
+{
+    portENTER_CRITICAL(&scene_mux);
+    scene_len = 0;
+    scene_version++;
+    portEXIT_CRITICAL(&scene_mux);
     coap_resource_notify_observers(resource, NULL);
-    snprintf(ctrl_text, strlen(ctrl_text)+1, MODE_STRING[manual]);
-    ctrl_mode = manual;
+    xEventGroupSetBits(endpoint_events, E_SCENE_BIT);
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+}
+
+void hnd_espressif_get_frames(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response)
+{
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_blocked_response(request, response,
+                                   COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                   frames_len,
+                                   (const u_char *)frames_data);
+}
+
+void hnd_espressif_put_frames(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response)
+{
+    size_t size, offset, total;
+    const uint8_t *data;
+
+    /* Batches are uploaded block-wise like scenes, the handler sees the whole body */
+    if (!coap_get_data_large(request, &size, &data, &offset, &total) || size != total) {
+        ESP_LOGE(TAG, "Got incomplete frames: %zu of %zu bytes", size, total);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+
+    int err = frames_validate(data, size);
+    if (err != FRAMES_OK) {
+        ESP_LOGE(TAG, "Got invalid frames of %zu bytes, error: %d", size, err);
+        coap_pdu_set_code(response, size > FRAMES_MAX_LEN ?
+                          COAP_RESPONSE_CODE_REQUEST_TOO_LARGE : COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+
+    /* Frames are transient, unlike scenes they are not kept in NVS */
+    portENTER_CRITICAL(&frames_mux);
+    memcpy(frames_data, data, size);
+    frames_len = size;
+    frames_version++;
+    portEXIT_CRITICAL(&frames_mux);
+    coap_resource_notify_observers(resource, NULL);
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+}
+
+void hnd_espressif_delete_frames(coap_resource_t *resource,
+                     coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const coap_string_t *query,
+                     coap_pdu_t *response)
+{
+    portENTER_CRITICAL(&frames_mux);
+    frames_len = 0;
+    frames_version++;
+    portEXIT_CRITICAL(&frames_mux);
+    coap_resource_notify_observers(resource, NULL);
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+}
+
+void hnd_espressif_get_features(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response)
+{
+    SpectralShape shape;
+    portENTER_CRITICAL(&shape_mux);
+    shape = shape_features;
+    portEXIT_CRITICAL(&shape_mux);
+
+    /* centroid, bandwidth and rolloff in Hz, flatness in thousandths */
+    uint16_t values[shape_features_size] = {
+        (uint16_t)shape.centroid,
+        (uint16_t)shape.bandwidth,
+        (uint16_t)shape.rolloff,
+        (uint16_t)(shape.flatness * 1000)
+    };
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_blocked_response(request, response,
+                                   COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                   sizeof(values),
+                                   (const u_char *)values);
+}
+
+void hnd_espressif_get_state(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response)
+{
+    uint8_t state[STATE_HEADER_LEN + MAX_LEN_ROOM_NAME];
+    size_t name_len = strnlen(room_name, MAX_LEN_ROOM_NAME - 1);
+    uint8_t *p = state;
+
+    *p++ = STATE_FORMAT;
+    *p++ = (uint8_t) ctrl_mode;
+    memcpy(p, rgb_data, sizeof(rgb_data));
+    p += sizeof(rgb_data);
+    memcpy(p, settings.settings_data, sizeof(settings.settings_data));
+    p += sizeof(settings.settings_data);
+    *p++ = (uint8_t) name_len;
+    memcpy(p, room_name, name_len);
+    p += name_len;
+
+    /* FNV-1a of the encoded state */
+    uint32_t hash = fnv1a(FNV_OFFSET, state, p - state);
+    uint8_t etag[sizeof(hash)];
+    memcpy(etag, &hash, sizeof(etag));
+    coap_add_option(response, COAP_OPTION_ETAG, sizeof(etag), etag);
+
+    /* A client that still holds this state gets 2.03 without the payload */
+    coap_opt_iterator_t opt_iter;
+    coap_opt_t *option = coap_check_option(request, COAP_OPTION_ETAG, &opt_iter);
+    if (option && coap_opt_length(option) == sizeof(etag)
+        && memcmp(coap_opt_value(option), etag, sizeof(etag)) == 0) {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_VALID);
+        return;
+    }
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_blocked_response(request, response,
+                                   COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                   p - state,
+                                   (const u_char *)state);
+}
+
+int spectrum_advance(void)
+{
+    const SpectrumFrame *frame = spectrum_mailbox_take(&spectrum_mailbox);
+    if (!frame) return 0;
+    spectrum_previous = spectrum_current;
+    spectrum_current = *frame;
+    spectrum_sequence++;
+    return 1;
+}
+
+/** Finds the observation of the request by session and token, or takes over the oldest entry for it
+ */
+static spectrum_observer *find_spectrum_observer(const coap_session_t *session, const coap_pdu_t *request)
+{
+    coap_bin_const_t token = coap_pdu_get_token(request);
+    uint32_t key = fnv1a(FNV_OFFSET, (const uint8_t *)&session, sizeof(session));
+    key = fnv1a(key, token.s, token.length);
+    for (int i = 0; i < SPECTRUM_OBSERVERS; i++) {
+        if (spectrum_observers[i].has_frame && spectrum_observers[i].key == key) return &spectrum_observers[i];
+    }
+    spectrum_observer *observer = &spectrum_observers[spectrum_observer_next];
+    spectrum_observer_next = (spectrum_observer_next + 1) % SPECTRUM_OBSERVERS;
+    observer->key = key;
+    observer->has_frame = 0;
+    return observer;
+}
+
+void hnd_espressif_get_spectrum(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response)
+{
+    /* single unchanged values take two bytes in a delta frame */
+    uint8_t payload[SPECTRUM_HEADER_LEN + 2 * sizeof(SpectrumFrame)];
+    const uint8_t *current = (const uint8_t *)&spectrum_current;
+    const uint8_t *previous = (const uint8_t *)&spectrum_previous;
+    size_t len = SPECTRUM_HEADER_LEN;
+
+    payload[0] = SPECTRUM_FORMAT;
+    payload[1] = SPECTRUM_FLAG_DELTA;
+    payload[2] = spectrum_sequence;
+    payload[3] = SPECTRUM_BANDS;
+    payload[4] = SPECTRUM_BINS;
+    /* plain GETs and new observers hold no previous frame, nor does one that got this frame already */
+    coap_opt_iterator_t opt_iter;
+    int holds_previous = 0;
+    if (coap_check_option(request, COAP_OPTION_OBSERVE, &opt_iter)) {
+        spectrum_observer *observer = find_spectrum_observer(session, request);
+        holds_previous = observer->has_frame && observer->sequence == (uint8_t)(spectrum_sequence - 1);
+        observer->sequence = spectrum_sequence;
+        observer->has_frame = 1;
+    }
+    if (is_query(query, "delta") && holds_previous && spectrum_sequence % SPECTRUM_KEY_FRAMES != 0) {
+        for (size_t i = 0; i < sizeof(SpectrumFrame); ) {
+            size_t run = 0;
+            while (i + run < sizeof(SpectrumFrame) && run < 255 && current[i + run] == previous[i + run]) run++;
+            if (run) {
+                payload[len++] = 0;
+                payload[len++] = run;
+                i += run;
+            } else {
+                payload[len++] = current[i] - previous[i];
+                i++;
+            }
+        }
+    }
+    /* complete frames when asked for, on key frames, to clients without the previous frame and when
+     * the changes don't compress */
+    if (len == SPECTRUM_HEADER_LEN || len > SPECTRUM_HEADER_LEN + sizeof(SpectrumFrame)) {
+        payload[1] = 0;
+        memcpy(payload + SPECTRUM_HEADER_LEN, current, sizeof(SpectrumFrame));
+        len = SPECTRUM_HEADER_LEN + sizeof(SpectrumFrame);
+    }
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_blocked_response(request, response,
+                                   COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                   len,
+                                   (const u_char *)payload);
+}
+
+void hnd_espressif_put_spectrum(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response)
+{
+    size_t size;
+    const uint8_t *data;
+
+    /* little endian notification interval in ms */
+    (void)coap_get_data(request, &size, &data);
+    uint16_t interval = size == 2 ? data[0] | data[1] << 8 : 0;
+    if (interval < SPECTRUM_INTERVAL_MIN || interval > SPECTRUM_INTERVAL_MAX) {
+        ESP_LOGE(TAG, "Got unexpected spectrum interval, size:%zu", size);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+    spectrum_interval_ms = interval;
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+}
+
+/**
+ * @brief Maps every magnitude bin to the color band its frequency falls in, bins on an edge belong to no band
+ */
+static void build_band_table(config_snapshot *snapshot)
+{
+    const settings_storage *edges = &snapshot->settings;
+    int lo = FFT_BINS, hi = 0;
+    for (int k = 0; k < FFT_BINS; k++) {
+        uint32_t freq = (uint32_t)(k * FFT_BIN_HZ);
+        uint8_t band = BAND_NONE;
+        if (edges->freq_b_start < freq && freq < snapshot->band_b_end) {
+            band = COLOR_B_IDX;
+        } else if (snapshot->band_b_end < freq && freq < snapshot->band_g_end) {
+            band = COLOR_G_IDX;
+        } else if (snapshot->band_g_end < freq && freq < edges->freq_r_end) {
+            band = COLOR_R_IDX;
+        }
+        snapshot->band_of_bin[k] = band;
+        if (edges->freq_b_start < freq && freq < edges->freq_r_end) {
+            if (k < lo) lo = k;
+            hi = k;
+        }
+    }
+    snapshot->band_bin_lo = lo;
+    snapshot->band_bin_hi = hi;
+}
+
+/**
+ * @brief Fills a free slot with the writer side config and publishes it, call with config_mux held
+ */
+static void config_publish(void)
+{
+    config_snapshot *current = atomic_load(&config_current);
+    config_snapshot *held = atomic_load(&config_held);
+    config_snapshot *next = &config_slots[0];
+    while (next == current || next == held) next++;
+
+    next->version = current->version + 1;
+    next->mode = ctrl_mode;
+    memcpy(next->rgb, rgb_data, sizeof(next->rgb));
+    next->settings = settings.settings_st;
+    next->db_scale = db_scale;
+    memcpy(next->shape_drivers, shape_drivers, sizeof(next->shape_drivers));
+    next->noise_frozen = noise_frozen;
+    next->band_balance_on = band_balance_on;
+    portENTER_CRITICAL(&palette_mux);
+    next->palette_version = palette_version;
+    portEXIT_CRITICAL(&palette_mux);
+    int balanced = band_balance_on && balanced_b_end;
+    next->band_b_end = balanced ? balanced_b_end : next->settings.freq_b_end;
+    next->band_g_end = balanced ? balanced_g_end : next->settings.freq_g_end;
+    int edges_changed = next->settings.freq_b_start != current->settings.freq_b_start
+        || next->band_b_end != current->band_b_end
+        || next->band_g_end != current->band_g_end
+        || next->settings.freq_r_end != current->settings.freq_r_end
+        || current->version == 0;   // the initial slot has no band table
+    if (edges_changed) {
+        build_band_table(next);
+    } else {
+        memcpy(next->band_of_bin, current->band_of_bin, sizeof(next->band_of_bin));
+        next->band_bin_lo = current->band_bin_lo;
+        next->band_bin_hi = current->band_bin_hi;
+    }
+    atomic_store(&config_current, next);
+}
+
+const config_snapshot *config_acquire(void)
+{
+    config_snapshot *snapshot = atomic_load(&config_current);
+    /* a writer that missed the hazard may already refill the slot, it then published another one */
+    for (;;) {
+        atomic_store(&config_held, snapshot);
+        config_snapshot *again = atomic_load(&config_current);
+        if (again == snapshot) return snapshot;
+        snapshot = again;
+    }
+}
+
+void config_set_settings(const settings_storage *update)
+{
+    portENTER_CRITICAL(&config_mux);
+    /* new edges of the user replace the balanced ones, balance starts over from them */
+    if (update->freq_b_start != settings.settings_st.freq_b_start
+            || update->freq_b_end != settings.settings_st.freq_b_end
+            || update->freq_g_end != settings.settings_st.freq_g_end
+            || update->freq_r_end != settings.settings_st.freq_r_end) {
+        balanced_b_end = balanced_g_end = 0;
+    }
+    settings.settings_st = *update;
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_rgb(const uint8_t rgb[3])
+{
+    portENTER_CRITICAL(&config_mux);
+    memmove(rgb_data, rgb, sizeof(rgb_data));
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_mode(control_mode mode)
+{
+    portENTER_CRITICAL(&config_mux);
+    ctrl_mode = mode;
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_balanced_edges(const settings_storage *base, uint16_t freq_b_end, uint16_t freq_g_end)
+{
+    portENTER_CRITICAL(&config_mux);
+    const settings_storage *user = &settings.settings_st;
+    if (band_balance_on && base->freq_b_start == user->freq_b_start && base->freq_b_end == user->freq_b_end
+            && base->freq_g_end == user->freq_g_end && base->freq_r_end == user->freq_r_end) {
+        balanced_b_end = freq_b_end;
+        balanced_g_end = freq_g_end;
+        config_publish();
+    }
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_shape_drivers(const uint8_t drivers[2])
+{
+    portENTER_CRITICAL(&config_mux);
+    memcpy(shape_drivers, drivers, sizeof(shape_drivers));
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_noise_frozen(uint8_t frozen)
+{
+    portENTER_CRITICAL(&config_mux);
+    noise_frozen = frozen;
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_band_balance(uint8_t on)
+{
+    portENTER_CRITICAL(&config_mux);
+    band_balance_on = on;
+    /* the user's edges are in effect again, turning balance back on starts from them */
+    balanced_b_end = balanced_g_end = 0;
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_set_db_scale(const db_scale_storage *update)
+{
+    portENTER_CRITICAL(&config_mux);
+    db_scale = *update;
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void config_palette_changed(void)
+{
+    portENTER_CRITICAL(&config_mux);
+    config_publish();
+    portEXIT_CRITICAL(&config_mux);
+}
+
+control_mode config_mode(void)
+{
+    /* writers only fill slots other than the current one and hold config_mux while they do */
+    portENTER_CRITICAL(&config_mux);
+    control_mode mode = atomic_load(&config_current)->mode;
+    portEXIT_CRITICAL(&config_mux);
+    return mode;
+}
+
+void config_copy(config_snapshot *copy)
+{
+    portENTER_CRITICAL(&config_mux);
+    *copy = *atomic_load(&config_current);
+    portEXIT_CRITICAL(&config_mux);
+}
+
+int dtls_event_handler(coap_session_t *session, const coap_event_t event)
+{
+    if (coap_session_get_proto(session) != COAP_PROTO_DTLS) return 0;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    switch (event) {
+        case COAP_EVENT_SERVER_SESSION_NEW:
+            /* created once the client proved its address with the cookie */
+            coap_session_set_app_data(session, (void *)(uintptr_t)now_ms);
+            break;
+        case COAP_EVENT_DTLS_CONNECTED: {
+            /* from the cookie verified ClientHello to the end of the handshake */
+            uint32_t handshake_ms = now_ms - (uint32_t)(uintptr_t)coap_session_get_app_data(session);
+            dtls_handshakes.full++;
+            dtls_handshakes.full_ms_total += handshake_ms;
+            ESP_LOGI(TAG, "DTLS handshake in %u ms, %u done, %u failed", (unsigned)handshake_ms,
+                     dtls_handshakes.full, dtls_handshakes.failed);
+            break;
+        }
+        case COAP_EVENT_DTLS_ERROR:
+            dtls_handshakes.failed++;
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+int64_t synced_time_us(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&clock_mux);
+    int64_t reference_us = time_sync_to_reference(&node_clock, now_us);
+    portEXIT_CRITICAL(&clock_mux);
+    return reference_us;
+}
+
+void time_source_set(uint8_t owner, uint32_t source)
+{
+    portENTER_CRITICAL(&time_source_mux);
+    if (owner == TIME_SOURCE_GROUP) {
+        group_time_source = source;
+    } else {
+        user_time_source = source;
+    }
+    uint32_t effective = group_time_source != TIME_SOURCE_RELEASED ? group_time_source : user_time_source;
+    if (effective != time_source) {
+        time_source = effective;
+        time_source_version++;
+    }
+    portEXIT_CRITICAL(&time_source_mux);
+}
+
+uint32_t time_source_get(uint32_t *version)
+{
+    portENTER_CRITICAL(&time_source_mux);
+    uint32_t source = time_source;
+    *version = time_source_version;
+    portEXIT_CRITICAL(&time_source_mux);
+    return source;
+}
+
+void hnd_espressif_get_timesync(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response)
+{
+    /* taken as late as possible, the sender counts everything before it as network delay */
+    int64_t now_us = synced_time_us();
+    uint8_t payload[sizeof(now_us)];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint64_t)now_us >> (8 * i);
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_blocked_response(request, response,
+                                   COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, 0,
+                                   sizeof(payload),
+                                   (const u_char *)payload);
+}
+
+void hnd_espressif_put_timesync(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response)
+{
+    size_t size;
+    const uint8_t *data;
+    uint32_t source;
+
+    /* IPv4 address of the time source in network order, it waits while the node is in a group */
+    (void)coap_get_data(request, &size, &data);
+    if (size != sizeof(source)) {
+        ESP_LOGE(TAG, "Got unexpected time source, size:%zu", size);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+    memcpy(&source, data, sizeof(source));
+    time_source_set(TIME_SOURCE_USER, source);
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+}
+
+void hnd_espressif_delete_timesync(coap_resource_t *resource,
+                     coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const coap_string_t *query,
+                     coap_pdu_t *response)
+{
+    time_source_set(TIME_SOURCE_USER, 0);
     coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
 }
 
@@ -3,6 +3,15 @@
 
 #include "coap3/coap.h"
 #include "freertos/event_groups.h"
+#include "scene_vm.h"
+#include "frame_player.h"
+#include "spectral_hue.h"
+#include "spectral_shape.h"
+#include "spectrum_frame.h"
+#include "time_sync.h"
+#include "audio_share.h"
+#include "rgb_leds.h"
+#include "settings_tlv.h"
 
 #define INITIAL_DATA "Undefined"
 #define USE_COAP "Use CoAP"
@@ -13,16 +22,30 @@
 #define LEDS_MDNS_HOSTNAME CONFIG_LEDS_MDNS_HOSTNAME
 #define LEDS_MDNS_INSTANCE CONFIG_LEDS_MDNS_INSTANCE
 
-/* The endpoint event group has three events:
+/* The endpoint event group has these events:
  * - an update occured on the rgb endpoint
  * - an update occured on the mode endpoint 
  * - an update occured on the room (name) endpoint 
+ * - an update occured on the prefs endpoint
+ * - an update occured on the scene endpoint
+ * - an update occured on the palette (prefs?palette) endpoint
+ * - an update occured on the shape drivers (prefs?shape) endpoint
+ * - an update occured on the band balance (prefs?balance) endpoint
+ * - an update occured on the dB scale (prefs?db) endpoint
+ * - an update occured on the group role (prefs?group) endpoint
  * These events are used to save updates in NVS*/
 #define E_RGB_BIT            BIT0
 #define E_MODE_BIT           BIT1
 #define E_NAME_BIT           BIT2
 #define E_PREF_BIT           BIT3
-#define ALL_ENDPOINT_EVENTS  (E_RGB_BIT | E_MODE_BIT | E_NAME_BIT | E_PREF_BIT)
+#define E_SCENE_BIT          BIT4
+#define E_PALETTE_BIT        BIT5
+#define E_SHAPE_BIT          BIT6
+#define E_BALANCE_BIT        BIT7
+#define E_DB_BIT             BIT8
+#define E_GROUP_BIT          BIT9
+#define ALL_ENDPOINT_EVENTS  (E_RGB_BIT | E_MODE_BIT | E_NAME_BIT | E_PREF_BIT | E_SCENE_BIT | E_PALETTE_BIT \
+                              | E_SHAPE_BIT | E_BALANCE_BIT | E_DB_BIT | E_GROUP_BIT)
 
 #define GENERATE_ENUM(ENUM) ENUM,
 #define GENERATE_STRING(STRING) #STRING,
@@ -32,6 +55,12 @@
         ENDPOINT(rgb)  \
         ENDPOINT(mode)   \
         ENDPOINT(prefs) \
+        ENDPOINT(scene) \
+        ENDPOINT(features) \
+        ENDPOINT(state) \
+        ENDPOINT(spectrum) \
+        ENDPOINT(frames) \
+        ENDPOINT(timesync) \
         ENDPOINT(endpoint_size)  \
 
 enum endpoint_enum {
@@ -47,6 +76,16 @@ typedef enum endpoint_enum endpoint;
         MODE(audio) \
         MODE(off) \
         MODE(audio_hold) \
+        MODE(light_show) \
+        MODE(audio_hue) \
+        MODE(audio_chroma) \
+        MODE(audio_timbre) \
+        MODE(audio_mood) \
+        MODE(audio_beat) \
+        MODE(audio_hpss) \
+        MODE(audio_shape) \
+        MODE(audio_multires) \
+        MODE(playback) \
         MODE(modes_size)  \
 
 enum modes_enum {
@@ -55,28 +94,64 @@ enum modes_enum {
 
 typedef enum modes_enum control_mode; 
 
+/* Shape drivers are [hue feature, intensity feature], amplitude keeps the usual intensity */
+#define SHAPE_DRIVER_HUE        (0)
+#define SHAPE_DRIVER_INTENSITY  (1)
+#define SHAPE_DRIVER_AMPLITUDE  (shape_features_size)
+
+/* Notification interval of the spectrum resource in ms, set with a PUT */
+#define SPECTRUM_INTERVAL_DEFAULT (200)
+#define SPECTRUM_INTERVAL_MIN     (50)
+#define SPECTRUM_INTERVAL_MAX     (10000)
+
 typedef struct handlers_t
 {
   coap_method_handler_t get_handlers[endpoint_size];
   coap_method_handler_t put_handlers[endpoint_size];
   coap_method_handler_t del_handlers[endpoint_size];
+  /* registered for both PATCH and iPATCH */
+  coap_method_handler_t patch_handlers[endpoint_size];
 } handlers_t;
 
-typedef struct settings_storage
+/* Bins outside the three color bands */
+#define BAND_NONE          (0xFF)
+
+/* Ranges of the dB scale in dB below the ADC full scale, intensity goes from 0 at
+   floor_db up to 100 at ceil_db, bands color_span_db below the loudest one are dark */
+typedef struct db_scale_storage
 {
-  uint16_t amp_min;
-  uint16_t amp_max;
-  uint16_t freq_b_start;
-  uint16_t freq_b_end;
-  uint16_t freq_g_end;
-  uint16_t freq_r_end;
-  uint16_t hold_mode_int;
-} settings_storage;
-
-typedef union settings_data_t {
-   uint8_t settings_data[14];
-   settings_storage settings_st;
-} settings_data_t;
+  uint8_t on;
+  uint8_t floor_db;
+  uint8_t ceil_db;
+  uint8_t color_span_db;
+} db_scale_storage;
+
+#define DB_SCALE_DEFAULTS {0, 48, 6, 30}
+
+/* Everything the audio task reads of the user config in one frame. Published snapshots are
+ * never written again while the audio task may hold them, so it reads one without locking */
+typedef struct config_snapshot
+{
+  uint32_t version;
+  control_mode mode;
+  uint8_t rgb[3];
+  settings_storage settings;
+  db_scale_storage db_scale;
+  uint8_t shape_drivers[2];
+  uint8_t noise_frozen;
+  uint8_t band_balance_on;
+  /* palette_version when the snapshot was published, the stops themselves stay behind palette_mux */
+  uint32_t palette_version;
+  /* blue/green and green/red edges in effect, the balanced ones while band balance moved them
+   * and the user's otherwise. settings always holds the user's */
+  uint16_t band_b_end;
+  uint16_t band_g_end;
+  /* color band of each magnitude bin and the first and last bin of all three bands,
+   * rebuilt by the writer whenever the band edges in effect change */
+  uint8_t band_of_bin[FFT_BINS];
+  uint16_t band_bin_lo;
+  uint16_t band_bin_hi;
+} config_snapshot;
 
 /* FreeRTOS event group to signal when color, mode or endpoint name are updated
     to store changes in NVS*/
@@ -86,10 +161,72 @@ extern const char *MODE_STRING[];
 extern const char *ENDPOINT_STRING[];
 
 extern char room_name[MAX_LEN_ROOM_NAME];
+/* Writer side copies of the config, change them through the config_set_ functions
+ * so the audio task gets a new snapshot. Only the CoAP task reads them directly,
+ * other tasks go through config_mode() and config_copy() */
 extern uint8_t rgb_data[3];
 extern settings_data_t settings;
 extern control_mode ctrl_mode;
 extern char ctrl_text[MAX_LEN_CTRL_NAME];
+/* Last uploaded scene, scene_version is bumped on every change.
+ * Guard reads and writes with scene_mux */
+extern uint8_t scene_data[SCENE_MAX_LEN];
+extern size_t scene_len;
+extern uint32_t scene_version;
+extern portMUX_TYPE scene_mux;
+/* Last uploaded frame batch, played back in playback mode. frames_version is bumped
+ * on every change, guard reads and writes with frames_mux */
+extern uint8_t frames_data[FRAMES_MAX_LEN];
+extern size_t frames_len;
+extern uint32_t frames_version;
+extern portMUX_TYPE frames_mux;
+/* Custom hue palette stops uploaded to prefs?palette, none means the default palette.
+ * palette_version is bumped on every change, guard reads and writes with palette_mux */
+extern uint8_t palette_stops[HUE_STOPS_MAX * 3];
+extern size_t palette_len;
+extern uint32_t palette_version;
+extern portMUX_TYPE palette_mux;
+/* Latest spectral shape of the audio, shape_version is bumped on every frame.
+ * Guard reads and writes with shape_mux */
+extern SpectralShape shape_features;
+extern uint32_t shape_version;
+extern portMUX_TYPE shape_mux;
+/* Features driving hue and intensity in audio_shape mode, set through prefs?shape.
+ * Writer side like rgb_data, change it with config_set_shape_drivers() */
+extern uint8_t shape_drivers[2];
+/* Noise floor control through prefs?noise: frozen floors stop adapting,
+ * bumping noise_reset_version makes the audio task start a new estimate */
+extern uint8_t noise_frozen;
+extern uint32_t noise_reset_version;
+/* When set through prefs?balance, the audio task moves the blue/green and green/red edges in
+ * effect so the three bands carry comparable long-term energy. The user's edges in settings
+ * are left alone, they're in effect again once balance is off */
+extern uint8_t band_balance_on;
+/* Intensity and band colors follow loudness in dB instead of amplitude when on, set through prefs?db */
+extern db_scale_storage db_scale;
+/* One of share_role, whether the node shares one analysis with its multicast group, set through prefs?group */
+extern uint8_t group_role;
+/* Bumped by the room, rgb, mode and prefs handlers, the CoAP task notifies state observers on change */
+extern uint32_t state_version;
+/* Spectra from the audio task to the CoAP task, the audio task is its only writer
+ * and the CoAP task its only reader */
+extern SpectrumMailbox spectrum_mailbox;
+extern uint16_t spectrum_interval_ms;
+/* Estimate of the clock of the node this one syncs to, only the CoAP task adds exchanges, guard with clock_mux */
+extern time_sync node_clock;
+extern portMUX_TYPE clock_mux;
+
+/* Who sets the time source: the user through /timesync or menuconfig, or group_link while the
+ * node is in a group. The group's source takes precedence, the user's is kept for when it leaves */
+enum time_source_owner { TIME_SOURCE_USER, TIME_SOURCE_GROUP };
+/* Set by group_link when the node leaves its group, the user's source is in effect again */
+#define TIME_SOURCE_RELEASED  (0xFFFFFFFF)
+
+/* Sets the source of owner, the IPv4 address of the node to sync to in network order,
+ * 0 to be its own reference. Bumps the version when the source in effect changes */
+void time_source_set(uint8_t owner, uint32_t source);
+/* The source in effect and its version */
+uint32_t time_source_get(uint32_t *version);
 
 EventGroupHandle_t get_endpoints_event_group();
 
@@ -131,6 +268,12 @@ void hnd_espressif_delete_settings(coap_resource_t *resource,
                      const coap_string_t *query,
                      coap_pdu_t *response);
 
+void hnd_espressif_patch_settings(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response);
+
 void hnd_espressif_get_rgb(coap_resource_t *resource,
                   coap_session_t *session, const coap_pdu_t *request,
                   const coap_string_t *query, coap_pdu_t *response);
@@ -163,6 +306,117 @@ void hnd_espressif_delete_mode(coap_resource_t *resource,
                      const coap_string_t *query,
                      coap_pdu_t *response);
 
+void hnd_espressif_get_scene(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response);
+
+void hnd_espressif_put_scene(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response);
+
+void hnd_espressif_delete_scene(coap_resource_t *resource,
+                     coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const coap_string_t *query,
+                     coap_pdu_t *response);
+
+void hnd_espressif_get_features(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response);
+
+void hnd_espressif_get_state(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response);
+
+void hnd_espressif_get_frames(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response);
+
+void hnd_espressif_put_frames(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response);
+
+void hnd_espressif_delete_frames(coap_resource_t *resource,
+                     coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const coap_string_t *query,
+                     coap_pdu_t *response);
+
+/* Takes the newest spectrum out of the mailbox for the next notification, 0 if there is none.
+ * Call it from the CoAP task only */
+int spectrum_advance(void);
+
+void hnd_espressif_get_spectrum(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response);
+
+void hnd_espressif_put_spectrum(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response);
+
+/* Latest config snapshot, only for the audio task. It stays valid until its next call */
+const config_snapshot *config_acquire(void);
+
+/* Update the writer side config and publish a snapshot of it, callable from any task */
+void config_set_settings(const settings_storage *update);
+void config_set_rgb(const uint8_t rgb[3]);
+void config_set_mode(control_mode mode);
+/* Balanced edges from the audio task, derived from the user's edges in base. Dropped when those
+ * changed meanwhile or balance is off, the audio task then starts over from the new snapshot */
+void config_set_balanced_edges(const settings_storage *base, uint16_t freq_b_end, uint16_t freq_g_end);
+void config_set_shape_drivers(const uint8_t drivers[2]);
+void config_set_noise_frozen(uint8_t frozen);
+void config_set_band_balance(uint8_t on);
+void config_set_db_scale(const db_scale_storage *update);
+/* Publishes the current palette_version, call it after bumping it */
+void config_palette_changed(void);
+
+/* Mode of the latest snapshot, for the tasks other than the audio task. Callable from any task */
+control_mode config_mode(void);
+/* Copy of the latest snapshot, for the tasks other than the audio task. Callable from any task */
+void config_copy(config_snapshot *copy);
+
+/* DTLS handshakes of the server, only touched by the CoAP task through dtls_event_handler().
+ * Clients that come back on a session kept idle don't handshake and don't show up here.
+ * There is no session resumption, every handshake is a full one */
+typedef struct dtls_handshake_stats
+{
+  unsigned full;
+  unsigned failed;
+  uint32_t full_ms_total;
+} dtls_handshake_stats;
+
+extern dtls_handshake_stats dtls_handshakes;
+
+/* CoAP event handler of the server context, counts DTLS handshakes and logs their time */
+int dtls_event_handler(coap_session_t *session, const coap_event_t event);
+
+/* Time of the reference clock in us, the local clock until an exchange with the time source was used.
+ * Callable from any task */
+int64_t synced_time_us(void);
+
+void hnd_espressif_get_timesync(coap_resource_t *resource,
+                  coap_session_t *session, const coap_pdu_t *request,
+                  const coap_string_t *query, coap_pdu_t *response);
+
+void hnd_espressif_put_timesync(coap_resource_t *resource,
+                  coap_session_t *session,
+                  const coap_pdu_t *request,
+                  const coap_string_t *query,
+                  coap_pdu_t *response);
+
+void hnd_espressif_delete_timesync(coap_resource_t *resource,
+                     coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const coap_string_t *query,
+                     coap_pdu_t *response);
+
 int verify_cn_callback(const char *cn,
                    const uint8_t *asn1_public_cert,
                    size_t asn1_length,
@@ -0,0 +1,30 @@
+#include "group_dedup.h"
+
+uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int group_dedup_repeated(group_dedup *recent, int group, const uint8_t *sender, size_t sender_len,
+                         uint16_t mid, const uint8_t *token, size_t token_len)
+{
+    if (!group)
+        return 0;
+
+    uint8_t mid_bytes[2] = {mid >> 8, mid & 0xff};
+    uint32_t hash = fnv1a(FNV_OFFSET, sender, sender_len);
+    hash = fnv1a(hash, mid_bytes, sizeof(mid_bytes));
+    hash = fnv1a(hash, token, token_len);
+    for (int i = 0; i < recent->count; i++) {
+        if (recent->hashes[i] == hash)
+            return 1;
+    }
+    recent->hashes[recent->next] = hash;
+    recent->next = (recent->next + 1) % GROUP_DEDUP_REQUESTS;
+    if (recent->count < GROUP_DEDUP_REQUESTS)
+        recent->count++;
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef GROUP_DEDUP_H
+#define GROUP_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Group senders repeat NON requests since nothing acknowledges them, and libcoap only
+ * deduplicates confirmable requests. Requests that came in on the multicast group are
+ * remembered by a hash of sender address, message ID and token, unicast requests are left
+ * to libcoap so a busy unicast client can't push group requests out of the ring */
+
+/* Group requests remembered */
+#define GROUP_DEDUP_REQUESTS  (16)
+#define FNV_OFFSET            (2166136261u)
+
+typedef struct group_dedup
+{
+  uint32_t hashes[GROUP_DEDUP_REQUESTS];
+  uint8_t count;
+  uint8_t next;
+} group_dedup;
+
+/* 32 bit FNV-1a, continues from hash, start with FNV_OFFSET */
+uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len);
+
+/* Checks if a group request was already seen from this sender with this message ID and token,
+ * remembers it otherwise. Returns 0 for requests that didn't come in on the group */
+int group_dedup_repeated(group_dedup *recent, int group, const uint8_t *sender, size_t sender_len,
+                         uint16_t mid, const uint8_t *token, size_t token_len);
+
+#endif /* GROUP_DEDUP_H */
@@ -0,0 +1,46 @@
+#include "settings_tlv.h"
+
+size_t settings_tlv_encode(const settings_storage *source, uint8_t *out)
+{
+    uint8_t *p = out;
+    *p++ = SETTINGS_TLV_VERSION;
+#define ENCODE_SETTING(NAME, TAG) \
+    *p++ = TAG; \
+    *p++ = sizeof(source->NAME); \
+    for (size_t i = 0; i < sizeof(source->NAME); i++) *p++ = source->NAME >> (8 * i);
+    FOREACH_SETTING(ENCODE_SETTING)
+#undef ENCODE_SETTING
+    return p - out;
+}
+
+int settings_tlv_apply(const uint8_t *data, size_t size, settings_storage *target)
+{
+    if (size < 1 || data[0] != SETTINGS_TLV_VERSION) return -1;
+    settings_storage update = *target;
+    size_t pos = 1;
+    while (pos < size) {
+        if (size - pos < 2 || size - pos - 2 < data[pos + 1]) return -1;
+        uint8_t tag = data[pos];
+        uint8_t len = data[pos + 1];
+        const uint8_t *value = &data[pos + 2];
+        pos += 2 + len;
+
+        uint32_t v = 0;
+        if (len > sizeof(v)) len = 0;   /* no field is that wide, known tags reject it below */
+        for (size_t i = 0; i < len; i++) v |= (uint32_t)value[i] << (8 * i);
+        switch (tag) {
+#define APPLY_SETTING(NAME, TAG) \
+            case TAG: \
+                if (len == 0 || v >> (8 * sizeof(update.NAME)) != 0) return -1; \
+                update.NAME = v; \
+                break;
+            FOREACH_SETTING(APPLY_SETTING)
+#undef APPLY_SETTING
+            default:
+                /* a field of a newer app */
+                break;
+        }
+    }
+    *target = update;
+    return 0;
+}
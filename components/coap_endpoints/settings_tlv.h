@@ -0,0 +1,50 @@
+#ifndef SETTINGS_TLV_H
+#define SETTINGS_TLV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The prefs settings and their TLV encoding, which lets the app and the node add fields
+ * without breaking each other. Kept apart from the endpoints so it builds without libcoap */
+
+typedef struct settings_storage
+{
+  uint16_t amp_min;
+  uint16_t amp_max;
+  uint16_t freq_b_start;
+  uint16_t freq_b_end;
+  uint16_t freq_g_end;
+  uint16_t freq_r_end;
+  uint16_t hold_mode_int;
+} settings_storage;
+
+typedef union settings_data_t {
+   uint8_t settings_data[14];
+   settings_storage settings_st;
+} settings_data_t;
+
+/* Tags of the settings in the prefs TLV encoding. A new field gets the next tag,
+   tags are never reused */
+#define FOREACH_SETTING(SETTING) \
+        SETTING(amp_min, 1) \
+        SETTING(amp_max, 2) \
+        SETTING(freq_b_start, 3) \
+        SETTING(freq_b_end, 4) \
+        SETTING(freq_g_end, 5) \
+        SETTING(freq_r_end, 6) \
+        SETTING(hold_mode_int, 7) \
+
+/* prefs?tlv layout: the schema version, then a tag, a length and a little endian value
+   per field. Readers skip tags they don't know, so only incompatible changes bump the version */
+#define SETTINGS_TLV_VERSION (1)
+#define GENERATE_TLV_LEN(NAME, TAG) + 2 + sizeof(((settings_storage *)0)->NAME)
+#define SETTINGS_TLV_LEN     (1 FOREACH_SETTING(GENERATE_TLV_LEN))
+
+/* Writes source in the prefs TLV encoding to out, which holds SETTINGS_TLV_LEN bytes. Returns the length */
+size_t settings_tlv_encode(const settings_storage *source, uint8_t *out);
+
+/* Applies the fields of a prefs TLV to target, fields it doesn't carry keep their value.
+ * Returns 0, or -1 without touching target if the TLV is malformed or a value doesn't fit its field */
+int settings_tlv_apply(const uint8_t *data, size_t size, settings_storage *target);
+
+#endif /* SETTINGS_TLV_H */
@@ -9,8 +9,9 @@ static uint8_t rgba_last[4] = {0};
 
 void set_rgb(uint8_t red, uint8_t green, uint8_t blue, uint8_t intensity) {
     if (intensity > 100) return; 
+    control_mode mode = config_mode();
     // avoid setting duty cycle in color hold mode if color didn't change
-    if (ctrl_mode == audio_hold) {
+    if (mode == audio_hold) {
         if (rgba_last[0] == red 
         && rgba_last[1] == green 
         && rgba_last[2] == blue 
@@ -27,7 +28,7 @@ void set_rgb(uint8_t red, uint8_t green, uint8_t blue, uint8_t intensity) {
     mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_1, MCPWM_OPR_A, intensity*green/255);
     mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_2, MCPWM_OPR_A, intensity*blue/255);
     // Update NVM
-    if (ctrl_mode == manual)
+    if (mode == manual)
         xEventGroupSetBits(endpoint_events,E_RGB_BIT);
 }
 
@@ -48,6 +49,8 @@ void mcpwm_gpio_init_config(void)
     mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_0, &pwm_config); 
     mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_1, &pwm_config);
     mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_2, &pwm_config);
-    if (ctrl_mode == manual || ctrl_mode == audio_intensity) 
-        set_rgb(rgb_data[0], rgb_data[1], rgb_data[2], 100);
+    config_snapshot config;
+    config_copy(&config);
+    if (config.mode == manual || config.mode == audio_intensity) 
+        set_rgb(config.rgb[0], config.rgb[1], config.rgb[2], 100);
 }
@@ -19,12 +19,20 @@
 #define I2S_SAMPLE_RATE   (44100)
 /* I2S read buffer length */
 #define I2S_READ_LEN      (2048)
+/* Magnitude bins of the I2S_READ_LEN/2 point FFT */
+#define FFT_BINS          (I2S_READ_LEN/4)
+/* Frequency step between magnitude bins, as used by the band loop */
+#define FFT_BIN_HZ        (16.0 * I2S_SAMPLE_RATE / I2S_READ_LEN)
 /* I2S data format */
 #define I2S_FORMAT        (I2S_CHANNEL_FMT_RIGHT_LEFT)
 /* I2S built-in ADC unit */
 #define I2S_ADC_UNIT              ADC_UNIT_1
 /* I2S built-in ADC channel (GPIO 36 is VP pin) */
 #define I2S_ADC_CHANNEL           ADC1_CHANNEL_0
+/* I2S built-in ADC attenuation, the calibration curve is characterized for it */
+#define I2S_ADC_ATTEN             ADC_ATTEN_DB_0
+/* ADC reference in mV for chips without one burned in eFuse */
+#define I2S_ADC_DEFAULT_VREF      (1100)
 /* Amplitude min and max values that influence the intensity of the rgb leds */
 #define SOUND_AMPLITUDE_MIN_TRESH (350)
 #define SOUND_AMPLITUDE_MAX_TRESH (2000-SOUND_AMPLITUDE_MIN_TRESH)
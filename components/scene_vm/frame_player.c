@@ -0,0 +1,107 @@
+#include <string.h>
+#include "frame_player.h"
+
+static const uint8_t CHANNEL_COUNT[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+static inline uint8_t clamp_u8(int32_t v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+/* Reads an unsigned LEB128 time step, returns its length or 0 if it's truncated or too long */
+static size_t read_dt(const uint8_t *p, size_t avail, uint32_t *dt)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < avail && i < 4; i++) {
+        value |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *dt = value;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+int frames_validate(const uint8_t *frames, size_t len)
+{
+    if (len < FRAMES_HEADER_LEN || frames[0] != FRAMES_MAGIC || frames[1] != FRAMES_VERSION)
+        return FRAMES_ERR_HEADER;
+    if (len > FRAMES_MAX_LEN)
+        return FRAMES_ERR_SIZE;
+
+    size_t pos = FRAMES_HEADER_LEN;
+    uint32_t any_dt = 0;
+    while (pos < len) {
+        uint32_t dt;
+        size_t n = read_dt(&frames[pos], len - pos, &dt);
+        if (n == 0 || pos + n >= len)
+            return FRAMES_ERR_TRUNCATED;
+        pos += n;
+        any_dt |= dt;
+        uint8_t mask = frames[pos++];
+        if (mask & ~(FRAMES_MASK_CHANNELS | FRAMES_MASK_DELTA))
+            return FRAMES_ERR_MASK;
+        pos += CHANNEL_COUNT[mask & FRAMES_MASK_CHANNELS];
+        if (pos > len)
+            return FRAMES_ERR_TRUNCATED;
+    }
+    if ((frames[2] & FRAMES_FLAG_LOOP) && any_dt == 0)
+        return FRAMES_ERR_TIMING;
+    return FRAMES_OK;
+}
+
+/* Reads the time step of the frame at pos and schedules it after from_us */
+static void schedule(frame_player *player, int64_t from_us)
+{
+    uint32_t dt = 0;
+    read_dt(&player->data[player->pos], player->len - player->pos, &dt);
+    player->due_us = from_us + (int64_t)dt * 1000;
+}
+
+int frame_player_load(frame_player *player, const uint8_t *frames, size_t len, int64_t start_us)
+{
+    memset(player, 0, sizeof(*player));
+    player->intensity = 100;
+    if (len == 0)
+        return FRAMES_OK;
+
+    int err = frames_validate(frames, len);
+    if (err != FRAMES_OK)
+        return err;
+
+    player->len = len - FRAMES_HEADER_LEN;
+    player->loop = frames[2] & FRAMES_FLAG_LOOP;
+    memcpy(player->data, frames + FRAMES_HEADER_LEN, player->len);
+    if (player->len)
+        schedule(player, start_us);
+    return FRAMES_OK;
+}
+
+int64_t frame_player_advance(frame_player *player, int64_t now_us)
+{
+    uint8_t *channels[4] = {&player->rgb[0], &player->rgb[1], &player->rgb[2], &player->intensity};
+
+    while (player->pos < player->len && player->due_us <= now_us) {
+        const uint8_t *p = &player->data[player->pos];
+        uint32_t dt;
+        p += read_dt(p, player->len - player->pos, &dt);
+        uint8_t mask = *p++;
+        for (int c = 0; c < 4; c++) {
+            if (!(mask & (1 << c)))
+                continue;
+            int32_t value = (mask & FRAMES_MASK_DELTA) ? *channels[c] + (int8_t)*p : *p;
+            *channels[c] = clamp_u8(value);
+            p++;
+        }
+        if (player->intensity > 100)
+            player->intensity = 100;
+        player->pos = p - player->data;
+
+        // frames are timed from the previous one's due time, so late wakeups don't add up
+        if (player->pos >= player->len && player->loop)
+            player->pos = 0;
+        if (player->pos < player->len)
+            schedule(player, player->due_us);
+    }
+    return player->pos < player->len ? player->due_us : -1;
+}
@@ -0,0 +1,58 @@
+#ifndef FRAME_PLAYER_H
+#define FRAME_PLAYER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Frame batches are stored with a three byte header: magic, version and flags */
+#define FRAMES_MAGIC          (0x46)
+#define FRAMES_VERSION        (1)
+#define FRAMES_HEADER_LEN     (3)
+/* Max size of an uploaded batch, header included */
+#define FRAMES_MAX_LEN        (4096)
+/* Header flags */
+#define FRAMES_FLAG_LOOP      (0x01)
+
+/* Each frame is a time step followed by a channel mask and one byte per channel in the mask:
+ * dt      milliseconds after the previous frame (or the start), unsigned LEB128
+ * mask    bits 0 - 3 select red, green, blue and intensity, FRAMES_MASK_DELTA makes
+ *         the channel bytes signed steps from the previous frame instead of values
+ * Channels not in the mask keep their value, playback starts from black at intensity 100 */
+#define FRAMES_MASK_CHANNELS  (0x0F)
+#define FRAMES_MASK_DELTA     (0x10)
+/* Longest time step, about 71 minutes, keeps LEB128 to 4 bytes */
+#define FRAMES_MAX_DT_MS      (0x0FFFFFFF)
+
+enum frames_err {
+    FRAMES_OK = 0,
+    FRAMES_ERR_HEADER = -1,
+    FRAMES_ERR_SIZE = -2,
+    FRAMES_ERR_MASK = -3,
+    FRAMES_ERR_TRUNCATED = -4,
+    FRAMES_ERR_TIMING = -5,    /* a looping batch has to take some time */
+};
+
+typedef struct frame_player
+{
+  uint8_t data[FRAMES_MAX_LEN - FRAMES_HEADER_LEN];
+  uint16_t len;
+  uint16_t pos;              /* next frame */
+  uint8_t loop;
+  int64_t due_us;            /* when the frame at pos is shown */
+  uint8_t rgb[3];
+  uint8_t intensity;
+} frame_player;
+
+/* Checks header, masks and lengths of a frame batch.
+ * Returns FRAMES_OK or a negative frames_err. */
+int frames_validate(const uint8_t *frames, size_t len);
+
+/* Validates and loads a batch (header included) whose first time step counts from start_us.
+ * An invalid or empty batch leaves the player empty, which renders black. */
+int frame_player_load(frame_player *player, const uint8_t *frames, size_t len, int64_t start_us);
+
+/* Shows every frame due by now_us, the output is left in player->rgb and player->intensity.
+ * Returns when the next frame is due, or -1 once a batch that doesn't loop has ended. */
+int64_t frame_player_advance(frame_player *player, int64_t now_us);
+
+#endif /* FRAME_PLAYER_H */
@@ -0,0 +1,211 @@
+#include <string.h>
+#include "scene_vm.h"
+
+typedef struct scene_op_info
+{
+  uint8_t len;           /* instruction length, opcode included */
+  uint8_t operand_mask;  /* argument bytes that can select a scene_source */
+} scene_op_info;
+
+static const scene_op_info OP_INFO[SCENE_OP_COUNT] = {
+    [SCENE_OP_END]  = {1, 0x0},
+    [SCENE_OP_SET]  = {4, 0x7},
+    [SCENE_OP_FADE] = {6, 0x7},
+    [SCENE_OP_WAIT] = {3, 0x0},
+    [SCENE_OP_LOOP] = {2, 0x0},
+    [SCENE_OP_NEXT] = {1, 0x0},
+    [SCENE_OP_INT]  = {2, 0x1},
+    [SCENE_OP_ADD]  = {4, 0x7},
+    [SCENE_OP_MUL]  = {2, 0x1},
+    [SCENE_OP_MIX]  = {5, 0x7},
+};
+
+static inline uint8_t clamp_u8(int32_t v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+static inline uint8_t operand(const scene_operands *ops, uint8_t op, uint8_t arg)
+{
+    return (op & SCENE_OP_AUDIO) ? ops->src[arg] : arg;
+}
+
+static inline int32_t delta(const scene_operands *ops, uint8_t op, uint8_t arg)
+{
+    return (op & SCENE_OP_AUDIO) ? ops->src[arg] : (int8_t)arg;
+}
+
+static void set_color(scene_vm *vm, int32_t r, int32_t g, int32_t b)
+{
+    vm->rgb[0] = clamp_u8(r);
+    vm->rgb[1] = clamp_u8(g);
+    vm->rgb[2] = clamp_u8(b);
+    for (int i = 0; i < 3; i++) {
+        vm->color_q8[i] = vm->rgb[i] << 8;
+    }
+}
+
+int scene_vm_validate(const uint8_t *scene, size_t len)
+{
+    if (len < SCENE_HEADER_LEN || scene[0] != SCENE_MAGIC || scene[1] != SCENE_VERSION)
+        return SCENE_ERR_HEADER;
+    if (len > SCENE_MAX_LEN)
+        return SCENE_ERR_SIZE;
+
+    int depth = 0;
+    size_t pc = SCENE_HEADER_LEN;
+    while (pc < len) {
+        uint8_t op = scene[pc];
+        uint8_t code = op & ~SCENE_OP_AUDIO;
+        if (code >= SCENE_OP_COUNT)
+            return SCENE_ERR_OPCODE;
+        const scene_op_info *info = &OP_INFO[code];
+        if ((op & SCENE_OP_AUDIO) && !info->operand_mask)
+            return SCENE_ERR_OPCODE;
+        if (pc + info->len > len)
+            return SCENE_ERR_TRUNCATED;
+        if (op & SCENE_OP_AUDIO) {
+            for (int i = 0; i < info->len - 1; i++) {
+                if ((info->operand_mask & (1 << i)) && scene[pc + 1 + i] >= SCENE_SRC_COUNT)
+                    return SCENE_ERR_SOURCE;
+            }
+        }
+        if (code == SCENE_OP_LOOP && ++depth > SCENE_MAX_LOOP_DEPTH)
+            return SCENE_ERR_LOOP;
+        if (code == SCENE_OP_NEXT && --depth < 0)
+            return SCENE_ERR_LOOP;
+        pc += info->len;
+    }
+    return depth == 0 ? SCENE_OK : SCENE_ERR_LOOP;
+}
+
+int scene_vm_load(scene_vm *vm, const uint8_t *scene, size_t len)
+{
+    memset(vm, 0, sizeof(*vm));
+    vm->intensity = 100;
+    if (len == 0)
+        return SCENE_OK;
+
+    int err = scene_vm_validate(scene, len);
+    if (err != SCENE_OK)
+        return err;
+
+    vm->len = len - SCENE_HEADER_LEN;
+    memcpy(vm->code, scene + SCENE_HEADER_LEN, vm->len);
+    return SCENE_OK;
+}
+
+unsigned scene_vm_tick(scene_vm *vm, const scene_operands *ops, unsigned budget)
+{
+    unsigned executed = 0;
+
+    if (vm->len == 0)
+        return 0;
+
+    // a pending WAIT or FADE consumes the tick until it runs out
+    if (vm->wait) {
+        vm->wait--;
+        if (vm->fading) {
+            if (vm->wait == 0) {
+                set_color(vm, vm->target[0], vm->target[1], vm->target[2]);
+                vm->fading = 0;
+            } else {
+                for (int i = 0; i < 3; i++) {
+                    vm->color_q8[i] += vm->step_q8[i];
+                    vm->rgb[i] = clamp_u8(vm->color_q8[i] >> 8);
+                }
+            }
+        }
+        if (vm->wait)
+            return 0;
+    }
+
+    while (executed < budget) {
+        const uint8_t *ins = &vm->code[vm->pc];
+        uint8_t op = ins[0];
+        uint8_t code = op & ~SCENE_OP_AUDIO;
+
+        executed++;
+        vm->pc += OP_INFO[code].len;
+
+        switch (code) {
+            case SCENE_OP_END:
+                vm->pc = vm->len;
+                break;
+            case SCENE_OP_SET:
+                set_color(vm, operand(ops, op, ins[1]), operand(ops, op, ins[2]), operand(ops, op, ins[3]));
+                break;
+            case SCENE_OP_FADE:
+                for (int i = 0; i < 3; i++) {
+                    vm->target[i] = operand(ops, op, ins[1 + i]);
+                }
+                vm->wait = ins[4] | (ins[5] << 8);
+                if (vm->wait == 0) {
+                    set_color(vm, vm->target[0], vm->target[1], vm->target[2]);
+                    break;
+                }
+                for (int i = 0; i < 3; i++) {
+                    vm->step_q8[i] = ((vm->target[i] << 8) - vm->color_q8[i]) / vm->wait;
+                }
+                vm->fading = 1;
+                goto yield;
+            case SCENE_OP_WAIT:
+                vm->wait = ins[1] | (ins[2] << 8);
+                if (vm->wait)
+                    goto yield;
+                break;
+            case SCENE_OP_LOOP:
+                vm->loops[vm->depth].start = vm->pc;
+                vm->loops[vm->depth].remaining = ins[1];
+                vm->depth++;
+                break;
+            case SCENE_OP_NEXT: {
+                scene_loop_frame *frame = &vm->loops[vm->depth - 1];
+                // a count of 0 repeats forever
+                if (frame->remaining == 0 || --frame->remaining > 0) {
+                    vm->pc = frame->start;
+                } else {
+                    vm->depth--;
+                }
+                break;
+            }
+            case SCENE_OP_INT: {
+                uint8_t value = operand(ops, op, ins[1]);
+                vm->intensity = (op & SCENE_OP_AUDIO) ? 100 * value / 255 : (value > 100 ? 100 : value);
+                break;
+            }
+            case SCENE_OP_ADD:
+                // immediates are signed deltas, audio sources only ever add
+                set_color(vm, vm->rgb[0] + delta(ops, op, ins[1]),
+                              vm->rgb[1] + delta(ops, op, ins[2]),
+                              vm->rgb[2] + delta(ops, op, ins[3]));
+                break;
+            case SCENE_OP_MUL: {
+                uint8_t factor = operand(ops, op, ins[1]);
+                set_color(vm, vm->rgb[0] * factor / 255, vm->rgb[1] * factor / 255, vm->rgb[2] * factor / 255);
+                break;
+            }
+            case SCENE_OP_MIX: {
+                uint8_t weight = ins[4];
+                int32_t mixed[3];
+                for (int i = 0; i < 3; i++) {
+                    int32_t to = operand(ops, op, ins[1 + i]);
+                    mixed[i] = vm->rgb[i] + (to - vm->rgb[i]) * weight / 255;
+                }
+                set_color(vm, mixed[0], mixed[1], mixed[2]);
+                break;
+            }
+        }
+
+        // running off the end (or END) restarts the scene on the next tick
+        if (vm->pc >= vm->len) {
+            vm->pc = 0;
+            vm->depth = 0;
+            break;
+        }
+    }
+
+yield:
+    vm->executed += executed;
+    return executed;
+}
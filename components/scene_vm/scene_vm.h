@@ -0,0 +1,111 @@
+#ifndef SCENE_VM_H
+#define SCENE_VM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Scene programs are stored with a two byte header: magic followed by version */
+#define SCENE_MAGIC           (0x53)
+#define SCENE_VERSION         (1)
+#define SCENE_HEADER_LEN      (2)
+/* Max size of an uploaded scene, header included */
+#define SCENE_MAX_LEN         (512)
+/* Max nesting of LOOP / NEXT pairs */
+#define SCENE_MAX_LOOP_DEPTH  (4)
+/* Max instructions executed in one renderer tick */
+#define SCENE_TICK_BUDGET     (32)
+
+/* Opcodes, followed by their argument bytes:
+ * END                          restart the scene from the beginning, yields the tick
+ * SET   r g b                  set the color
+ * FADE  r g b ticks_lo ticks_hi  fade linearly to the color over the given ticks
+ * WAIT  ticks_lo ticks_hi      hold the current output for the given ticks
+ * LOOP  count                  repeat up to the matching NEXT count times, 0 repeats forever
+ * NEXT                         end of the innermost LOOP
+ * INT   intensity              set the intensity (0 - 100)
+ * ADD   r g b                  add to the color, saturating
+ * MUL   factor                 scale the color by factor/255
+ * MIX   r g b weight           move the color towards r g b by weight/255
+ * OR-ing SCENE_OP_AUDIO into SET, FADE, INT, ADD, MUL or MIX makes their color /
+ * intensity / factor arguments select a scene_source instead of being immediates. */
+#define FOREACH_SCENE_OP(OP) \
+        OP(SCENE_OP_END)   \
+        OP(SCENE_OP_SET)   \
+        OP(SCENE_OP_FADE)  \
+        OP(SCENE_OP_WAIT)  \
+        OP(SCENE_OP_LOOP)  \
+        OP(SCENE_OP_NEXT)  \
+        OP(SCENE_OP_INT)   \
+        OP(SCENE_OP_ADD)   \
+        OP(SCENE_OP_MUL)   \
+        OP(SCENE_OP_MIX)   \
+        OP(SCENE_OP_COUNT) \
+
+#define GENERATE_SCENE_ENUM(ENUM) ENUM,
+
+enum scene_op_enum {
+    FOREACH_SCENE_OP(GENERATE_SCENE_ENUM)
+};
+
+#define SCENE_OP_AUDIO  (0x80)
+
+/* Audio reactive operands, refreshed by the audio task */
+enum scene_source {
+    SCENE_SRC_AUDIO_R,
+    SCENE_SRC_AUDIO_G,
+    SCENE_SRC_AUDIO_B,
+    SCENE_SRC_AUDIO_INT,  /* audio intensity scaled to 0 - 255 */
+    SCENE_SRC_COUNT
+};
+
+typedef union scene_operands {
+    uint8_t src[SCENE_SRC_COUNT];
+    uint32_t all;
+} scene_operands;
+
+enum scene_err {
+    SCENE_OK = 0,
+    SCENE_ERR_HEADER = -1,
+    SCENE_ERR_SIZE = -2,
+    SCENE_ERR_OPCODE = -3,
+    SCENE_ERR_TRUNCATED = -4,
+    SCENE_ERR_SOURCE = -5,
+    SCENE_ERR_LOOP = -6,
+};
+
+typedef struct scene_loop_frame
+{
+  uint16_t start;
+  uint8_t remaining;
+} scene_loop_frame;
+
+typedef struct scene_vm
+{
+  uint8_t code[SCENE_MAX_LEN - SCENE_HEADER_LEN];
+  uint16_t len;
+  uint16_t pc;
+  uint16_t wait;             /* ticks left in the current WAIT or FADE */
+  uint8_t fading;
+  uint8_t depth;
+  scene_loop_frame loops[SCENE_MAX_LOOP_DEPTH];
+  int32_t color_q8[3];       /* color in 8.8 fixed point, so fades don't stall */
+  int32_t step_q8[3];
+  uint8_t target[3];
+  uint8_t rgb[3];
+  uint8_t intensity;
+  uint32_t executed;         /* instructions executed since load */
+} scene_vm;
+
+/* Checks header, opcodes, argument lengths, sources and loop nesting of a scene.
+ * Returns SCENE_OK or a negative scene_err. */
+int scene_vm_validate(const uint8_t *scene, size_t len);
+
+/* Validates and loads a scene (header included). An invalid or empty scene leaves
+ * the vm empty, which renders black. */
+int scene_vm_load(scene_vm *vm, const uint8_t *scene, size_t len);
+
+/* Runs one renderer tick executing at most budget instructions, the output is left
+ * in vm->rgb and vm->intensity. Returns the number of instructions executed. */
+unsigned scene_vm_tick(scene_vm *vm, const scene_operands *ops, unsigned budget);
+
+#endif /* SCENE_VM_H */
@@ -0,0 +1,100 @@
+#include <string.h>
+#include "time_sync.h"
+
+void time_sync_reset(time_sync *sync)
+{
+    memset(sync, 0, sizeof(*sync));
+}
+
+/* Offset predicted at a local time from the fitted line */
+static int64_t predicted_offset(const time_sync *sync, int64_t local_us)
+{
+    return sync->base_offset_us + (int64_t)(sync->drift * (float)(local_us - sync->base_local_us));
+}
+
+/* Least squares line through the kept offsets, centered on their mean so floats keep the precision */
+static void fit(time_sync *sync)
+{
+    int n = sync->point_count;
+    int64_t sum_x = 0, sum_y = 0;
+    for (int i = 0; i < n; i++) {
+        sum_x += sync->point_local_us[i];
+        sum_y += sync->point_offset_us[i];
+    }
+    int64_t mean_x = sum_x / n;
+    int64_t mean_y = sum_y / n;
+
+    float sxx = 0, sxy = 0;
+    for (int i = 0; i < n; i++) {
+        float dx = (float)(sync->point_local_us[i] - mean_x);
+        sxx += dx * dx;
+        sxy += dx * (float)(sync->point_offset_us[i] - mean_y);
+    }
+    /* a single point, or points a few ms apart, don't tell the rate */
+    if (sxx > 1e12f) {
+        sync->drift = sxy / sxx;
+        if (sync->drift > TIME_SYNC_MAX_DRIFT)
+            sync->drift = TIME_SYNC_MAX_DRIFT;
+        if (sync->drift < -TIME_SYNC_MAX_DRIFT)
+            sync->drift = -TIME_SYNC_MAX_DRIFT;
+    }
+    sync->base_local_us = mean_x;
+    sync->base_offset_us = mean_y;
+}
+
+int time_sync_add(time_sync *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+    int64_t rtt = (t4 - t1) - (t3 - t2);
+    if (t4 < t1 || rtt < 0)
+        return 0;
+    uint32_t rtt_us = rtt > UINT32_MAX ? UINT32_MAX : (uint32_t)rtt;
+
+    sync->rtt_us[sync->rtt_next] = rtt_us;
+    sync->rtt_next = (sync->rtt_next + 1) % TIME_SYNC_WINDOW;
+    if (sync->rtt_count < TIME_SYNC_WINDOW)
+        sync->rtt_count++;
+
+    /* a queued or retried packet makes one leg longer than the other, drop the slow exchanges */
+    uint32_t min_rtt = UINT32_MAX;
+    for (int i = 0; i < sync->rtt_count; i++) {
+        if (sync->rtt_us[i] < min_rtt)
+            min_rtt = sync->rtt_us[i];
+    }
+    if (rtt_us > min_rtt + TIME_SYNC_SLACK_US || sync->rtt_count < TIME_SYNC_MIN_RTTS)
+        return 0;
+
+    int64_t local_us = t1 + (t4 - t1) / 2;
+    int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+    int64_t error = offset - predicted_offset(sync, local_us);
+    sync->last_rtt_us = rtt_us;
+
+    if (!sync->locked || error > TIME_SYNC_STEP_US || error < -TIME_SYNC_STEP_US) {
+        /* first exchange or a jump of the reference: start over from this offset */
+        sync->point_count = 0;
+        sync->point_next = 0;
+        sync->drift = 0;
+        sync->locked = 1;
+        error = 0;
+    }
+
+    sync->point_local_us[sync->point_next] = local_us;
+    sync->point_offset_us[sync->point_next] = offset;
+    sync->point_next = (sync->point_next + 1) % TIME_SYNC_POINTS;
+    if (sync->point_count < TIME_SYNC_POINTS)
+        sync->point_count++;
+    fit(sync);
+    sync->last_error_us = (int32_t)error;
+    return 1;
+}
+
+int64_t time_sync_to_reference(const time_sync *sync, int64_t local_us)
+{
+    return local_us + predicted_offset(sync, local_us);
+}
+
+int64_t time_sync_to_local(const time_sync *sync, int64_t reference_us)
+{
+    /* the offset changes by drift per us, small enough that one refinement is exact to the us */
+    int64_t local_us = reference_us - sync->base_offset_us;
+    return reference_us - predicted_offset(sync, local_us);
+}
@@ -0,0 +1,59 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdint.h>
+
+/* A node keeps its own clock and an estimate of how far a reference node's clock is ahead of it.
+ * Each exchange gives four timestamps:
+ * t1  local time the request left
+ * t2  reference time the request arrived
+ * t3  reference time the response left
+ * t4  local time the response arrived
+ * The round trip (t4 - t1) - (t3 - t2) bounds the error of the offset ((t2 - t1) + (t3 - t4)) / 2,
+ * so only exchanges close to the shortest recent round trip are used. */
+
+/* Round trips remembered for the delay filter */
+#define TIME_SYNC_WINDOW      (32)
+/* Exchanges up to this much slower than the fastest in the window are used */
+#define TIME_SYNC_SLACK_US    (400)
+/* Round trips seen before the first exchange is used, one alone can't tell it was slow */
+#define TIME_SYNC_MIN_RTTS    (4)
+/* Offsets of the exchanges used, the line through them gives offset and rate */
+#define TIME_SYNC_POINTS      (32)
+/* Offset errors above this step the clock instead of slewing it */
+#define TIME_SYNC_STEP_US     (20000)
+/* Bound of the rate estimate, crystals are well within 100 ppm */
+#define TIME_SYNC_MAX_DRIFT   (200e-6f)
+/* Exchanges with the time source, quicker until the delay filter has seen a few round trips */
+#define TIME_SYNC_PERIOD_MS   (1000)
+#define TIME_SYNC_BURST_MS    (100)
+#define TIME_SYNC_BURST       (8)
+
+typedef struct time_sync
+{
+  uint32_t rtt_us[TIME_SYNC_WINDOW];
+  uint8_t rtt_count;
+  uint8_t rtt_next;
+  int64_t point_local_us[TIME_SYNC_POINTS];
+  int64_t point_offset_us[TIME_SYNC_POINTS];
+  uint8_t point_count;
+  uint8_t point_next;
+  uint8_t locked;            /* an offset has been measured */
+  int64_t base_local_us;     /* local time the estimate is centered on */
+  int64_t base_offset_us;    /* reference minus local time at base_local_us */
+  float drift;               /* reference rate minus local rate */
+  int32_t last_error_us;     /* offset error of the last exchange used */
+  uint32_t last_rtt_us;
+} time_sync;
+
+/* Forgets the offset, rate and round trips, the reference is the local clock again */
+void time_sync_reset(time_sync *sync);
+
+/* Adds one exchange. Returns 1 if it corrected the estimate, 0 if the delay filter dropped it */
+int time_sync_add(time_sync *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+/* Reference time at a local time, and the local time at a reference time */
+int64_t time_sync_to_reference(const time_sync *sync, int64_t local_us);
+int64_t time_sync_to_local(const time_sync *sync, int64_t reference_us);
+
+#endif /* TIME_SYNC_H */
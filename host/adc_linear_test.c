@@ -0,0 +1,128 @@
+/* ADC linearization table and the fused unpack. A characterization shaped like the ESP32's,
+ * an offset, a bend at the top and flat codes, with a rounding step backwards in it, must
+ * normalize to a monotonic table from 0 to 4095 within a code of the millivolts' straight
+ * line. adc_unpack must match a plain reference for every channel tag, in place and into a
+ * separate buffer, carrying the mean from frame to frame. Prints the unpack throughput.
+ * Exits 1 on a mismatch */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adc_linear.h"
+#include "rgb_leds.h"
+
+#define FRAME_LEN          (I2S_READ_LEN / 2)
+#define FRAMES             (200)
+#define TIMED_FRAMES       (100000)
+
+static int failures;
+
+static void expect(int ok, const char *what, int at)
+{
+    if (ok) return;
+    if (failures++ < 10) fprintf(stderr, "%s at %d\n", what, at);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Millivolts per raw code like esp_adc_cal gives at 11 dB: 142 mV at code 0, bending
+ * over towards 3.1 V, flat for the last codes, with one rounding step backwards
+ */
+static void characterization(uint16_t *mv)
+{
+    for (int code = 0; code < ADC_CODES; code++) {
+        double x = (double)code / (ADC_CODES - 1);
+        double v = 142 + 2900 * x - 250 * x * x * x;
+        if (code > 4000) v = 142 + 2900 * (4000.0 / 4095) - 250 * (4000.0 / 4095) * (4000.0 / 4095) * (4000.0 / 4095);
+        mv[code] = (uint16_t)(v + 0.5);
+    }
+    mv[2000] = mv[1999] - 1;
+}
+
+static void test_normalize(void)
+{
+    static uint16_t mv[ADC_CODES], lut[ADC_CODES];
+    characterization(mv);
+    memcpy(lut, mv, sizeof(lut));
+    adc_linear_normalize(lut);
+
+    expect(lut[0] == 0, "table doesn't start at 0", 0);
+    expect(lut[ADC_CODES - 1] == ADC_CODES - 1, "table doesn't end at 4095", ADC_CODES - 1);
+    int worst = 0;
+    for (int code = 0; code < ADC_CODES; code++) {
+        expect(code == 0 || lut[code] >= lut[code - 1], "table steps backwards", code);
+        double line = (double)(mv[code] - mv[0]) * (ADC_CODES - 1) / (mv[ADC_CODES - 1] - mv[0]);
+        int off = abs((int)lut[code] - (int)line);
+        /* the backward step is flattened, by the millivolt it went back */
+        if (code != 2000) expect(off <= 1, "table off the millivolt line", code);
+        if (off > worst) worst = off;
+    }
+    printf("normalize: monotonic 0 to %d, at most %d code off the millivolt line\n", lut[ADC_CODES - 1], worst);
+
+    /* a flat characterization leaves the codes as they are */
+    for (int code = 0; code < ADC_CODES; code++) lut[code] = 1000;
+    adc_linear_normalize(lut);
+    for (int code = 0; code < ADC_CODES; code++) expect(lut[code] == code, "flat table not identity", code);
+}
+
+static void test_unpack(void)
+{
+    static uint16_t mv[ADC_CODES], lut[ADC_CODES], raw[FRAME_LEN];
+    static int16_t out[FRAME_LEN];
+    characterization(mv);
+    memcpy(lut, mv, sizeof(lut));
+    adc_linear_normalize(lut);
+
+    AdcFrame frame = {0}, aliased = {0};
+    int32_t expected_mean = 0;
+    srand(1);
+    for (int f = 0; f < FRAMES; f++) {
+        int32_t sum = 0, lo = ADC_CODES, hi = -1;
+        for (int i = 0; i < FRAME_LEN; i++) {
+            int code = 2048 + (rand() % 1024) - 512 + f;
+            /* the I2S ADC mode tags every sample with its channel in the top 4 bits */
+            raw[i] = (uint16_t)(rand() % 16) << 12 | code;
+            int32_t x = lut[code];
+            sum += x;
+            lo = x < lo ? x : lo;
+            hi = x > hi ? x : hi;
+        }
+        adc_unpack(lut, raw, out, FRAME_LEN, &frame);
+        for (int i = 0; i < FRAME_LEN; i++) {
+            expect(out[i] == lut[raw[i] & ADC_CODE_MASK] - expected_mean, "unpacked sample differs", i);
+        }
+        expect(frame.lo == lo && frame.hi == hi, "frame extremes differ", f);
+        expect(frame.mean == sum / FRAME_LEN, "frame mean differs", f);
+
+        /* in place, as the audio task calls it */
+        adc_unpack(lut, raw, (int16_t *)raw, FRAME_LEN, &aliased);
+        expect(memcmp(raw, out, sizeof(out)) == 0, "in place unpack differs", f);
+        expected_mean = sum / FRAME_LEN;
+    }
+    printf("unpack: %d frames of %d samples match the reference, in place too\n", FRAMES, FRAME_LEN);
+
+    volatile int32_t sink = 0;
+    int64_t started = now_ns();
+    for (int f = 0; f < TIMED_FRAMES; f++) {
+        adc_unpack(lut, raw, out, FRAME_LEN, &frame);
+        sink += frame.mean;
+    }
+    double ns = (double)(now_ns() - started) / TIMED_FRAMES;
+    printf("unpack: %.2f us per frame, %.0f Msamples/s\n", ns / 1000, FRAME_LEN * 1000.0 / ns);
+}
+
+int main(void)
+{
+    test_normalize();
+    test_unpack();
+    if (failures) printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
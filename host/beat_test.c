@@ -0,0 +1,301 @@
+/* Beat tracker accuracy on labelled clips. Without arguments it synthesizes clips of known
+ * tempo: four on the floor, a rock backbeat, swung hip hop, a fast and a slow one, and one
+ * with dropped kicks under noise. Pairs of a 16 bit PCM WAV file and a text file with one
+ * annotated beat time in seconds per line are scored instead when given. Every clip is cut
+ * into I2S_READ_LEN / 2 sample frames and transformed as the audio task does. The LEDs pulse
+ * when a frame reaches the tracker's next beat, those pulses are scored against the labels
+ * with the usual 70 ms F-measure once the tracker has a full onset envelope. Like the
+ * "allowed metrical levels" scores of beat tracking evaluations, a tracker at double or half
+ * the labelled tempo is scored against the labels at its level, and the level is printed.
+ * The tempo must be within 4 % and the F-measure at least MIN_F_MEASURE on every clip, else
+ * exits 1 */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "beat_tracker.h"
+#include "rgb_leds.h"
+
+#define FRAME_LEN          (I2S_READ_LEN / 2)
+#define SAMPLE_RATE        (I2S_SAMPLE_RATE)
+#define CLIP_SECONDS       (30)
+#define TOLERANCE_US       (70000)
+#define TEMPO_TOLERANCE    (0.04)
+#define MIN_F_MEASURE      (0.8)
+#define MAX_BEATS          (4096)
+
+typedef struct clip {
+    const char *name;
+    float *samples;
+    long len;
+    int rate;
+    double beats_s[MAX_BEATS];
+    int beat_count;
+    double bpm;                 /* from the median interval of the labels */
+} clip;
+
+typedef enum { KICK, SNARE, HAT } drum;
+
+/* deterministic noise, the same clips on every run */
+static uint32_t noise_state = 1;
+
+static float noise(void)
+{
+    noise_state = noise_state * 1664525u + 1013904223u;
+    return (int32_t)noise_state / 2147483648.0f;
+}
+
+/**
+ * @brief Mixes one drum hit starting at second t into the clip
+ */
+static void hit(clip *c, double t, drum kind, float gain)
+{
+    long start = (long)(t * c->rate);
+    long len = c->rate / (kind == KICK ? 5 : 10);
+    for (long i = 0; i < len && start + i < c->len; i++) {
+        if (start + i < 0) continue;
+        double s = (double)i / c->rate;
+        float v;
+        if (kind == KICK) v = sinf(2 * M_PI * (50 + 100 * exp(-s * 30)) * s) * expf(-s * 12);
+        else if (kind == SNARE) v = (0.6f * noise() + 0.4f * sinf(2 * M_PI * 190 * s)) * expf(-s * 25);
+        else v = noise() * expf(-s * 80);
+        c->samples[start + i] += gain * v;
+    }
+}
+
+static void set_labels(clip *c, double first_s, double period_s)
+{
+    c->beat_count = 0;
+    for (double t = first_s; t < (double)c->len / c->rate && c->beat_count < MAX_BEATS; t += period_s) {
+        c->beats_s[c->beat_count++] = t;
+    }
+}
+
+/**
+ * @brief Synthesizes clip number n of the built in set, returns 0 past the last one
+ */
+static int synth_clip(clip *c, int n)
+{
+    static const struct {
+        const char *name;
+        double bpm;
+        double swing;          /* delay of the off beat hats, share of half a beat */
+        int backbeat;          /* kicks on 1 and 3, snares on 2 and 4 */
+        float dropped;         /* share of kicks left out */
+        float noise;
+    } styles[] = {
+        {"four on the floor 128", 128, 0, 0, 0, 0.02f},
+        {"rock backbeat 100", 100, 0, 1, 0, 0.02f},
+        {"swung hip hop 90", 90, 0.33, 1, 0, 0.02f},
+        {"fast 160", 160, 0, 0, 0, 0.02f},
+        {"slow 72", 72, 0, 1, 0, 0.02f},
+        {"dropped kicks 120", 120, 0, 0, 0.3f, 0.1f},
+    };
+    if (n >= (int)(sizeof(styles) / sizeof(styles[0]))) return 0;
+
+    c->name = styles[n].name;
+    c->rate = SAMPLE_RATE;
+    c->len = (long)CLIP_SECONDS * c->rate;
+    c->samples = calloc(c->len, sizeof(float));
+    double period = 60.0 / styles[n].bpm;
+    double first = 0.25;
+    set_labels(c, first, period);
+    for (int b = 0; b < c->beat_count; b++) {
+        double t = c->beats_s[b];
+        int kick = styles[n].backbeat ? b % 2 == 0 : 1;
+        if (kick && (noise() + 1) / 2 >= styles[n].dropped) hit(c, t, KICK, 0.8f);
+        if (styles[n].backbeat && b % 2 == 1) hit(c, t, SNARE, 0.6f);
+        hit(c, t, HAT, 0.15f);
+        hit(c, t + period / 2 * (1 + styles[n].swing), HAT, 0.2f);
+    }
+    for (long i = 0; i < c->len; i++) c->samples[i] += styles[n].noise * noise();
+    return 1;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * @brief Reads a 16 bit PCM WAV file, channels mixed down, and its beat labels. Returns 0 or -1
+ */
+static int read_clip(clip *c, const char *wav_path, const char *labels_path)
+{
+    FILE *f = fopen(wav_path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size);
+    if (!data || fread(data, 1, size, f) != (size_t)size || size < 12 || memcmp(data + 8, "WAVE", 4) != 0) {
+        fclose(f);
+        free(data);
+        return -1;
+    }
+    fclose(f);
+
+    int channels = 0, bits = 0;
+    for (long pos = 12; pos + 8 <= size;) {
+        uint32_t len = le32(data + pos + 4);
+        if (memcmp(data + pos, "fmt ", 4) == 0 && pos + 24 <= size) {
+            channels = data[pos + 10] | data[pos + 11] << 8;
+            c->rate = le32(data + pos + 12);
+            bits = data[pos + 22] | data[pos + 23] << 8;
+        } else if (memcmp(data + pos, "data", 4) == 0 && channels && bits == 16) {
+            if (len > size - pos - 8) len = size - pos - 8;
+            c->len = len / 2 / channels;
+            c->samples = malloc(c->len * sizeof(float));
+            const int16_t *pcm = (const int16_t *)(data + pos + 8);
+            for (long i = 0; i < c->len; i++) {
+                float sum = 0;
+                for (int ch = 0; ch < channels; ch++) sum += pcm[i * channels + ch];
+                c->samples[i] = sum / channels / 32768.0f;
+            }
+            break;
+        }
+        pos += 8 + len + (len & 1);
+    }
+    free(data);
+    if (!c->samples) return -1;
+
+    FILE *labels = fopen(labels_path, "r");
+    if (!labels) return -1;
+    c->beat_count = 0;
+    while (c->beat_count < MAX_BEATS && fscanf(labels, "%lf%*[^\n]", &c->beats_s[c->beat_count]) == 1) c->beat_count++;
+    fclose(labels);
+    c->name = wav_path;
+    return c->beat_count > 1 ? 0 : -1;
+}
+
+/**
+ * @brief F-measure of the pulses against the beats from scored_from_us on, greedy one to one
+ * matching within the tolerance. Both lists are sorted
+ */
+static double f_measure(const double *beats_s, int beat_count, const int64_t *pulses_us, int pulses,
+                        int64_t scored_from_us, double *precision, double *recall)
+{
+    int labels = 0, hits = 0, next_pulse = 0, scored_pulses = 0;
+    for (int b = 0; b < beat_count; b++) {
+        int64_t beat_us = (int64_t)(beats_s[b] * 1e6);
+        if (beat_us < scored_from_us) continue;
+        labels++;
+        while (next_pulse < pulses && pulses_us[next_pulse] < beat_us - TOLERANCE_US) next_pulse++;
+        if (next_pulse < pulses && pulses_us[next_pulse] <= beat_us + TOLERANCE_US) {
+            hits++;
+            next_pulse++;
+        }
+    }
+    for (int p = 0; p < pulses; p++) scored_pulses += pulses_us[p] >= scored_from_us;
+    *precision = scored_pulses ? (double)hits / scored_pulses : 0;
+    *recall = labels ? (double)hits / labels : 0;
+    return *precision + *recall > 0 ? 2 * *precision * *recall / (*precision + *recall) : 0;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Runs the tracker over a clip and scores it, returns 1 if it passes
+ */
+static int score_clip(clip *c)
+{
+    double intervals[MAX_BEATS];
+    for (int b = 1; b < c->beat_count; b++) intervals[b - 1] = c->beats_s[b] - c->beats_s[b - 1];
+    qsort(intervals, c->beat_count - 1, sizeof(double), compare_doubles);
+    c->bpm = 60 / intervals[(c->beat_count - 1) / 2];
+
+    BeatTracker *tracker = create_beat_tracker(FFT_BINS);
+    FFTTransformer *fft = create_fft_transformer(FRAME_LEN, FFT_SCALED_OUTPUT);
+    FFT_PRECISION frame[FRAME_LEN], magnitudes[FFT_BINS];
+    static int64_t pulses_us[MAX_BEATS * 2];
+    int pulses = 0;
+    int64_t pulsed_beat_us = 0, scored_from_us = -1;
+    double frame_us = 1e6 * FRAME_LEN / c->rate;
+
+    for (long f = 0; (f + 1) * FRAME_LEN <= c->len; f++) {
+        /* the audio task stamps a frame once its read returns */
+        int64_t now_us = (int64_t)((f + 1) * frame_us);
+        for (int i = 0; i < FRAME_LEN; i++) frame[i] = c->samples[f * FRAME_LEN + i];
+        fft_forward(fft, frame);
+        for (int i = 0; i < FRAME_LEN; i += 2) {
+            magnitudes[i / 2] = sqrt(frame[i] * frame[i] + frame[i + 1] * frame[i + 1]);
+        }
+        beat_tracker_add(tracker, magnitudes, now_us);
+        if (!tracker->period_us) continue;
+        if (scored_from_us < 0) scored_from_us = now_us;
+        /* one pulse per predicted beat, in the first frame at or past it */
+        if (now_us >= tracker->next_beat_us && tracker->next_beat_us - pulsed_beat_us > tracker->period_us / 2
+            && pulses < MAX_BEATS * 2) {
+            pulsed_beat_us = tracker->next_beat_us;
+            pulses_us[pulses++] = now_us;
+        }
+    }
+
+    /* the labels at the tracker's metrical level: as they are, with the midpoints added,
+       or every other one from whichever start scores better */
+    static double level_beats[2 * MAX_BEATS];
+    int level = tracker->bpm > 0 ? (int)lround(log2(tracker->bpm / c->bpm)) : 0;
+    level = level < -1 ? -1 : (level > 1 ? 1 : level);
+    double precision = 0, recall = 0, best = -1;
+    if (scored_from_us < 0) scored_from_us = INT64_MAX;
+    for (int start = 0; start < (level < 0 ? 2 : 1); start++) {
+        int count = 0;
+        for (int b = start; b < c->beat_count; b += level < 0 ? 2 : 1) {
+            level_beats[count++] = c->beats_s[b];
+            if (level > 0 && b + 1 < c->beat_count) level_beats[count++] = (c->beats_s[b] + c->beats_s[b + 1]) / 2;
+        }
+        double p, r, f = f_measure(level_beats, count, pulses_us, pulses, scored_from_us, &p, &r);
+        if (f > best) {
+            best = f;
+            precision = p;
+            recall = r;
+        }
+    }
+    double tempo_error = tracker->bpm / (c->bpm * exp2(level)) - 1;
+    int pass = fabs(tempo_error) <= TEMPO_TOLERANCE && best >= MIN_F_MEASURE;
+
+    printf("%-24s %5.1f bpm, tracked %5.1f%s, F %.2f (precision %.2f, recall %.2f)%s\n", c->name, c->bpm,
+           tracker->bpm, level > 0 ? " (double)" : (level < 0 ? " (half)" : ""), best, precision, recall,
+           pass ? "" : "  FAIL");
+    free_beat_tracker(tracker);
+    free_fft_transformer(fft);
+    return pass;
+}
+
+int main(int argc, char **argv)
+{
+    int clips = 0, passed = 0;
+    if (argc > 1) {
+        if (argc % 2 == 0) {
+            fprintf(stderr, "usage: %s [clip.wav beats.txt]...\n", argv[0]);
+            return 2;
+        }
+        for (int a = 1; a + 1 < argc; a += 2) {
+            static clip c;
+            memset(&c, 0, sizeof(c));
+            if (read_clip(&c, argv[a], argv[a + 1]) != 0) {
+                fprintf(stderr, "Cannot read %s with labels %s\n", argv[a], argv[a + 1]);
+                return 2;
+            }
+            clips++;
+            passed += score_clip(&c);
+            free(c.samples);
+        }
+    } else {
+        static clip c;
+        for (int n = 0; synth_clip(&c, n); n++) {
+            clips++;
+            passed += score_clip(&c);
+            free(c.samples);
+            memset(&c, 0, sizeof(c));
+        }
+    }
+    printf("%d of %d clips within %.0f %% tempo and F >= %.2f\n", passed, clips, TEMPO_TOLERANCE * 100, MIN_F_MEASURE);
+    return passed == clips ? 0 : 1;
+}
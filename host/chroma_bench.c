@@ -0,0 +1,136 @@
+/* Cost and pitch classes of the audio_chroma pass. A sine at each note from F#3 to C8 is fed
+ * frame by frame the way the audio task does, the dominant pitch class must be the note's
+ * once the chroma settled. Then the chroma pass is timed against the band loop every FFT
+ * mode runs on the same frame: the transform, magnitudes, noise floor and band sums.
+ * Exits 1 on a wrong pitch class or if the chroma pass costs more than the band loop */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chroma.h"
+#include "noise_floor.h"
+#include "rgb_leds.h"
+
+#define FRAME              (I2S_READ_LEN / 2)
+#define SAMPLE_HZ          (FFT_BIN_HZ * FRAME)
+#define SETTLE_FRAMES      (4 * CHROMA_FFT_LEN * CHROMA_DECIMATION / FRAME)
+#define TIMED_FRAMES       (4000)
+#define TIMED_RUNS         (5)
+/* the lowest note whose semitone neighbours the long transform's bins tell apart */
+#define NOTE_LO            (54)
+#define NOTE_HI            (108)
+
+static int failures;
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief A frame of a sine at freq as the ADC delivers it, sample positions continue across frames
+ */
+static void sine(int16_t *frame, long first_sample, double freq)
+{
+    for (int i = 0; i < FRAME; i++) frame[i] = (int16_t)lrint(1200 * sin(2 * M_PI * freq * (first_sample + i) / SAMPLE_HZ));
+}
+
+typedef struct band_loop {
+    FFTTransformer *fft;
+    NoiseFloor *noise;
+    FFT_PRECISION input[FRAME];
+    FFT_PRECISION magnitudes[FFT_BINS];
+    uint8_t band_of_bin[FFT_BINS];
+} band_loop;
+
+/**
+ * @brief The band loop of the audio task on one frame, as in every FFT mode
+ */
+static void band_frame(band_loop *b, const int16_t *frame, int range, FFT_PRECISION *rgb)
+{
+    for (int i = 0; i < FRAME; i++) b->input[i] = frame[i] / (FFT_PRECISION)(range / 16);
+    fft_forward(b->fft, b->input);
+    for (int i = 0; i < FRAME; i += 2) {
+        b->magnitudes[i / 2] = sqrt(b->input[i] * b->input[i] + b->input[i + 1] * b->input[i + 1]);
+    }
+    noise_floor_apply(b->noise, b->magnitudes);
+    memset(rgb, 0, 3 * sizeof(FFT_PRECISION));
+    for (int k = 0; k < FFT_BINS; k++) {
+        if (b->band_of_bin[k] != 0xFF) rgb[b->band_of_bin[k]] += b->magnitudes[k];
+    }
+}
+
+int main(void)
+{
+    static int16_t frame[FRAME];
+
+    ChromaPlan *plan = create_chroma_plan(SAMPLE_HZ);
+    printf("chroma bins %.1f Hz, %d weights, a transform every %d frames\n", plan->bin_hz, plan->nnz,
+           CHROMA_HOP / FRAME);
+
+    int wrong = 0;
+    for (int note = NOTE_LO; note <= NOTE_HI; note++) {
+        double freq = 440 * pow(2, (note - 69) / 12.0);
+        int pitch_class = 0;
+        free_chroma_plan(plan);
+        plan = create_chroma_plan(SAMPLE_HZ);
+        for (int f = 0; f < SETTLE_FRAMES; f++) {
+            sine(frame, (long)f * FRAME, freq);
+            pitch_class = chroma_push(plan, frame, FRAME);
+        }
+        if (pitch_class != note % 12) {
+            wrong++;
+            fprintf(stderr, "note %d at %.1f Hz: pitch class %d, expected %d\n", note, freq, pitch_class, note % 12);
+        }
+    }
+    printf("%d of %d notes from %.0f Hz to %.0f Hz on the right pitch class\n", NOTE_HI - NOTE_LO + 1 - wrong,
+           NOTE_HI - NOTE_LO + 1, 440 * pow(2, (NOTE_LO - 69) / 12.0), 440 * pow(2, (NOTE_HI - 69) / 12.0));
+    failures += wrong;
+
+    static band_loop bands;
+    bands.fft = create_fft_transformer(FRAME, FFT_SCALED_OUTPUT);
+    bands.noise = create_noise_floor(FFT_BINS);
+    for (int k = 0; k < FFT_BINS; k++) {
+        double freq = k * FFT_BIN_HZ;
+        bands.band_of_bin[k] = freq <= BLUE_FREQ_START || freq >= RED_FREQ_END ? 0xFF
+            : (freq < BLUE_FREQ_END ? COLOR_B_IDX : (freq < GREEN_FREQ_END ? COLOR_G_IDX : COLOR_R_IDX));
+    }
+    for (int i = 0; i < FRAME; i++) frame[i] = (int16_t)(rand() % 2400 - 1200);
+
+    /* the fastest of a few runs, the others caught a busy host */
+    volatile double sink = 0;
+    double chroma_us = 1e9, band_us = 1e9;
+    FFT_PRECISION rgb[3];
+    for (int run = 0; run < TIMED_RUNS; run++) {
+        int64_t started = now_ns();
+        int pitch_class = 0;
+        for (int f = 0; f < TIMED_FRAMES; f++) pitch_class = chroma_push(plan, frame, FRAME);
+        sink += pitch_class;
+        double us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+        if (us < chroma_us) chroma_us = us;
+
+        started = now_ns();
+        for (int f = 0; f < TIMED_FRAMES; f++) {
+            band_frame(&bands, frame, 2400, rgb);
+            sink += rgb[0];
+        }
+        us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+        if (us < band_us) band_us = us;
+    }
+    printf("chroma pass %.1f us per frame, band loop %.1f us, %.2f of it\n", chroma_us, band_us, chroma_us / band_us);
+    if (chroma_us > band_us) {
+        failures++;
+        fprintf(stderr, "the chroma pass costs more than the band loop\n");
+    }
+
+    free_chroma_plan(plan);
+    free_fft_transformer(bands.fft);
+    free_noise_floor(bands.noise);
+    if (failures) printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/* Parity of the int8 mood classifier with its float reference, its held out accuracy and
+ * its CPU cost. Random feature windows in the quantizer's range go through classifier_forward
+ * and classifier_reference. The integer scores must stay within the error that input and
+ * hidden rounding can add, and the mood must agree whenever the reference's margin is
+ * larger than that. Windows of the held out synthesized clips, which mood_train never saw,
+ * must get their labelled mood at least MIN_HELD_OUT_ACCURACY of the time. Then MFCC plus
+ * features per frame and inference per window are timed and compared with the audio task's
+ * budget. Exits 1 on a parity failure or below the accuracy */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "classifier.h"
+#include "mfcc.h"
+#include "mood_clips.h"
+#include "rgb_leds.h"
+
+#define WINDOWS            (200000)
+#define HELD_OUT_CLIPS     (25)
+#define CLIP_WINDOWS       (3)
+#define MIN_HELD_OUT_ACCURACY (0.9)
+#define TIMED_FRAMES       (20000)
+#define TIMED_WINDOWS      (200000)
+
+/* As in main/coap_server_main.c */
+#define MFCC_FILTERS       (16)
+#define MFCC_COEFFS        (8)
+#define MFCC_FREQ_LO       (100)
+#define MFCC_FREQ_HI       (8000)
+#define MOOD_WINDOW_US     (1000000)
+#define MOOD_BUDGET_US     (5000)
+#define AUDIO_FRAME_US     (1000000.0 * (I2S_READ_LEN / 2) / I2S_SAMPLE_RATE)
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static float uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+/**
+ * @brief Bound of |integer score - reference score| of each mood. Inputs are rounded by at most
+ * half a step, the hidden layer's shift floors by at most one step
+ */
+static void score_bounds(const ClassifierModel *model, float bounds[moods_size])
+{
+    float hidden_scale = (float)model->hidden_mult / (1 << model->hidden_shift);
+    float hidden_error[CLASSIFIER_HIDDEN];
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        float sum = 0;
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) sum += abs(model->w1[h][i]);
+        hidden_error[h] = 0.5f * sum * hidden_scale + 1;
+    }
+    for (int c = 0; c < moods_size; c++) {
+        bounds[c] = 0;
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) bounds[c] += abs(model->w2[c][h]) * hidden_error[h];
+    }
+}
+
+/**
+ * @brief Whether the reference's hidden layer stays below the int8 clamp, above it the integer path saturates
+ */
+static int in_range(const ClassifierModel *model, const float features[CLASSIFIER_FEATURES])
+{
+    float hidden_scale = (float)model->hidden_mult / (1 << model->hidden_shift);
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        float acc = model->b1[h];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) acc += model->w1[h][i] * (features[i] / model->input_scale[i]);
+        if (acc * hidden_scale > 126) return 0;
+    }
+    return 1;
+}
+
+static int parity(const ClassifierModel *model)
+{
+    float bounds[moods_size], max_bound = 0;
+    score_bounds(model, bounds);
+    for (int c = 0; c < moods_size; c++) max_bound = bounds[c] > max_bound ? bounds[c] : max_bound;
+
+    int tested = 0, saturated = 0, agreed = 0, ties = 0, failures = 0;
+    float worst = 0;
+    for (int w = 0; w < WINDOWS; w++) {
+        float features[CLASSIFIER_FEATURES];
+        int8_t q[CLASSIFIER_FEATURES];
+        int32_t scores[moods_size];
+        float reference[moods_size];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+            float limit = 126 * model->input_scale[i];
+            /* log band energies and the c0 change are never negative */
+            features[i] = uniform(i >= CLASSIFIER_MFCCS ? 0 : -limit, limit);
+        }
+        if (!in_range(model, features)) {
+            saturated++;
+            continue;
+        }
+        tested++;
+        classifier_quantize(model, features, q);
+        int mood = classifier_forward(model, q, scores);
+        int expected = classifier_reference(model, features, reference);
+
+        float margin = INFINITY;
+        for (int c = 0; c < moods_size; c++) {
+            float error = fabsf(scores[c] - reference[c]);
+            if (error > bounds[c]) {
+                failures++;
+                fprintf(stderr, "window %d mood %d: score %d, reference %.1f, bound %.1f\n", w, c,
+                        (int)scores[c], reference[c], bounds[c]);
+            }
+            if (error > worst) worst = error;
+            if (c != expected && reference[expected] - reference[c] < margin) margin = reference[expected] - reference[c];
+        }
+        if (mood == expected) {
+            agreed++;
+        } else if (margin > 2 * max_bound) {
+            failures++;
+            fprintf(stderr, "window %d: mood %d, reference %d by a margin of %.1f\n", w, mood, expected, margin);
+        } else {
+            ties++;
+        }
+    }
+    printf("parity: %d windows, %d saturated and skipped, %.2f %% same mood, %d differ within the rounding margin\n",
+           tested, saturated, 100.0 * agreed / tested, ties);
+    printf("parity: worst score error %.1f, bound %.1f\n", worst, max_bound);
+    return failures;
+}
+
+/**
+ * @brief Accuracy of the int8 path on the held out clips, returns 1 below MIN_HELD_OUT_ACCURACY
+ */
+static int held_out(const ClassifierModel *model)
+{
+    int right = 0, total = 0;
+    printf("held out:");
+    for (int mood = 0; mood < moods_size; mood++) {
+        int mood_right = 0;
+        for (int c = 0; c < HELD_OUT_CLIPS; c++) {
+            float windows[CLIP_WINDOWS][CLASSIFIER_FEATURES];
+            mood_clip_windows(mood, MOOD_HELD_OUT_SEED + c, CLIP_WINDOWS, windows);
+            for (int w = 0; w < CLIP_WINDOWS; w++) {
+                int8_t q[CLASSIFIER_FEATURES];
+                int32_t scores[moods_size];
+                classifier_quantize(model, windows[w], q);
+                mood_right += classifier_forward(model, q, scores) == mood;
+            }
+        }
+        printf(" mood %d %.1f %%", mood, 100.0 * mood_right / (HELD_OUT_CLIPS * CLIP_WINDOWS));
+        right += mood_right;
+        total += HELD_OUT_CLIPS * CLIP_WINDOWS;
+    }
+    printf("\nheld out: %.1f %% of %d windows of synthesized clips on their labelled mood\n", 100.0 * right / total,
+           total);
+    return right < MIN_HELD_OUT_ACCURACY * total;
+}
+
+static void cpu_cost(const ClassifierModel *model)
+{
+    Mfcc *mfcc = create_mfcc(FFT_BINS, FFT_BIN_HZ, MFCC_FILTERS, MFCC_COEFFS, MFCC_FREQ_LO, MFCC_FREQ_HI);
+    static FFT_PRECISION magnitudes[FFT_BINS];
+    FFT_PRECISION bands[3];
+    MoodFeatures features = {0};
+    float window[CLASSIFIER_FEATURES];
+    int8_t q[CLASSIFIER_FEATURES];
+    int32_t scores[moods_size];
+    volatile int sink = 0;
+
+    for (int k = 0; k < FFT_BINS; k++) magnitudes[k] = uniform(0, 100);
+    for (int b = 0; b < 3; b++) bands[b] = uniform(0, 10000);
+    int64_t started = now_ns();
+    for (int f = 0; f < TIMED_FRAMES; f++) {
+        magnitudes[f % FFT_BINS] = uniform(0, 100);
+        mfcc_forward(mfcc, magnitudes);
+        mood_features_add(&features, mfcc, bands);
+    }
+    double frame_us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+
+    started = now_ns();
+    for (int w = 0; w < TIMED_WINDOWS; w++) {
+        mood_features_add(&features, mfcc, bands);
+        mood_features_take(&features, window);
+        classifier_quantize(model, window, q);
+        sink += classifier_forward(model, q, scores);
+    }
+    double window_us = (now_ns() - started) / 1000.0 / TIMED_WINDOWS;
+
+    double frames = MOOD_WINDOW_US / AUDIO_FRAME_US;
+    printf("cpu: %.2f us per frame (MFCC and features), %.3f us per window (quantize and inference)\n",
+           frame_us, window_us);
+    printf("cpu: %.0f frames per window, %.0f us of the %d us budget on this host\n", frames,
+           frames * frame_us + window_us, MOOD_BUDGET_US);
+    free_mfcc(mfcc);
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = parity(&mood_model);
+    int inaccurate = held_out(&mood_model);
+    cpu_cost(&mood_model);
+    if (failures) printf("parity: %d failures\n", failures);
+    if (inaccurate) printf("held out: below %.0f %%\n", 100 * MIN_HELD_OUT_ACCURACY);
+    return failures || inaccurate ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/* Group requests reach every node once. GROUP_NODES coap_server_host processes share a UDP
+ * port and join the multicast group on the loopback, then REQUESTS NON PUTs of /mode go to the
+ * group, each sent REPEATS times with the same message ID and token like a client retrying
+ * over a lossy link. Every node must apply each request exactly once: stopped, each reports
+ * REQUESTS state changes. Takes the directory of coap_server_host. Exits 1 if a node doesn't
+ * come up or applied a request twice or not at all */
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define GROUP              "239.255.42.1"
+#define PORT               (56850)
+#define PORT_STRING        "56850"
+#define GROUP_NODES        (3)
+#define REQUESTS           (20)
+#define REPEATS            (3)
+#define STARTUP_US         (500000)
+#define GAP_US             (20000)
+#define MODE_MANUAL        (0)
+#define MODE_OFF           (4)
+
+typedef struct node {
+    pid_t pid;
+    int out;                /* read end of its stdout */
+} node;
+
+/**
+ * @brief Starts coap_server_host in dir on the group with its stdout on a pipe, returns 0 or -1
+ */
+static int start_node(const char *dir, node *n)
+{
+    char path[512];
+    int fds[2];
+    snprintf(path, sizeof(path), "%s/coap_server_host", dir);
+    if (pipe(fds) != 0) return -1;
+    n->pid = fork();
+    if (n->pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(path, "coap_server_host", "-u", "-g", GROUP, "-i", "lo", PORT_STRING, (char *)NULL);
+        perror(path);
+        _exit(127);
+    }
+    close(fds[1]);
+    n->out = fds[0];
+    return n->pid < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Stops a node and returns the state changes it reports, -1 if it reports none
+ */
+static int stop_node(node *n)
+{
+    char output[4096];
+    size_t len = 0;
+    ssize_t got;
+    kill(n->pid, SIGTERM);
+    while (len < sizeof(output) - 1 && (got = read(n->out, output + len, sizeof(output) - 1 - len)) > 0) len += got;
+    output[len] = 0;
+    close(n->out);
+    waitpid(n->pid, NULL, 0);
+    unsigned changes;
+    for (char *line = strtok(output, "\n"); line; line = strtok(NULL, "\n")) {
+        if (sscanf(line, "%u state changes applied", &changes) == 1) return (int)changes;
+    }
+    return -1;
+}
+
+/**
+ * @brief A NON PUT of /mode, returns its length
+ */
+static size_t put_mode(uint8_t *pdu, uint16_t mid, uint16_t token, uint8_t mode)
+{
+    size_t len = 0;
+    pdu[len++] = 0x52;                  /* version 1, NON, 2 byte token */
+    pdu[len++] = 0x03;                  /* PUT */
+    pdu[len++] = mid >> 8;
+    pdu[len++] = mid & 0xFF;
+    pdu[len++] = token >> 8;
+    pdu[len++] = token & 0xFF;
+    pdu[len++] = 0xB4;                  /* Uri-Path, 4 bytes */
+    memcpy(pdu + len, "mode", 4);
+    len += 4;
+    pdu[len++] = 0xFF;
+    pdu[len++] = mode;
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s directory-of-coap_server_host\n", argv[0]);
+        return 2;
+    }
+    node nodes[GROUP_NODES];
+    int failures = 0;
+    for (int i = 0; i < GROUP_NODES; i++) {
+        if (start_node(argv[1], &nodes[i]) != 0) return 1;
+    }
+    usleep(STARTUP_US);
+    for (int i = 0; i < GROUP_NODES; i++) {
+        if (waitpid(nodes[i].pid, NULL, WNOHANG) != 0) {
+            fprintf(stderr, "node %d didn't come up\n", i);
+            return 1;
+        }
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct in_addr loopback = {.s_addr = inet_addr("127.0.0.1")};
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    struct sockaddr_in group = {.sin_family = AF_INET, .sin_port = htons(PORT), .sin_addr.s_addr = inet_addr(GROUP)};
+    for (int r = 0; r < REQUESTS; r++) {
+        uint8_t pdu[32];
+        size_t len = put_mode(pdu, (uint16_t)(0x4000 + r), (uint16_t)(0x100 + r), r % 2 ? MODE_OFF : MODE_MANUAL);
+        for (int k = 0; k < REPEATS; k++) {
+            if (sendto(sock, pdu, len, 0, (struct sockaddr *)&group, sizeof(group)) != (ssize_t)len) {
+                perror("sendto");
+                failures++;
+            }
+            usleep(GAP_US);
+        }
+    }
+    close(sock);
+    usleep(STARTUP_US);
+
+    for (int i = 0; i < GROUP_NODES; i++) {
+        int changes = stop_node(&nodes[i]);
+        printf("node %d applied %d of %d requests sent %d times each\n", i, changes, REQUESTS, REPEATS);
+        if (changes != REQUESTS) failures++;
+    }
+    if (failures) printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+/* Load generator for the node's CoAP server, the regression benchmark of server changes.
+ * Every client is a session that keeps one request in flight, so the concurrency is the
+ * number of clients. Reports throughput and the p50, p99 and max latency of the requests,
+ * observing clients report the notifications they got instead */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap3/coap.h"
+
+#define DEFAULT_CLIENTS    (8)
+#define DEFAULT_SECONDS    (10)
+#define DEFAULT_PSK        "secret-key"
+#define DEFAULT_IDENTITY   "CoAP"
+#define IO_WAIT_MS         (10)
+/* Warnings only, syslog's LOG_WARNING */
+#define COAP_LOG_LEVEL     (4)
+/* Requests answered in the first second aren't counted, DTLS and TCP are still connecting */
+#define WARMUP_US          (1000000LL)
+
+enum load_kind {
+    LOAD_GET,       /* GET /state */
+    LOAD_PUT,       /* PUT /rgb */
+    LOAD_OBSERVE,   /* observe /spectrum */
+    LOAD_MIX,       /* clients cycle through GET, PUT and iPATCH /prefs */
+};
+
+typedef struct load_client {
+    coap_session_t *session;
+    unsigned sent;
+    int observing;
+} load_client;
+
+static const char *kind_names[] = {"get", "put", "observe", "mix"};
+
+static enum load_kind kind = LOAD_GET;
+static int64_t start_us, end_us;
+static uint32_t *latencies_us;
+static size_t latency_count, latency_cap;
+static unsigned long errors, notifications;
+
+static int64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void add_latency(uint32_t latency_us)
+{
+    if (latency_count == latency_cap) {
+        latency_cap = latency_cap ? 2 * latency_cap : 65536;
+        latencies_us = realloc(latencies_us, latency_cap * sizeof(*latencies_us));
+        if (!latencies_us) {
+            fprintf(stderr, "Out of memory for latencies\n");
+            exit(1);
+        }
+    }
+    latencies_us[latency_count++] = latency_us;
+}
+
+typedef struct load_request {
+    coap_pdu_code_t code;
+    const char *path;
+    const uint8_t *payload;
+    size_t len;
+} load_request;
+
+static const uint8_t rgb_payload[3] = {0x20, 0x40, 0x80};
+/* sets the blue band end to its default of 500 Hz in the prefs TLV */
+static const uint8_t patch_payload[] = {1, 4, 2, 0xF4, 0x01};
+
+static const load_request requests[] = {
+    [LOAD_GET] = {COAP_REQUEST_CODE_GET, "state", NULL, 0},
+    [LOAD_PUT] = {COAP_REQUEST_CODE_PUT, "rgb", rgb_payload, sizeof(rgb_payload)},
+    [LOAD_OBSERVE] = {COAP_REQUEST_CODE_GET, "spectrum", NULL, 0},
+};
+static const load_request mix_requests[] = {
+    {COAP_REQUEST_CODE_GET, "state", NULL, 0},
+    {COAP_REQUEST_CODE_PUT, "rgb", rgb_payload, sizeof(rgb_payload)},
+    {COAP_REQUEST_CODE_IPATCH, "prefs", patch_payload, sizeof(patch_payload)},
+};
+
+/**
+ * @brief Sends the next request of a client with its send time as the token, the response handler takes the latency from it
+ */
+static void send_request(load_client *client)
+{
+    const load_request *request = kind == LOAD_MIX ? &mix_requests[client->sent % 3] : &requests[kind];
+    coap_pdu_t *pdu = coap_pdu_init(COAP_MESSAGE_CON, request->code, coap_new_message_id(client->session),
+                                    coap_session_max_pdu_size(client->session));
+    if (!pdu) {
+        errors++;
+        return;
+    }
+    int64_t sent_us = now_us();
+    coap_add_token(pdu, sizeof(sent_us), (const uint8_t *)&sent_us);
+    if (kind == LOAD_OBSERVE) {
+        uint8_t buf[4];
+        coap_add_option(pdu, COAP_OPTION_OBSERVE,
+                        coap_encode_var_safe(buf, sizeof(buf), COAP_OBSERVE_ESTABLISH), buf);
+        client->observing = 1;
+    }
+    coap_add_option(pdu, COAP_OPTION_URI_PATH, strlen(request->path), (const uint8_t *)request->path);
+    if (request->len) coap_add_data(pdu, request->len, request->payload);
+    client->sent++;
+    if (coap_send(client->session, pdu) == COAP_INVALID_MID) errors++;
+}
+
+static coap_response_t response_handler(coap_session_t *session, const coap_pdu_t *sent,
+                                        const coap_pdu_t *received, const coap_mid_t mid)
+{
+    (void)sent; (void)mid;
+    load_client *client = coap_session_get_app_data(session);
+    coap_bin_const_t token = coap_pdu_get_token(received);
+    int64_t received_us = now_us();
+
+    if (!client || token.length != sizeof(int64_t)) return COAP_RESPONSE_OK;
+    if (COAP_RESPONSE_CLASS(coap_pdu_get_code(received)) != 2) errors++;
+    if (client->observing) {
+        if (received_us >= start_us + WARMUP_US) notifications++;
+        return COAP_RESPONSE_OK;
+    }
+
+    int64_t sent_us;
+    memcpy(&sent_us, token.s, sizeof(sent_us));
+    if (received_us >= start_us + WARMUP_US) add_latency((uint32_t)(received_us - sent_us));
+    if (received_us < end_us) send_request(client);
+    return COAP_RESPONSE_OK;
+}
+
+static void nack_handler(coap_session_t *session, const coap_pdu_t *sent,
+                         const coap_nack_reason_t reason, const coap_mid_t mid)
+{
+    (void)sent; (void)mid;
+    load_client *client = coap_session_get_app_data(session);
+    errors++;
+    /* a lost request leaves the client idle, it carries on with the next one */
+    if (client && !client->observing && reason == COAP_NACK_TOO_MANY_RETRIES && now_us() < end_us) {
+        send_request(client);
+    }
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(double p)
+{
+    size_t i = (size_t)(p * (latency_count - 1) + 0.5);
+    return latencies_us[i];
+}
+
+/**
+ * @brief Opens the session of a client, returns 0 or -1
+ */
+static int open_session(coap_context_t *ctx, load_client *client, const coap_address_t *dst, coap_proto_t proto,
+                        coap_dtls_cpsk_t *dtls_psk)
+{
+    if (proto == COAP_PROTO_DTLS) {
+        client->session = coap_new_client_session_psk2(ctx, NULL, dst, proto, dtls_psk);
+    } else {
+        client->session = coap_new_client_session(ctx, NULL, dst, proto);
+    }
+    if (!client->session) return -1;
+    coap_session_set_app_data(client->session, client);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-p udp|tcp|dtls] [-m get|put|observe|mix] [-c clients] [-d seconds]\n"
+            "          [-k psk] [-i identity] host [port]\n"
+            "  get: GET /state, put: PUT /rgb, observe: observe /spectrum,\n"
+            "  mix: GET /state, PUT /rgb and iPATCH /prefs in turn,\n"
+            "  port defaults to 5683, 5684 for dtls\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    coap_proto_t proto = COAP_PROTO_UDP;
+    int clients = DEFAULT_CLIENTS;
+    int seconds = DEFAULT_SECONDS;
+    const char *psk = DEFAULT_PSK;
+    const char *identity = DEFAULT_IDENTITY;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:m:c:d:k:i:")) != -1) {
+        switch (opt) {
+            case 'p':
+                if (strcmp(optarg, "udp") == 0) proto = COAP_PROTO_UDP;
+                else if (strcmp(optarg, "tcp") == 0) proto = COAP_PROTO_TCP;
+                else if (strcmp(optarg, "dtls") == 0) proto = COAP_PROTO_DTLS;
+                else usage(argv[0]);
+                break;
+            case 'm':
+                for (kind = LOAD_GET; kind <= LOAD_MIX && strcmp(optarg, kind_names[kind]) != 0; kind++);
+                if (kind > LOAD_MIX) usage(argv[0]);
+                break;
+            case 'c':
+                clients = atoi(optarg);
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'k':
+                psk = optarg;
+                break;
+            case 'i':
+                identity = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc || clients < 1 || seconds < 2) usage(argv[0]);
+    const char *host = argv[optind];
+    const char *port = optind + 1 < argc ? argv[optind + 1] : (proto == COAP_PROTO_DTLS ? "5684" : "5683");
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *res;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", host);
+        return 1;
+    }
+    coap_address_t dst;
+    coap_address_init(&dst);
+    dst.size = res->ai_addrlen;
+    memcpy(&dst.addr, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+
+    coap_startup();
+    coap_set_log_level(COAP_LOG_LEVEL);
+    coap_context_t *ctx = coap_new_context(NULL);
+    if (!ctx) {
+        fprintf(stderr, "coap_new_context() failed\n");
+        return 1;
+    }
+    coap_register_response_handler(ctx, response_handler);
+    coap_register_nack_handler(ctx, nack_handler);
+
+    load_client *load = calloc(clients, sizeof(*load));
+    coap_dtls_cpsk_t dtls_psk;
+    memset(&dtls_psk, 0, sizeof(dtls_psk));
+    dtls_psk.version = COAP_DTLS_CPSK_SETUP_VERSION;
+    dtls_psk.psk_info.identity.s = (const uint8_t *)identity;
+    dtls_psk.psk_info.identity.length = strlen(identity);
+    dtls_psk.psk_info.key.s = (const uint8_t *)psk;
+    dtls_psk.psk_info.key.length = strlen(psk);
+
+    start_us = now_us();
+    end_us = start_us + seconds * 1000000LL;
+    for (int i = 0; i < clients; i++) {
+        if (open_session(ctx, &load[i], &dst, proto, &dtls_psk) != 0) {
+            fprintf(stderr, "Opening session %d failed\n", i);
+            return 1;
+        }
+        send_request(&load[i]);
+    }
+
+    while (now_us() < end_us) {
+        if (coap_io_process(ctx, IO_WAIT_MS) < 0) break;
+    }
+    double measured_s = (end_us - start_us - WARMUP_US) / 1e6;
+
+    printf("%s %s, %d clients, %.1f s measured\n", proto == COAP_PROTO_DTLS ? "dtls" :
+           proto == COAP_PROTO_TCP ? "tcp" : "udp", kind_names[kind], clients, measured_s);
+    if (kind == LOAD_OBSERVE) {
+        printf("notifications: %lu, %.1f/s, %.2f/s per observer\n", notifications,
+               notifications / measured_s, notifications / measured_s / clients);
+    } else if (latency_count) {
+        qsort(latencies_us, latency_count, sizeof(*latencies_us), compare_latency);
+        printf("requests: %zu, %.0f/s\n", latency_count, latency_count / measured_s);
+        printf("latency us: p50 %u, p99 %u, max %u\n", percentile(0.50), percentile(0.99),
+               latencies_us[latency_count - 1]);
+    } else {
+        printf("no responses\n");
+    }
+    printf("errors: %lu\n", errors);
+
+    for (int i = 0; i < clients; i++) {
+        if (load[i].session) coap_session_release(load[i].session);
+    }
+    free(load);
+    free(latencies_us);
+    coap_free_context(ctx);
+    coap_cleanup();
+    return errors ? 1 : 0;
+}
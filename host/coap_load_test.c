@@ -0,0 +1,92 @@
+/* coap_load and state_probe against coap_server_host on the loopback. The server is started on
+ * a spare port, then coap_load runs a few seconds of each load: GETs and the request mix over
+ * UDP, observers over TCP and GETs over DTLS. Then state_probe measures a UI refresh through
+ * the four resources, /state and its revalidation. Their figures are printed as the programs
+ * report them. Takes the directory of the three programs. Exits 1 if the server doesn't come
+ * up, a load or the probe reports an error or the server doesn't stop cleanly */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PORT               "56830"
+#define DTLS_PORT          "56831"
+#define SECONDS            "4"
+#define PROBE_ROUNDS       "100"
+#define STARTUP_US         (500000)
+
+static const char *loads[][8] = {
+    {"-p", "udp", "-m", "get", "-c", "32", "127.0.0.1", PORT},
+    {"-p", "udp", "-m", "mix", "-c", "8", "127.0.0.1", PORT},
+    {"-p", "tcp", "-m", "observe", "-c", "50", "127.0.0.1", PORT},
+    {"-p", "dtls", "-m", "get", "-c", "8", "127.0.0.1", DTLS_PORT},
+};
+
+/**
+ * @brief Starts dir/name with args, NULL terminated, returns its pid or -1
+ */
+static pid_t spawn(const char *dir, const char *name, const char *const *args)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(path, (char *const *)args);
+        perror(path);
+        _exit(127);
+    }
+    return pid;
+}
+
+static int exit_status(pid_t pid)
+{
+    int status;
+    if (waitpid(pid, &status, 0) != pid) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s directory-of-coap_server_host-coap_load-and-state_probe\n", argv[0]);
+        return 2;
+    }
+    const char *server_args[] = {"coap_server_host", PORT, NULL};
+    pid_t server = spawn(argv[1], "coap_server_host", server_args);
+    if (server < 0) return 1;
+    usleep(STARTUP_US);
+    if (waitpid(server, NULL, WNOHANG) != 0) {
+        fprintf(stderr, "coap_server_host didn't come up\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        const char *args[12] = {"coap_load", "-d", SECONDS};
+        for (int a = 0; a < 8; a++) args[3 + a] = loads[i][a];
+        printf("coap_load -d %s %s %s %s %s %s %s %s %s\n", SECONDS, args[3], args[4], args[5], args[6], args[7],
+               args[8], args[9], args[10]);
+        fflush(stdout);
+        if (exit_status(spawn(argv[1], "coap_load", args)) != 0) {
+            fprintf(stderr, "the %s %s load failed\n", loads[i][1], loads[i][3]);
+            failures++;
+        }
+    }
+
+    const char *probe_args[] = {"state_probe", "-n", PROBE_ROUNDS, "127.0.0.1", PORT, NULL};
+    printf("state_probe -n %s 127.0.0.1 %s\n", PROBE_ROUNDS, PORT);
+    fflush(stdout);
+    if (exit_status(spawn(argv[1], "state_probe", probe_args)) != 0) {
+        fprintf(stderr, "state_probe failed\n");
+        failures++;
+    }
+
+    kill(server, SIGTERM);
+    if (exit_status(server) != 0) {
+        fprintf(stderr, "coap_server_host didn't stop cleanly\n");
+        failures++;
+    }
+    if (failures) printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+/* The node's CoAP endpoints on Linux, the server side of the load benchmark.
+ * Serves UDP and TCP on the CoAP port and DTLS with the menuconfig default PSK on the
+ * next one, and joins the menuconfig multicast group like a node. A thread stands in for
+ * the audio task and publishes a spectrum every frame, mDNS, NVS and the LEDs are left out.
+ * Prints how many state changes it applied when stopped */
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "coap3/coap.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "coap_endpoints.h"
+
+/* Default of the menuconfig COAP_PSK_KEY, identity "CoAP" like on the node */
+#define COAP_PSK           "secret-key"
+#define COAP_NOTIFY_MS     (100)
+/* Warnings only, syslog's LOG_WARNING */
+#define COAP_LOG_LEVEL     (4)
+/* The audio task publishes one spectrum per I2S read */
+#define AUDIO_FRAME_US     (1000000LL * (I2S_READ_LEN / 2) / I2S_SAMPLE_RATE)
+
+const static char *TAG = "CoAP host server";
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal)
+{
+    (void)signal;
+    running = 0;
+}
+
+/**
+ * @brief Publishes a slowly sweeping spectrum at the audio frame rate, consecutive frames differ like music does
+ */
+static void *audio_stand_in(void *arg)
+{
+    (void)arg;
+    FFT_PRECISION bands[SPECTRUM_BANDS];
+    static FFT_PRECISION magnitudes[SPECTRUM_BINS * SPECTRUM_GROUP];
+    unsigned frame = 0;
+
+    while (running) {
+        for (int k = 0; k < SPECTRUM_BINS * SPECTRUM_GROUP; k++) {
+            magnitudes[k] = 1000 * (1.0f + sinf(0.02f * k + 0.1f * frame));
+        }
+        for (int b = 0; b < SPECTRUM_BANDS; b++) {
+            bands[b] = 100000 * (1.0f + sinf(0.3f * frame + b));
+        }
+        SpectrumFrame *spectrum = spectrum_mailbox_back(&spectrum_mailbox);
+        spectrum_frame_quantize(spectrum, bands, magnitudes);
+        spectrum_mailbox_publish(&spectrum_mailbox);
+        frame++;
+        usleep(AUDIO_FRAME_US);
+    }
+    return NULL;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-g group] [-i interface] [-u] [port]
+"
+            "  group defaults to " CONFIG_COAP_MCAST_GROUP ", -g '' joins none,
+"
+            "  -u serves plain UDP only, so several servers can share the port
+", name);
+    exit(2);
+}
+
+/**
+ * @brief Adds an endpoint of proto on port, returns 0 or -1
+ */
+static int add_endpoint(coap_context_t *ctx, uint16_t port, coap_proto_t proto)
+{
+    coap_address_t serv_addr;
+    coap_address_init(&serv_addr);
+    serv_addr.addr.sin.sin_family      = AF_INET;
+    serv_addr.addr.sin.sin_addr.s_addr = INADDR_ANY;
+    serv_addr.addr.sin.sin_port        = htons(port);
+    serv_addr.size = sizeof(serv_addr.addr.sin);
+    if (!coap_new_endpoint(ctx, &serv_addr, proto)) {
+        ESP_LOGE(TAG, "coap_new_endpoint() for port %u failed", port);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *group = CONFIG_COAP_MCAST_GROUP;
+    const char *interface = NULL;
+    int udp_only = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "g:i:u")) != -1) {
+        switch (opt) {
+            case 'g': group = optarg; break;
+            case 'i': interface = optarg; break;
+            case 'u': udp_only = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    uint16_t port = optind < argc ? (uint16_t)atoi(argv[optind]) : COAP_DEFAULT_PORT;
+    coap_resource_t *features_resource = NULL, *state_resource = NULL, *spectrum_resource = NULL;
+    uint32_t notified_shape_version = 0;
+    uint32_t notified_state_version = 0;
+    int64_t spectrum_sent_us = 0;
+    pthread_t audio_thread;
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    coap_startup();
+    coap_set_log_level(COAP_LOG_LEVEL);
+
+    /* what the NVS daemon does at boot without stored values */
+    get_endpoints_event_group();
+    settings_storage defaults = {
+        .amp_min = SOUND_AMPLITUDE_MIN_TRESH,
+        .amp_max = SOUND_AMPLITUDE_MAX_TRESH,
+        .freq_b_start = BLUE_FREQ_START,
+        .freq_b_end = BLUE_FREQ_END,
+        .freq_g_end = GREEN_FREQ_END,
+        .freq_r_end = RED_FREQ_END,
+        .hold_mode_int = HOLD_MODE_INTENSITY,
+    };
+    config_set_settings(&defaults);
+
+    coap_context_t *ctx = coap_new_context(NULL);
+    if (!ctx) {
+        ESP_LOGE(TAG, "coap_new_context() failed");
+        return 1;
+    }
+    coap_context_set_block_mode(ctx, COAP_BLOCK_USE_LIBCOAP | COAP_BLOCK_SINGLE_BODY);
+
+    if (add_endpoint(ctx, port, COAP_PROTO_UDP) != 0) goto clean_up;
+    /* group requests reach the UDP endpoint, repeats of them are caught as on a node */
+    if (strlen(group)) {
+        if (coap_join_mcast_group_intf(ctx, group, interface) != 0) {
+            ESP_LOGE(TAG, "Joining CoAP multicast group %s failed", group);
+            goto clean_up;
+        }
+        ESP_LOGI(TAG, "Joined CoAP multicast group %s", group);
+    }
+    if (udp_only) {
+        ESP_LOGI(TAG, "Serving plain UDP only");
+    } else {
+        if (coap_tcp_is_supported() && add_endpoint(ctx, port, COAP_PROTO_TCP) != 0) goto clean_up;
+        if (coap_dtls_is_supported()) {
+            coap_register_event_handler(ctx, dtls_event_handler);
+            coap_context_set_psk(ctx, "CoAP", (const uint8_t *)COAP_PSK, sizeof(COAP_PSK) - 1);
+            if (add_endpoint(ctx, port + 1, COAP_PROTO_DTLS) != 0) goto clean_up;
+        } else {
+            ESP_LOGW(TAG, "libcoap built without DTLS, only UDP and TCP are served");
+        }
+    }
+
+    handlers_t handlers;
+    set_endpoints_handlers(&handlers);
+    for (endpoint x = 0; x < endpoint_size; x++) {
+        coap_str_const_t *endpoint_string = coap_make_str_const(ENDPOINT_STRING[x]);
+        coap_resource_t *resource = coap_resource_init(endpoint_string, 0);
+        if (!resource) {
+            ESP_LOGE(TAG, "coap_resource_init() failed");
+            goto clean_up;
+        }
+        coap_register_handler(resource, COAP_REQUEST_GET, handlers.get_handlers[x]);
+        coap_register_handler(resource, COAP_REQUEST_PUT, handlers.put_handlers[x]);
+        coap_register_handler(resource, COAP_REQUEST_DELETE, handlers.del_handlers[x]);
+        coap_register_handler(resource, COAP_REQUEST_PATCH, handlers.patch_handlers[x]);
+        coap_register_handler(resource, COAP_REQUEST_IPATCH, handlers.patch_handlers[x]);
+        coap_resource_set_get_observable(resource, 1);
+        coap_add_resource(ctx, resource);
+        if (x == features) features_resource = resource;
+        if (x == state) state_resource = resource;
+        if (x == spectrum) {
+            coap_resource_set_mode(resource, COAP_RESOURCE_FLAGS_NOTIFY_NON);
+            spectrum_resource = resource;
+        }
+    }
+
+    if (pthread_create(&audio_thread, NULL, audio_stand_in, NULL) != 0) {
+        ESP_LOGE(TAG, "Starting the audio stand-in failed");
+        goto clean_up;
+    }
+    if (udp_only) ESP_LOGI(TAG, "Serving on port %u", port);
+    else ESP_LOGI(TAG, "Serving on port %u, DTLS on %u", port, port + 1);
+
+    /* the notification rules of the node's CoAP task */
+    while (running) {
+        unsigned notify_ms = spectrum_interval_ms < COAP_NOTIFY_MS ? spectrum_interval_ms : COAP_NOTIFY_MS;
+        if (coap_io_process(ctx, notify_ms) < 0) break;
+        if (notified_shape_version != shape_version) {
+            notified_shape_version = shape_version;
+            coap_resource_notify_observers(features_resource, NULL);
+        }
+        if (notified_state_version != state_version) {
+            notified_state_version = state_version;
+            coap_resource_notify_observers(state_resource, NULL);
+        }
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - spectrum_sent_us >= spectrum_interval_ms * 1000LL && spectrum_advance()) {
+            spectrum_sent_us = now_us;
+            coap_resource_notify_observers(spectrum_resource, NULL);
+        }
+    }
+    running = 0;
+    pthread_join(audio_thread, NULL);
+    printf("%u state changes applied\n", (unsigned)state_version);
+    if (dtls_handshakes.full) {
+        printf("DTLS handshakes: %u averaging %u ms, %u failed\n", dtls_handshakes.full,
+               (unsigned)(dtls_handshakes.full_ms_total / dtls_handshakes.full), dtls_handshakes.failed);
+    }
+
+clean_up:
+    coap_free_context(ctx);
+    coap_cleanup();
+    return 0;
+}
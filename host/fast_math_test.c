@@ -0,0 +1,91 @@
+/* Error and speed of the fast logs against libm. Every 7th float from 1e-6 to 1e6 goes
+ * through fast_log2f_lut and fast_log2f and is compared with a double log2, the errors must
+ * stay within what fast_math.h states. Then each is timed over a buffer of inputs next to
+ * log2f and logf, in ns per call. Exits 1 if an error bound is exceeded */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "fast_math.h"
+
+#define LUT_MAX_ERROR      (1.3e-5)
+#define QUADRATIC_MAX_ERROR (0.008)
+#define STRIDE             (7)
+#define TIMED_LEN          (4096)
+#define TIMED_ROUNDS       (5000)
+/* 20 * log10(2), as in main/coap_server_main.c */
+#define DB_PER_LOG2        (6.0206)
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint32_t bits_of(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+static float float_of(uint32_t bits)
+{
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+/* a call per element, summed so the calls can't be dropped */
+#define TIME_CALLS(fn, inputs, ns) do { \
+        volatile float sink = 0; \
+        int64_t started = now_ns(); \
+        for (int r = 0; r < TIMED_ROUNDS; r++) { \
+            float sum = 0; \
+            for (int i = 0; i < TIMED_LEN; i++) sum += fn(inputs[i]); \
+            sink += sum; \
+        } \
+        ns = (double)(now_ns() - started) / TIMED_ROUNDS / TIMED_LEN; \
+    } while (0)
+
+int main(void)
+{
+    double lut_worst = 0, quadratic_worst = 0;
+    float lut_at = 0, quadratic_at = 0;
+    long checked = 0;
+    for (uint32_t bits = bits_of(1e-6f); bits <= bits_of(1e6f); bits += STRIDE) {
+        float x = float_of(bits);
+        double exact = log2((double)x);
+        double lut_error = fabs(fast_log2f_lut(x) - exact);
+        double quadratic_error = fabs(fast_log2f(x) - exact);
+        if (lut_error > lut_worst) {
+            lut_worst = lut_error;
+            lut_at = x;
+        }
+        if (quadratic_error > quadratic_worst) {
+            quadratic_worst = quadratic_error;
+            quadratic_at = x;
+        }
+        checked++;
+    }
+    printf("%ld floats from 1e-6 to 1e6\n", checked);
+    printf("fast_log2f_lut max error %.2e at %g (%.5f dB), bound %.1e\n", lut_worst, lut_at,
+           lut_worst * DB_PER_LOG2, LUT_MAX_ERROR);
+    printf("fast_log2f     max error %.2e at %g (%.5f dB), bound %.1e\n", quadratic_worst, quadratic_at,
+           quadratic_worst * DB_PER_LOG2, QUADRATIC_MAX_ERROR);
+
+    static float inputs[TIMED_LEN];
+    for (int i = 0; i < TIMED_LEN; i++) inputs[i] = powf(10, -6 + 12.0f * i / TIMED_LEN);
+    double lut_ns, quadratic_ns, log2f_ns, logf_ns;
+    TIME_CALLS(fast_log2f_lut, inputs, lut_ns);
+    TIME_CALLS(fast_log2f, inputs, quadratic_ns);
+    TIME_CALLS(log2f, inputs, log2f_ns);
+    TIME_CALLS(logf, inputs, logf_ns);
+    printf("ns per call: fast_log2f_lut %.2f, fast_log2f %.2f, log2f %.2f, logf %.2f\n", lut_ns, quadratic_ns,
+           log2f_ns, logf_ns);
+
+    return lut_worst <= LUT_MAX_ERROR && quadratic_worst <= QUADRATIC_MAX_ERROR ? 0 : 1;
+}
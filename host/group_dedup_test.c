@@ -0,0 +1,55 @@
+/* Repeats of group requests. A repeat from the same sender with the same message ID and token
+ * must be caught, from another sender or with another token it is a new request. Unicast
+ * requests are never repeats and, however many there are, must not push a group request out
+ * of the ring. GROUP_DEDUP_REQUESTS later group requests do. Exits 1 on a wrong answer */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "group_dedup.h"
+
+#define UNICAST_FLOOD      (1000)
+
+static int failures;
+
+static void expect(int ok, const char *what)
+{
+    if (ok) return;
+    failures++;
+    fprintf(stderr, "%s\n", what);
+}
+
+static int put(group_dedup *recent, int group, uint8_t sender, uint16_t mid, uint8_t token)
+{
+    uint8_t address[6] = {192, 168, 1, sender, 0x16, 0x33};
+    return group_dedup_repeated(recent, group, address, sizeof(address), mid, &token, 1);
+}
+
+int main(void)
+{
+    group_dedup recent;
+    memset(&recent, 0, sizeof(recent));
+
+    expect(!put(&recent, 1, 10, 100, 1), "first group request taken as a repeat");
+    expect(put(&recent, 1, 10, 100, 1), "group repeat not caught");
+    expect(!put(&recent, 1, 11, 100, 1), "request of another sender taken as a repeat");
+    expect(!put(&recent, 1, 10, 100, 2), "request with another token taken as a repeat");
+    expect(!put(&recent, 1, 10, 101, 1), "request with another message ID taken as a repeat");
+
+    /* unicast NONs may legitimately reuse IDs of a client that restarted, they're all applied */
+    expect(!put(&recent, 0, 10, 200, 1), "unicast request taken as a repeat");
+    expect(!put(&recent, 0, 10, 200, 1), "unicast resend taken as a repeat");
+    expect(!put(&recent, 0, 10, 100, 1), "unicast request matching a group request taken as a repeat");
+
+    for (int i = 0; i < UNICAST_FLOOD; i++) put(&recent, 0, 20, (uint16_t)i, 1);
+    int held = put(&recent, 1, 10, 100, 1);
+    expect(held, "unicast requests pushed a group request out");
+
+    for (int i = 0; i < GROUP_DEDUP_REQUESTS; i++) put(&recent, 1, 30, (uint16_t)i, 1);
+    expect(!put(&recent, 1, 10, 100, 1), "group request still remembered after the ring turned");
+
+    printf("group repeats caught, %d unicast requests left %s group request in the ring of %d\n", UNICAST_FLOOD,
+           held ? "the" : "no", GROUP_DEDUP_REQUESTS);
+    if (failures) printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+/* Speed of the HPSS median filters. hpss_forward keeps its time and frequency windows
+ * sorted and replaces one value per step, the reference copies every window and sorts it
+ * with qsort. Both split the same random frames, their masks must be identical, then
+ * each is timed. Exits 1 if the outputs differ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hpss.h"
+#include "rgb_leds.h"
+
+#define CHECKED_FRAMES     (500)
+#define TIMED_FRAMES       (5000)
+#define FRAME_SETS         (64)
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+static int clamp_bin(int bin, int bins)
+{
+    return bin < 0 ? 0 : (bin >= bins ? bins - 1 : bin);
+}
+
+/**
+ * @brief The same split with every median window copied and sorted, history is a bins x HPSS_TIME_LEN ring
+ */
+static void naive_hpss(const FFT_PRECISION *magnitudes, float *history, int head, FFT_PRECISION *harmonic)
+{
+    float window[HPSS_TIME_LEN > HPSS_FREQ_LEN ? HPSS_TIME_LEN : HPSS_FREQ_LEN];
+    for (int bin = 0; bin < FFT_BINS; bin++) {
+        history[bin * HPSS_TIME_LEN + head] = magnitudes[bin];
+        memcpy(window, history + bin * HPSS_TIME_LEN, HPSS_TIME_LEN * sizeof(float));
+        qsort(window, HPSS_TIME_LEN, sizeof(float), compare_floats);
+        float h = window[HPSS_TIME_LEN / 2];
+        for (int i = 0; i < HPSS_FREQ_LEN; i++) window[i] = magnitudes[clamp_bin(bin + i - HPSS_FREQ_LEN / 2, FFT_BINS)];
+        qsort(window, HPSS_FREQ_LEN, sizeof(float), compare_floats);
+        float p = window[HPSS_FREQ_LEN / 2];
+        float hh = h * h, pp = p * p;
+        float mask = hh + pp > 0 ? hh / (hh + pp) : 0.5f;
+        float mag = magnitudes[bin];
+        harmonic[bin] = mag * mask;
+    }
+}
+
+int main(void)
+{
+    static FFT_PRECISION frames[FRAME_SETS][FFT_BINS], harmonic[FFT_BINS];
+    static float history[FFT_BINS * HPSS_TIME_LEN];
+    Hpss *hpss = create_hpss(FFT_BINS);
+    int mismatches = 0;
+
+    srand(1);
+    /* float values, so both sides see the magnitudes the sorted windows store */
+    for (int s = 0; s < FRAME_SETS; s++) {
+        for (int k = 0; k < FFT_BINS; k++) frames[s][k] = (float)(100.0 * rand() / RAND_MAX);
+    }
+    for (int f = 0; f < CHECKED_FRAMES; f++) {
+        const FFT_PRECISION *magnitudes = frames[f % FRAME_SETS];
+        hpss_forward(hpss, magnitudes);
+        naive_hpss(magnitudes, history, f % HPSS_TIME_LEN, harmonic);
+        for (int k = 0; k < FFT_BINS; k++) mismatches += hpss->harmonic[k] != harmonic[k];
+    }
+    printf("%d frames of %d bins, %d harmonic magnitudes differ from the sorted reference\n", CHECKED_FRAMES,
+           FFT_BINS, mismatches);
+
+    volatile int hits = 0;
+    int64_t started = now_ns();
+    for (int f = 0; f < TIMED_FRAMES; f++) hits += hpss_forward(hpss, frames[f % FRAME_SETS]);
+    double fast_us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+    started = now_ns();
+    for (int f = 0; f < TIMED_FRAMES; f++) naive_hpss(frames[f % FRAME_SETS], history, f % HPSS_TIME_LEN, harmonic);
+    double naive_us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+    printf("hpss_forward %.1f us per frame (%.1f Mbin/s), qsort reference %.1f us, %.1fx\n", fast_us,
+           FFT_BINS / fast_us, naive_us, naive_us / fast_us);
+
+    free_hpss(hpss);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+/* ESP-IDF, FreeRTOS and LED calls of the endpoint layer, on POSIX for the host build */
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mdns.h"
+#include "freertos/event_groups.h"
+#include "rgb_leds.h"
+
+struct event_group {
+    EventBits_t bits;
+};
+
+static pthread_mutex_t critical_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_lock(&critical_mutex);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000u);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    return __atomic_or_fetch(&group->bits, bits, __ATOMIC_SEQ_CST);
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    return __atomic_fetch_and(&group->bits, ~bits, __ATOMIC_SEQ_CST);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    (void)type;
+    const uint8_t host_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    for (int i = 0; i < 6; i++) mac[i] = host_mac[i];
+    return ESP_OK;
+}
+
+esp_err_t mdns_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t mdns_hostname_set(const char *hostname)
+{
+    (void)hostname;
+    return ESP_OK;
+}
+
+esp_err_t mdns_instance_name_set(const char *instance_name)
+{
+    (void)instance_name;
+    return ESP_OK;
+}
+
+esp_err_t mdns_service_add(const char *instance_name, const char *service_type, const char *proto,
+                           uint16_t port, mdns_txt_item_t txt[], size_t num_items)
+{
+    (void)instance_name; (void)service_type; (void)proto; (void)port; (void)txt; (void)num_items;
+    return ESP_OK;
+}
+
+esp_err_t mdns_service_txt_item_set(const char *service_type, const char *proto,
+                                    const char *key, const char *value)
+{
+    (void)service_type; (void)proto; (void)key; (void)value;
+    return ESP_OK;
+}
+
+void set_rgb(uint8_t red, uint8_t green, uint8_t blue, uint8_t intensity)
+{
+    (void)red; (void)green; (void)blue; (void)intensity;
+}
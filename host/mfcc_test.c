@@ -0,0 +1,151 @@
+/* MFCC front end against a naive reference, and its speed. The reference builds every
+ * mel triangle densely over all bins, takes libm's log and computes the DCT-II term by
+ * term. The coefficients of random and tonal spectra must agree within what the fast
+ * log's error can add up to over the filters. Both are then timed. Exits 1 on a mismatch */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mfcc.h"
+#include "rgb_leds.h"
+
+#define SPECTRA            (2000)
+#define TIMED_FRAMES       (20000)
+/* As in main/coap_server_main.c */
+#define MFCC_FILTERS       (16)
+#define MFCC_COEFFS        (8)
+#define MFCC_FREQ_LO       (100)
+#define MFCC_FREQ_HI       (8000)
+/* Max error of fast_logf, fast_log2f's 0.008 in natural log units */
+#define FAST_LOG_ERROR     (0.0056)
+#define ENERGY_FLOOR       (1e-10)
+
+typedef struct mfcc_config {
+    const char *name;
+    int bins;
+    double bin_hz;
+} mfcc_config;
+
+static const mfcc_config configs[] = {
+    {"audio task bins", FFT_BINS, FFT_BIN_HZ},
+    {"21.5 Hz bins", 512, 21.533},
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static double mel(double hz)
+{
+    return 2595.0 * log10(1.0 + hz / 700.0);
+}
+
+static double hz(double mel)
+{
+    return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+/**
+ * @brief Textbook MFCCs of one frame of magnitudes
+ */
+static void naive_mfcc(const FFT_PRECISION *magnitudes, int bins, double bin_hz, double *out)
+{
+    double energies[MFCC_FILTERS];
+    double mel_step = (mel(MFCC_FREQ_HI) - mel(MFCC_FREQ_LO)) / (MFCC_FILTERS + 1);
+    for (int f = 0; f < MFCC_FILTERS; f++) {
+        double left = hz(mel(MFCC_FREQ_LO) + f * mel_step);
+        double center = hz(mel(MFCC_FREQ_LO) + (f + 1) * mel_step);
+        double right = hz(mel(MFCC_FREQ_LO) + (f + 2) * mel_step);
+        double energy = ENERGY_FLOOR;
+        int covered = 0;
+        for (int k = 0; k < bins; k++) {
+            double freq = k * bin_hz;
+            double weight = freq <= center ? (freq - left) / (center - left) : (right - freq) / (right - center);
+            if (weight <= 0 || freq >= right) continue;
+            energy += weight * magnitudes[k] * magnitudes[k];
+            covered = 1;
+        }
+        /* a filter narrower than a bin takes the nearest one */
+        if (!covered) {
+            int k = (int)(center / bin_hz + 0.5);
+            k = k < bins ? k : bins - 1;
+            energy += magnitudes[k] * magnitudes[k];
+        }
+        energies[f] = log(energy);
+    }
+    for (int i = 0; i < MFCC_COEFFS; i++) {
+        out[i] = 0;
+        for (int f = 0; f < MFCC_FILTERS; f++) out[i] += energies[f] * cos(M_PI * i * (f + 0.5) / MFCC_FILTERS);
+    }
+}
+
+/**
+ * @brief Random magnitudes for even n, a few harmonic partials over a noise floor for odd n
+ */
+static void spectrum(FFT_PRECISION *magnitudes, int bins, int n)
+{
+    for (int k = 0; k < bins; k++) magnitudes[k] = (n % 2 ? 0.01 : 100.0) * rand() / RAND_MAX;
+    if (n % 2) {
+        int fundamental = 1 + rand() % 20;
+        for (int h = 1; h * fundamental < bins; h++) magnitudes[h * fundamental] += 50.0 / h;
+    }
+}
+
+static int check(const mfcc_config *config)
+{
+    Mfcc *mfcc = create_mfcc(config->bins, config->bin_hz, MFCC_FILTERS, MFCC_COEFFS, MFCC_FREQ_LO, MFCC_FREQ_HI);
+    FFT_PRECISION *magnitudes = malloc(config->bins * sizeof(FFT_PRECISION));
+    double reference[MFCC_COEFFS], worst = 0;
+    double tolerance = MFCC_FILTERS * FAST_LOG_ERROR;
+    int failures = 0;
+
+    for (int n = 0; n < SPECTRA; n++) {
+        spectrum(magnitudes, config->bins, n);
+        mfcc_forward(mfcc, magnitudes);
+        naive_mfcc(magnitudes, config->bins, config->bin_hz, reference);
+        for (int i = 0; i < MFCC_COEFFS; i++) {
+            double error = fabs(mfcc->mfcc[i] - reference[i]);
+            if (error > worst) worst = error;
+            if (error > tolerance && failures++ < 10) {
+                fprintf(stderr, "%s, spectrum %d: c%d is %.4f, reference %.4f\n", config->name, n, i,
+                        mfcc->mfcc[i], reference[i]);
+            }
+        }
+    }
+    printf("%-16s worst coefficient error %.4f, tolerance %.4f\n", config->name, worst, tolerance);
+
+    volatile double sink = 0;
+    int64_t started = now_ns();
+    for (int f = 0; f < TIMED_FRAMES; f++) {
+        magnitudes[f % config->bins] += 1;
+        mfcc_forward(mfcc, magnitudes);
+        sink += mfcc->mfcc[1];
+    }
+    double fast_us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+    started = now_ns();
+    for (int f = 0; f < TIMED_FRAMES; f++) {
+        magnitudes[f % config->bins] += 1;
+        naive_mfcc(magnitudes, config->bins, config->bin_hz, reference);
+        sink += reference[1];
+    }
+    double naive_us = (now_ns() - started) / 1000.0 / TIMED_FRAMES;
+    printf("%-16s %.3f us per frame, naive %.3f us, %.1fx\n", config->name, fast_us, naive_us, naive_us / fast_us);
+
+    free(magnitudes);
+    free_mfcc(mfcc);
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+    srand(1);
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) failures += check(&configs[c]);
+    if (failures) printf("%d coefficients off\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+/* Clips of each mood drawn from a seed, so the training and held out sets are the same on every
+ * run. Tones are placed in the units of the band edges and the MFCC range, where the frame's
+ * sample rate is FFT_BIN_HZ * FRAME as in chroma_bench, tempos and note lengths in seconds.
+ *  calm       a few mid tones, held for seconds under a slow swell, quiet
+ *  energetic  kicks, noise bursts and a chord changing every beat, loud
+ *  bass       a low tone pulsing with the beat over a faint mid tone
+ *  bright     a fast arpeggio of high tones over hiss
+ * Each clip draws its tempo, pitches and level, the features come out of the node's pipeline:
+ * the frame scaled by its range, the transform, the noise floor, the band sums over the default
+ * edges, the MFCC and mood_features_add */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mood_clips.h"
+#include "noise_floor.h"
+#include "rgb_leds.h"
+
+#define FRAME              (I2S_READ_LEN / 2)
+#define SAMPLE_HZ          (FFT_BIN_HZ * FRAME)
+#define TONES              (3)
+
+/* As in main/coap_server_main.c */
+#define MFCC_FILTERS       (16)
+#define MFCC_COEFFS        (8)
+#define MFCC_FREQ_LO       (100)
+#define MFCC_FREQ_HI       (8000)
+#define MOOD_WINDOW_US     (1000000)
+#define AUDIO_FRAME_US     (1000000.0 * FRAME / I2S_SAMPLE_RATE)
+
+typedef struct synth {
+    int mood;
+    uint32_t rng;
+    float level;                /* peak in ADC codes */
+    long beat;                  /* samples per beat, 0 for none */
+    long note;                  /* samples between pitch changes */
+    float lo_hz, hi_hz;         /* range the tones are drawn from */
+    float tone_hz[TONES];
+    double phase[TONES];
+    float last_noise;
+} synth;
+
+static float uniform(synth *s, float lo, float hi)
+{
+    s->rng = s->rng * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (s->rng >> 8) / 16777216.0f;
+}
+
+static void draw_tones(synth *s)
+{
+    for (int i = 0; i < TONES; i++) s->tone_hz[i] = uniform(s, s->lo_hz, s->hi_hz);
+}
+
+static void synth_start(synth *s, int mood, uint32_t seed)
+{
+    memset(s, 0, sizeof(*s));
+    s->mood = mood;
+    s->rng = seed * 2654435761u + mood + 1;
+    switch (mood) {
+    case mood_calm:
+        s->level = uniform(s, 450, 800);
+        s->note = (long)(uniform(s, 1.5f, 3) * I2S_SAMPLE_RATE);
+        s->lo_hz = 600;
+        s->hi_hz = 2400;
+        break;
+    case mood_energetic:
+        s->level = uniform(s, 1500, 1900);
+        s->beat = (long)(60 / uniform(s, 120, 170) * I2S_SAMPLE_RATE);
+        s->note = s->beat;
+        s->lo_hz = 400;
+        s->hi_hz = 6000;
+        break;
+    case mood_bass:
+        s->level = uniform(s, 1200, 1600);
+        s->beat = (long)(60 / uniform(s, 70, 110) * I2S_SAMPLE_RATE);
+        s->note = 4 * s->beat;
+        s->lo_hz = 150;
+        s->hi_hz = 450;
+        break;
+    default:
+        s->level = uniform(s, 700, 1000);
+        s->note = (long)(uniform(s, 0.12f, 0.25f) * I2S_SAMPLE_RATE);
+        s->lo_hz = 2500;
+        s->hi_hz = 7500;
+        break;
+    }
+    draw_tones(s);
+}
+
+/**
+ * @brief Sample n of the clip in ADC codes around 0
+ */
+static int16_t synth_sample(synth *s, long n)
+{
+    if (n % s->note == 0) draw_tones(s);
+    float tones[TONES];
+    for (int i = 0; i < TONES; i++) {
+        s->phase[i] += 2 * M_PI * s->tone_hz[i] / SAMPLE_HZ;
+        if (s->phase[i] > 2 * M_PI) s->phase[i] -= 2 * M_PI;
+        tones[i] = sinf(s->phase[i]);
+    }
+    float noise = uniform(s, -1, 1);
+    float since_beat = s->beat ? (float)(n % s->beat) / I2S_SAMPLE_RATE : 0;
+    float v;
+    switch (s->mood) {
+    case mood_calm:
+        v = (0.75f + 0.25f * sinf(2 * M_PI * 0.3f * n / I2S_SAMPLE_RATE)) * (tones[0] + tones[1] + tones[2]) / 3
+            + 0.01f * noise;
+        break;
+    case mood_energetic: {
+        float half = s->beat ? (float)(n % (s->beat / 2)) / I2S_SAMPLE_RATE : 0;
+        v = 0.5f * expf(-since_beat * 12) * tones[0] + 0.4f * expf(-half * 30) * noise
+            + 0.25f * (tones[1] + tones[2]) + 0.05f * noise;
+        break;
+    }
+    case mood_bass:
+        /* the low tone is the first, the other two sit an octave and two up, faint */
+        v = (0.4f + 0.6f * expf(-since_beat * 4)) * tones[0]
+            + 0.1f * sinf(2 * s->phase[0]) + 0.05f * sinf(4 * s->phase[0]) + 0.02f * noise;
+        break;
+    default:
+        v = (tones[0] + 0.6f * tones[1] + 0.4f * tones[2]) / 2 + 0.2f * (noise - s->last_noise);
+        break;
+    }
+    s->last_noise = noise;
+    float code = s->level * v;
+    return (int16_t)lrintf(code > 2047 ? 2047 : (code < -2048 ? -2048 : code));
+}
+
+void mood_clip_windows(int mood, uint32_t seed, int windows, float out[][CLASSIFIER_FEATURES])
+{
+    static int16_t frame[FRAME];
+    static FFT_PRECISION input[FRAME];
+    static FFT_PRECISION magnitudes[FFT_BINS];
+    uint8_t band_of_bin[FFT_BINS];
+    for (int k = 0; k < FFT_BINS; k++) {
+        double freq = k * FFT_BIN_HZ;
+        band_of_bin[k] = freq <= BLUE_FREQ_START || freq >= RED_FREQ_END ? 0xFF
+            : (freq < BLUE_FREQ_END ? COLOR_B_IDX : (freq < GREEN_FREQ_END ? COLOR_G_IDX : COLOR_R_IDX));
+    }
+    FFTTransformer *fft = create_fft_transformer(FRAME, FFT_SCALED_OUTPUT);
+    NoiseFloor *noise = create_noise_floor(FFT_BINS);
+    Mfcc *mfcc = create_mfcc(FFT_BINS, FFT_BIN_HZ, MFCC_FILTERS, MFCC_COEFFS, MFCC_FREQ_LO, MFCC_FREQ_HI);
+    MoodFeatures features = {0};
+    synth s;
+    synth_start(&s, mood, seed);
+
+    int window_frames = (int)lrint(MOOD_WINDOW_US / AUDIO_FRAME_US);
+    long n = 0;
+    for (int w = -MOOD_CLIP_WARMUP; w < windows; w++) {
+        for (int f = 0; f < window_frames; f++) {
+            int16_t hi = -2048, lo = 2047;
+            for (int i = 0; i < FRAME; i++, n++) {
+                frame[i] = synth_sample(&s, n);
+                if (frame[i] > hi) hi = frame[i];
+                if (frame[i] < lo) lo = frame[i];
+            }
+            /* frames the audio task skips as too quiet */
+            int range = hi - lo - SOUND_AMPLITUDE_MIN_TRESH;
+            if (range / 16 <= 0) continue;
+            for (int i = 0; i < FRAME; i++) input[i] = frame[i] / (FFT_PRECISION)(range / 16);
+            fft_forward(fft, input);
+            for (int i = 0; i < FRAME; i += 2) magnitudes[i / 2] = sqrt(input[i] * input[i] + input[i + 1] * input[i + 1]);
+            noise_floor_apply(noise, magnitudes);
+            FFT_PRECISION rgb[3] = {0};
+            for (int k = 0; k < FFT_BINS; k++) {
+                if (band_of_bin[k] != 0xFF) rgb[band_of_bin[k]] += magnitudes[k];
+            }
+            mfcc_forward(mfcc, magnitudes);
+            mood_features_add(&features, mfcc, rgb);
+        }
+        float window[CLASSIFIER_FEATURES];
+        mood_features_take(&features, window);
+        if (w >= 0) memcpy(out[w], window, sizeof(window));
+    }
+    free_fft_transformer(fft);
+    free_noise_floor(noise);
+    free_mfcc(mfcc);
+}
@@ -0,0 +1,20 @@
+/* Synthesized clips of known mood for host/mood_windows and host/classifier_test */
+#ifndef MOOD_CLIPS_H
+#define MOOD_CLIPS_H
+
+#include <stdint.h>
+
+#include "classifier.h"
+
+/* Windows a clip plays before its features are taken, the noise floor and c0 settle */
+#define MOOD_CLIP_WARMUP   (1)
+/* Clips below this seed are the training set, the held out clips start here */
+#define MOOD_HELD_OUT_SEED (1000)
+
+/**
+ * @brief Synthesizes clip seed of mood and writes the features of windows mood windows to out,
+ * extracted frame by frame as the audio task does, after MOOD_CLIP_WARMUP windows
+ */
+void mood_clip_windows(int mood, uint32_t seed, int windows, float out[][CLASSIFIER_FEATURES]);
+
+#endif /* MOOD_CLIPS_H */
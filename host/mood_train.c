@@ -0,0 +1,300 @@
+/* Trains the mood classifier from labelled feature windows and prints the mood_model
+ * definition of components/audio_dsp/mood_model.c.
+ * Input lines are "mood,f0,...,f11", the mood one of calm, energetic, bass and bright and
+ * the features the window means the node logs with DEBUG_MOOD_FEATURES. A float perceptron
+ * of the ClassifierModel layout is fit by full batch gradient descent on the cross entropy,
+ * then quantized: inputs to 126 steps of their largest magnitude, each layer's weights to
+ * int8 and the hidden layer to 126 steps of its largest activation. The accuracy of the
+ * float and the int8 model on the training windows goes to stderr, and on held out windows
+ * when a second file is given */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classifier.h"
+
+#define MAX_WINDOWS        (100000)
+#define EPOCHS             (3000)
+#define LEARNING_RATE      (0.1f)
+#define WEIGHT_DECAY       (1e-4f)
+/* Requantization multipliers are kept in 10 bits so acc * hidden_mult fits int32 */
+#define MULT_BITS          (10)
+
+#define GENERATE_MOOD_NAME(ENUM) #ENUM,
+
+static const char *mood_names[] = {
+    FOREACH_MOOD(GENERATE_MOOD_NAME)
+};
+
+typedef struct window {
+    float x[CLASSIFIER_FEATURES];
+    int mood;
+} window;
+
+typedef struct float_model {
+    float w1[CLASSIFIER_HIDDEN][CLASSIFIER_FEATURES];
+    float b1[CLASSIFIER_HIDDEN];
+    float w2[moods_size][CLASSIFIER_HIDDEN];
+    float b2[moods_size];
+} float_model;
+
+static window windows[MAX_WINDOWS], held_out[MAX_WINDOWS];
+static int window_count, held_out_count;
+/* the features are standardized for training, the first layer takes it back out */
+static float mean[CLASSIFIER_FEATURES], dev[CLASSIFIER_FEATURES];
+
+static float gaussian(void)
+{
+    float u = (rand() + 1.0f) / (RAND_MAX + 2.0f), v = rand() / (float)RAND_MAX;
+    return sqrtf(-2 * logf(u)) * cosf(2 * M_PI * v);
+}
+
+/**
+ * @brief Reads labelled windows into set, returns 0 or -1
+ */
+static int read_windows(FILE *in, window *set, int *count)
+{
+    char line[512];
+    int number = 0;
+    while (fgets(line, sizeof(line), in)) {
+        number++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char *field = strtok(line, ",");
+        window *w = &set[*count];
+        w->mood = -1;
+        for (int m = 0; m < moods_size; m++) {
+            /* names without their mood_ prefix */
+            if (strcmp(field, mood_names[m] + 5) == 0) w->mood = m;
+        }
+        int i = 0;
+        while (w->mood >= 0 && i < CLASSIFIER_FEATURES && (field = strtok(NULL, ",\n"))) w->x[i++] = strtof(field, NULL);
+        if (w->mood < 0 || i != CLASSIFIER_FEATURES) {
+            fprintf(stderr, "line %d: expected a mood and %d features\n", number, CLASSIFIER_FEATURES);
+            return -1;
+        }
+        if (++*count == MAX_WINDOWS) break;
+    }
+    return *count ? 0 : -1;
+}
+
+static void standardize(void)
+{
+    for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+        double sum = 0, squares = 0;
+        for (int n = 0; n < window_count; n++) sum += windows[n].x[i];
+        mean[i] = sum / window_count;
+        for (int n = 0; n < window_count; n++) squares += (windows[n].x[i] - mean[i]) * (windows[n].x[i] - mean[i]);
+        dev[i] = sqrt(squares / window_count);
+        if (dev[i] < 1e-6f) dev[i] = 1;
+    }
+}
+
+/**
+ * @brief Forward pass on standardized inputs, fills the hidden activations and class probabilities
+ */
+static int forward(const float_model *m, const float z[CLASSIFIER_FEATURES], float hidden[CLASSIFIER_HIDDEN],
+                   float p[moods_size])
+{
+    int best = 0;
+    float top = -INFINITY, sum = 0;
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        float acc = m->b1[h];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) acc += m->w1[h][i] * z[i];
+        hidden[h] = acc > 0 ? acc : 0;
+    }
+    for (int c = 0; c < moods_size; c++) {
+        p[c] = m->b2[c];
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) p[c] += m->w2[c][h] * hidden[h];
+        if (p[c] > top) {
+            top = p[c];
+            best = c;
+        }
+    }
+    for (int c = 0; c < moods_size; c++) sum += p[c] = expf(p[c] - top);
+    for (int c = 0; c < moods_size; c++) p[c] /= sum;
+    return best;
+}
+
+static void train(float_model *m)
+{
+    static float_model grad;
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) m->w1[h][i] = gaussian() * sqrtf(2.0f / CLASSIFIER_FEATURES);
+        m->b1[h] = 0.1f;
+    }
+    for (int c = 0; c < moods_size; c++) {
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) m->w2[c][h] = gaussian() * sqrtf(2.0f / CLASSIFIER_HIDDEN);
+    }
+
+    for (int epoch = 0; epoch < EPOCHS; epoch++) {
+        memset(&grad, 0, sizeof(grad));
+        double loss = 0;
+        for (int n = 0; n < window_count; n++) {
+            float z[CLASSIFIER_FEATURES], hidden[CLASSIFIER_HIDDEN], p[moods_size], dh[CLASSIFIER_HIDDEN] = {0};
+            for (int i = 0; i < CLASSIFIER_FEATURES; i++) z[i] = (windows[n].x[i] - mean[i]) / dev[i];
+            forward(m, z, hidden, p);
+            loss -= logf(p[windows[n].mood] + 1e-9f);
+            for (int c = 0; c < moods_size; c++) {
+                float d = p[c] - (c == windows[n].mood);
+                grad.b2[c] += d;
+                for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+                    grad.w2[c][h] += d * hidden[h];
+                    dh[h] += d * m->w2[c][h];
+                }
+            }
+            for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+                if (hidden[h] <= 0) continue;
+                grad.b1[h] += dh[h];
+                for (int i = 0; i < CLASSIFIER_FEATURES; i++) grad.w1[h][i] += dh[h] * z[i];
+            }
+        }
+        float step = LEARNING_RATE / window_count;
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+            m->b1[h] -= step * grad.b1[h];
+            for (int i = 0; i < CLASSIFIER_FEATURES; i++) m->w1[h][i] -= step * grad.w1[h][i] + WEIGHT_DECAY * m->w1[h][i];
+        }
+        for (int c = 0; c < moods_size; c++) {
+            m->b2[c] -= step * grad.b2[c];
+            for (int h = 0; h < CLASSIFIER_HIDDEN; h++) m->w2[c][h] -= step * grad.w2[c][h] + WEIGHT_DECAY * m->w2[c][h];
+        }
+        if (epoch % 500 == 0 || epoch == EPOCHS - 1) {
+            fprintf(stderr, "epoch %d: loss %.4f\n", epoch, loss / window_count);
+        }
+    }
+}
+
+static int8_t round_i8(float v)
+{
+    long r = lrintf(v);
+    return r < -127 ? -127 : (r > 127 ? 127 : (int8_t)r);
+}
+
+/**
+ * @brief Quantizes the trained model into the int8 layout of classifier_forward
+ */
+static void quantize(const float_model *m, ClassifierModel *q)
+{
+    /* raw feature weights, the standardization folded into the first layer */
+    float w1[CLASSIFIER_HIDDEN][CLASSIFIER_FEATURES], b1[CLASSIFIER_HIDDEN];
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        b1[h] = m->b1[h];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+            w1[h][i] = m->w1[h][i] / dev[i];
+            b1[h] -= w1[h][i] * mean[i];
+        }
+    }
+    for (int i = 0; i < CLASSIFIER_FEATURES; i++) {
+        float top = 0;
+        for (int n = 0; n < window_count; n++) top = fmaxf(top, fabsf(windows[n].x[i]));
+        q->input_scale[i] = top > 0 ? top / 126 : 1;
+    }
+
+    /* acc = w1q . xq + b1q is the float accumulator over a1 */
+    float a1 = 0;
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) a1 = fmaxf(a1, fabsf(w1[h][i] * q->input_scale[i]));
+    }
+    a1 /= 127;
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) q->w1[h][i] = round_i8(w1[h][i] * q->input_scale[i] / a1);
+        q->b1[h] = lrintf(b1[h] / a1);
+    }
+
+    /* hidden activations in steps of ah, requantized from steps of a1 */
+    float top_hidden = 0;
+    for (int n = 0; n < window_count; n++) {
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+            float acc = b1[h];
+            for (int i = 0; i < CLASSIFIER_FEATURES; i++) acc += w1[h][i] * windows[n].x[i];
+            top_hidden = fmaxf(top_hidden, acc);
+        }
+    }
+    float ah = top_hidden > 0 ? top_hidden / 126 : a1;
+    q->hidden_shift = 0;
+    while (a1 / ah * (1 << q->hidden_shift) < (1 << (MULT_BITS - 1)) && q->hidden_shift < 30) q->hidden_shift++;
+    q->hidden_mult = lrintf(a1 / ah * (1 << q->hidden_shift));
+
+    float a2 = 0;
+    for (int c = 0; c < moods_size; c++) {
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) a2 = fmaxf(a2, fabsf(m->w2[c][h] * ah));
+    }
+    a2 /= 127;
+    for (int c = 0; c < moods_size; c++) {
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) q->w2[c][h] = round_i8(m->w2[c][h] * ah / a2);
+        q->b2[c] = lrintf(m->b2[c] / a2);
+    }
+}
+
+static void print_model(const ClassifierModel *q, const char *source)
+{
+    printf("/* Trained by host/mood_train from %s, %d labelled windows */\n", source, window_count);
+    printf("const ClassifierModel mood_model = {\n    .input_scale = {");
+    for (int i = 0; i < CLASSIFIER_FEATURES; i++) printf("%s%.6gf", i ? ", " : " ", q->input_scale[i]);
+    printf(" },\n    .w1 = {\n");
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) {
+        printf("        {");
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) printf("%s%4d", i ? "," : "", q->w1[h][i]);
+        printf(" },\n");
+    }
+    printf("    },\n    .b1 = {");
+    for (int h = 0; h < CLASSIFIER_HIDDEN; h++) printf("%s%d", h ? ", " : " ", (int)q->b1[h]);
+    printf(" },\n    .hidden_mult = %d,\n    .hidden_shift = %d,\n    .w2 = {\n", (int)q->hidden_mult, q->hidden_shift);
+    for (int c = 0; c < moods_size; c++) {
+        printf("        {");
+        for (int h = 0; h < CLASSIFIER_HIDDEN; h++) printf("%s%4d", h ? "," : "", q->w2[c][h]);
+        printf(" },  // %s\n", mood_names[c]);
+    }
+    printf("    },\n    .b2 = {");
+    for (int c = 0; c < moods_size; c++) printf("%s%d", c ? ", " : " ", (int)q->b2[c]);
+    printf(" },\n};\n");
+}
+
+/**
+ * @brief Prints the accuracy of the float and the int8 model on a set of windows to stderr
+ */
+static void report(const char *name, const float_model *trained, const ClassifierModel *quantized,
+                   const window *set, int count)
+{
+    int float_right = 0, int_right = 0;
+    for (int n = 0; n < count; n++) {
+        float z[CLASSIFIER_FEATURES], hidden[CLASSIFIER_HIDDEN], p[moods_size];
+        int8_t q[CLASSIFIER_FEATURES];
+        int32_t scores[moods_size];
+        for (int i = 0; i < CLASSIFIER_FEATURES; i++) z[i] = (set[n].x[i] - mean[i]) / dev[i];
+        float_right += forward(trained, z, hidden, p) == set[n].mood;
+        classifier_quantize(quantized, set[n].x, q);
+        int_right += classifier_forward(quantized, q, scores) == set[n].mood;
+    }
+    fprintf(stderr, "%s accuracy: float %.1f %%, int8 %.1f %% of %d windows\n", name, 100.0 * float_right / count,
+            100.0 * int_right / count, count);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s windows.csv [held_out.csv] > mood_model.txt\n", argv[0]);
+        return 2;
+    }
+    for (int f = 1; f < argc; f++) {
+        FILE *in = fopen(argv[f], "r");
+        if (!in || read_windows(in, f == 1 ? windows : held_out, f == 1 ? &window_count : &held_out_count) != 0) {
+            fprintf(stderr, "No labelled windows in %s\n", argv[f]);
+            return 1;
+        }
+        fclose(in);
+    }
+    srand(1);
+    standardize();
+
+    static float_model trained;
+    static ClassifierModel quantized;
+    train(&trained);
+    quantize(&trained, &quantized);
+
+    report("training", &trained, &quantized, windows, window_count);
+    if (held_out_count) report("held out", &trained, &quantized, held_out, held_out_count);
+    print_model(&quantized, argv[1]);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/* Prints labelled feature windows of synthesized clips in the input format of mood_train,
+ * "mood,f0,...,f11", CLIP_WINDOWS windows of each clip. Takes the number of clips per mood
+ * and the seed of the first, 0 and up for the training set, MOOD_HELD_OUT_SEED and up for
+ * held out windows */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mood_clips.h"
+
+#define CLIP_WINDOWS       (3)
+
+#define GENERATE_MOOD_NAME(ENUM) #ENUM,
+
+static const char *mood_names[] = {
+    FOREACH_MOOD(GENERATE_MOOD_NAME)
+};
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s clips-per-mood first-seed > windows.csv\n", argv[0]);
+        return 2;
+    }
+    int clips = atoi(argv[1]);
+    uint32_t first = strtoul(argv[2], NULL, 10);
+    printf("# %d synthesized clips per mood from seed %u, %d windows each\n", clips, first, CLIP_WINDOWS);
+    for (int mood = 0; mood < moods_size; mood++) {
+        for (int c = 0; c < clips; c++) {
+            float windows[CLIP_WINDOWS][CLASSIFIER_FEATURES];
+            mood_clip_windows(mood, first + c, CLIP_WINDOWS, windows);
+            for (int w = 0; w < CLIP_WINDOWS; w++) {
+                /* names without their mood_ prefix */
+                printf("%s", mood_names[mood] + 5);
+                for (int i = 0; i < CLASSIFIER_FEATURES; i++) printf(",%.6g", windows[w][i]);
+                printf("\n");
+            }
+        }
+    }
+    return 0;
+}
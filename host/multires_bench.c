@@ -0,0 +1,153 @@
+/* Cost and response of the multi-resolution band analysis against one long transform.
+ * The reference gets the long transform's bass resolution by running a full rate
+ * MULTIRES_LONG_LEN * MULTIRES_DECIMATION point FFT every hop. Both run with the audio task's
+ * hop and default band edges. Reported per band: the level of a steady tone in the band
+ * relative to the reference, and the hops until a tone burst starting in the band reaches
+ * half its steady level. Then the time per hop of each */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "multires.h"
+#include "rgb_leds.h"
+
+/* As in main/coap_server_main.c, audio_multires reads a quarter frame per hop */
+#define HOP                (I2S_READ_LEN / 8)
+#define SAMPLE_HZ          (FFT_BIN_HZ * (I2S_READ_LEN / 2))
+#define REFERENCE_LEN      (MULTIRES_LONG_LEN * MULTIRES_DECIMATION)
+#define BANDS              (3)
+#define SETTLE_HOPS        (REFERENCE_LEN / HOP * 2)
+#define TIMED_HOPS         (20000)
+
+static const uint16_t edges[BANDS + 1] = {BLUE_FREQ_START, BLUE_FREQ_END, GREEN_FREQ_END, RED_FREQ_END};
+static const char *band_names[BANDS] = {"blue", "green", "red"};
+
+typedef struct reference {
+    FFTTransformer *fft;
+    float ring[REFERENCE_LEN];
+    int head;
+    float window[REFERENCE_LEN];
+    FFT_PRECISION work[REFERENCE_LEN];
+} reference;
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void reference_init(reference *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->fft = create_fft_transformer(REFERENCE_LEN, FFT_SCALED_OUTPUT);
+    for (int i = 0; i < REFERENCE_LEN; i++) r->window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / REFERENCE_LEN);
+}
+
+/**
+ * @brief Band levels of the newest REFERENCE_LEN samples after pushing a hop
+ */
+static void reference_bands(reference *r, const float *samples, int len, FFT_PRECISION *out)
+{
+    for (int i = 0; i < len; i++) {
+        r->ring[r->head] = samples[i];
+        r->head = (r->head + 1) % REFERENCE_LEN;
+    }
+    for (int i = 0; i < REFERENCE_LEN; i++) r->work[i] = r->ring[(r->head + i) % REFERENCE_LEN] * r->window[i];
+    fft_forward(r->fft, r->work);
+    FFT_PRECISION power[BANDS] = {0};
+    double bin_hz = SAMPLE_HZ / REFERENCE_LEN;
+    for (int k = 1; k < REFERENCE_LEN / 2; k++) {
+        double freq = k * bin_hz;
+        for (int b = 0; b < BANDS; b++) {
+            if (edges[b] < freq && freq < edges[b + 1]) {
+                power[b] += r->work[2 * k - 1] * r->work[2 * k - 1] + r->work[2 * k] * r->work[2 * k];
+            }
+        }
+    }
+    for (int b = 0; b < BANDS; b++) out[b] = sqrt(power[b]);
+}
+
+/**
+ * @brief A hop of a tone at freq switched on at on_hop, sample positions continue across hops
+ */
+static void tone(float *hop, long first_sample, double freq, int on)
+{
+    for (int i = 0; i < HOP; i++) hop[i] = on ? 0.5f * sinf(2 * M_PI * freq * (first_sample + i) / SAMPLE_HZ) : 0;
+}
+
+int main(void)
+{
+    static reference ref;
+    float hop[HOP];
+    FFT_PRECISION levels[BANDS], ref_levels[BANDS];
+
+    printf("%d sample hops, multires long bins %.1f, short bins %.1f, reference bins %.1f (band edge units)\n", HOP,
+           SAMPLE_HZ / MULTIRES_DECIMATION / MULTIRES_LONG_LEN, SAMPLE_HZ / MULTIRES_SHORT_LEN,
+           SAMPLE_HZ / REFERENCE_LEN);
+    for (int b = 0; b < BANDS; b++) {
+        double freq = (edges[b] + edges[b + 1]) / 2.0;
+        MultiRes *mr = create_multires(SAMPLE_HZ);
+        multires_set_bands(mr, edges, BANDS, edges[2]);
+        reference_init(&ref);
+
+        /* silence, then the burst: hops until half the steady level */
+        int on_hop = SETTLE_HOPS, mr_rise = -1, ref_rise = -1;
+        double mr_steady = 0, ref_steady = 0;
+        for (int h = 0; h < on_hop + 2 * SETTLE_HOPS; h++) {
+            tone(hop, (long)h * HOP, freq, h >= on_hop);
+            multires_push(mr, hop, HOP);
+            multires_bands(mr, levels);
+            reference_bands(&ref, hop, HOP, ref_levels);
+            if (h == on_hop + 2 * SETTLE_HOPS - 1) {
+                mr_steady = levels[b];
+                ref_steady = ref_levels[b];
+            }
+        }
+        /* again for the rise, now that the steady levels are known */
+        free_multires(mr);
+        mr = create_multires(SAMPLE_HZ);
+        multires_set_bands(mr, edges, BANDS, edges[2]);
+        free_fft_transformer(ref.fft);
+        reference_init(&ref);
+        for (int h = 0; h < on_hop + 2 * SETTLE_HOPS && (mr_rise < 0 || ref_rise < 0); h++) {
+            tone(hop, (long)h * HOP, freq, h >= on_hop);
+            multires_push(mr, hop, HOP);
+            multires_bands(mr, levels);
+            reference_bands(&ref, hop, HOP, ref_levels);
+            if (h >= on_hop && mr_rise < 0 && levels[b] >= mr_steady / 2) mr_rise = h - on_hop;
+            if (h >= on_hop && ref_rise < 0 && ref_levels[b] >= ref_steady / 2) ref_rise = h - on_hop;
+        }
+        printf("%-5s tone at %6.0f: level %.3f of the reference, half level after %d hops, reference %d hops\n",
+               band_names[b], freq, mr_steady / ref_steady, mr_rise, ref_rise);
+        free_multires(mr);
+        free_fft_transformer(ref.fft);
+    }
+
+    MultiRes *mr = create_multires(SAMPLE_HZ);
+    multires_set_bands(mr, edges, BANDS, edges[2]);
+    reference_init(&ref);
+    for (int i = 0; i < HOP; i++) hop[i] = (float)rand() / RAND_MAX - 0.5f;
+    volatile double sink = 0;
+    int64_t started = now_ns();
+    for (int h = 0; h < TIMED_HOPS; h++) {
+        multires_push(mr, hop, HOP);
+        multires_bands(mr, levels);
+        sink += levels[0];
+    }
+    double mr_us = (now_ns() - started) / 1000.0 / TIMED_HOPS;
+    started = now_ns();
+    for (int h = 0; h < TIMED_HOPS / 10; h++) {
+        reference_bands(&ref, hop, HOP, ref_levels);
+        sink += ref_levels[0];
+    }
+    double ref_us = (now_ns() - started) / 1000.0 / (TIMED_HOPS / 10);
+    printf("multires %.1f us per hop, %d point reference %.1f us, %.1fx\n", mr_us, REFERENCE_LEN, ref_us,
+           ref_us / mr_us);
+    free_multires(mr);
+    free_fft_transformer(ref.fft);
+    return 0;
+}
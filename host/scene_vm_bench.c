@@ -0,0 +1,105 @@
+/* Throughput of the scene VM. Runs a few scene programs tick by tick and reports the
+ * time per instruction and per renderer tick, and how long validating and loading an
+ * upload takes. The renderer ticks every 16 ms with a budget of SCENE_TICK_BUDGET
+ * instructions, so a tick's cost is the figure to compare with the renderer's period */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scene_vm.h"
+
+#define TICKS              (2000000)
+#define LOADS              (200000)
+
+typedef struct bench_scene {
+    const char *name;
+    const uint8_t *code;
+    size_t len;
+} bench_scene;
+
+/* arithmetic only, every tick runs the whole budget */
+static const uint8_t arithmetic[] = {
+    SCENE_MAGIC, SCENE_VERSION,
+    SCENE_OP_LOOP, 0,
+        SCENE_OP_ADD, 3, 2, 1,
+        SCENE_OP_MUL, 250,
+        SCENE_OP_MIX, 10, 200, 90, 64,
+        SCENE_OP_INT, 80,
+    SCENE_OP_NEXT,
+};
+
+/* audio operands in every color instruction */
+static const uint8_t audio[] = {
+    SCENE_MAGIC, SCENE_VERSION,
+    SCENE_OP_LOOP, 0,
+        SCENE_OP_SET | SCENE_OP_AUDIO, SCENE_SRC_AUDIO_R, SCENE_SRC_AUDIO_G, SCENE_SRC_AUDIO_B,
+        SCENE_OP_MIX | SCENE_OP_AUDIO, SCENE_SRC_AUDIO_B, SCENE_SRC_AUDIO_R, SCENE_SRC_AUDIO_G, SCENE_SRC_AUDIO_INT,
+        SCENE_OP_INT | SCENE_OP_AUDIO, SCENE_SRC_AUDIO_INT,
+        SCENE_OP_WAIT, 1, 0,
+    SCENE_OP_NEXT,
+};
+
+/* a light show as the app builds them, mostly fades and waits */
+static const uint8_t show[] = {
+    SCENE_MAGIC, SCENE_VERSION,
+    SCENE_OP_INT, 100,
+    SCENE_OP_LOOP, 3,
+        SCENE_OP_FADE, 255, 0, 0, 50, 0,
+        SCENE_OP_FADE, 0, 0, 255, 50, 0,
+        SCENE_OP_LOOP, 4,
+            SCENE_OP_SET, 255, 255, 255,
+            SCENE_OP_WAIT, 5, 0,
+            SCENE_OP_SET, 0, 0, 0,
+            SCENE_OP_WAIT, 5, 0,
+        SCENE_OP_NEXT,
+    SCENE_OP_NEXT,
+    SCENE_OP_FADE, 0, 255, 0, 100, 0,
+    SCENE_OP_END,
+};
+
+static const bench_scene scenes[] = {
+    {"arithmetic", arithmetic, sizeof(arithmetic)},
+    {"audio operands", audio, sizeof(audio)},
+    {"light show", show, sizeof(show)},
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int main(void)
+{
+    static scene_vm vm;
+    scene_operands ops = {.src = {200, 100, 50, 180}};
+    unsigned checksum = 0;
+
+    for (size_t s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++) {
+        if (scene_vm_load(&vm, scenes[s].code, scenes[s].len) != SCENE_OK) {
+            fprintf(stderr, "%s doesn't load\n", scenes[s].name);
+            return 1;
+        }
+        uint64_t executed = 0;
+        int64_t started = now_ns();
+        for (int t = 0; t < TICKS; t++) {
+            ops.src[SCENE_SRC_AUDIO_INT] = t;
+            executed += scene_vm_tick(&vm, &ops, SCENE_TICK_BUDGET);
+            checksum += vm.rgb[0] + vm.intensity;
+        }
+        double elapsed = now_ns() - started;
+        printf("%-16s %6.2f instructions per tick, %6.2f ns per instruction, %7.1f ns per tick\n",
+               scenes[s].name, (double)executed / TICKS, elapsed / executed, elapsed / TICKS);
+    }
+
+    int64_t started = now_ns();
+    for (int l = 0; l < LOADS; l++) {
+        checksum += scene_vm_load(&vm, show, sizeof(show));
+    }
+    printf("validate and load  %.1f ns per %zu byte scene\n", (double)(now_ns() - started) / LOADS, sizeof(show));
+    /* keeps the loops from being optimized out */
+    printf("checksum %u\n", checksum);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/* The prefs TLV encoding. Settings must survive an encode and apply, a TLV carrying some fields
+ * must leave the others alone, and tags of a newer app must be skipped. A TLV cut inside a
+ * field's tag and length or its value, a known field wider than any setting and a value that
+ * doesn't fit its field must be rejected without touching the settings. Exits 1 on a wrong answer */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "settings_tlv.h"
+
+static int failures;
+
+static void expect(int ok, const char *what)
+{
+    if (ok) return;
+    failures++;
+    fprintf(stderr, "%s\n", what);
+}
+
+static const settings_storage defaults = {
+    .amp_min = 350, .amp_max = 1650, .freq_b_start = 300, .freq_b_end = 500,
+    .freq_g_end = 1100, .freq_r_end = 3500, .hold_mode_int = 255,
+};
+
+/**
+ * @brief Applies a TLV to a copy of the defaults, expecting it rejected and the copy untouched
+ */
+static void expect_rejected(const uint8_t *tlv, size_t len, const char *what)
+{
+    settings_storage target = defaults;
+    expect(settings_tlv_apply(tlv, len, &target) == -1, what);
+    expect(memcmp(&target, &defaults, sizeof(target)) == 0, "a rejected TLV changed the settings");
+}
+
+int main(void)
+{
+    uint8_t tlv[SETTINGS_TLV_LEN];
+    settings_storage target = {0};
+    size_t len = settings_tlv_encode(&defaults, tlv);
+    expect(len == SETTINGS_TLV_LEN, "the encoding isn't SETTINGS_TLV_LEN long");
+    expect(settings_tlv_apply(tlv, len, &target) == 0, "an encoded TLV was rejected");
+    expect(memcmp(&target, &defaults, sizeof(target)) == 0, "settings changed on their way through the TLV");
+
+    /* only the blue band end, 450 */
+    const uint8_t one_field[] = {SETTINGS_TLV_VERSION, 4, 2, 0xC2, 0x01};
+    target = defaults;
+    expect(settings_tlv_apply(one_field, sizeof(one_field), &target) == 0, "a single field was rejected");
+    expect(target.freq_b_end == 450, "the single field wasn't applied");
+    target.freq_b_end = defaults.freq_b_end;
+    expect(memcmp(&target, &defaults, sizeof(target)) == 0, "a single field changed another");
+
+    /* tag 200 of a newer app, four bytes, then the blue band end */
+    const uint8_t unknown[] = {SETTINGS_TLV_VERSION, 200, 4, 1, 2, 3, 4, 4, 2, 0xC2, 0x01};
+    target = defaults;
+    expect(settings_tlv_apply(unknown, sizeof(unknown), &target) == 0, "an unknown tag was rejected");
+    expect(target.freq_b_end == 450, "the field after an unknown tag wasn't applied");
+    /* as long as no setting could be, it still only gets skipped */
+    const uint8_t unknown_wide[] = {SETTINGS_TLV_VERSION, 201, 6, 1, 2, 3, 4, 5, 6};
+    target = defaults;
+    expect(settings_tlv_apply(unknown_wide, sizeof(unknown_wide), &target) == 0, "a wide unknown tag was rejected");
+
+    const uint8_t truncated_length[] = {SETTINGS_TLV_VERSION, 4, 2, 0xC2, 0x01, 5};
+    expect_rejected(truncated_length, sizeof(truncated_length), "a tag without its length was accepted");
+    const uint8_t truncated_value[] = {SETTINGS_TLV_VERSION, 4, 2, 0xC2};
+    expect_rejected(truncated_value, sizeof(truncated_value), "a value cut short was accepted");
+    const uint8_t oversized[] = {SETTINGS_TLV_VERSION, 4, 5, 0xC2, 0x01, 0, 0, 0};
+    expect_rejected(oversized, sizeof(oversized), "a known field wider than any setting was accepted");
+    const uint8_t too_large[] = {SETTINGS_TLV_VERSION, 4, 3, 0x00, 0x00, 0x01};
+    expect_rejected(too_large, sizeof(too_large), "a value that doesn't fit its field was accepted");
+    const uint8_t empty_value[] = {SETTINGS_TLV_VERSION, 4, 0};
+    expect_rejected(empty_value, sizeof(empty_value), "a known field without a value was accepted");
+    const uint8_t version[] = {SETTINGS_TLV_VERSION + 1, 4, 2, 0xC2, 0x01};
+    expect_rejected(version, sizeof(version), "another schema version was accepted");
+
+    if (failures) printf("%d failures\n", failures);
+    else printf("settings TLV: encoding, unknown tags, truncation and out of range values handled\n");
+    return failures ? 1 : 0;
+}
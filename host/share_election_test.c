@@ -0,0 +1,217 @@
+/* Leader election of group audio. Nodes run share_election the way group_link does: every
+ * SHARE_POLL_MS they hear the packets of the others, tick the election and, leading, send a
+ * heartbeat every SHARE_HEARTBEAT_US. Checked, each by the time a group must have settled:
+ * nodes started together agree on the lowest id, a joining node with a lower id doesn't take
+ * over, a silent leader is replaced by one node, follow only nodes never lead, and with lost
+ * packets the group still has one leader nearly all the time. Exits 1 if a check fails */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_share.h"
+
+#define NODES              (4)
+#define STEP_US            (SHARE_POLL_MS * 1000)
+/* a silent leader is noticed after the timeout, then rival claims are settled by one heartbeat */
+#define SETTLE_US          (SHARE_LEADER_TIMEOUT_US + 2 * SHARE_HEARTBEAT_US + 2 * STEP_US)
+#define LOSSY_RUN_US       (600LL * 1000000)
+#define LOSS               (0.2)
+#define LOSSY_AGREED_MIN   (0.99)
+
+typedef struct node {
+    uint32_t id;
+    uint8_t role;
+    int64_t join_us;        /* when it starts, it's absent before */
+    int64_t leave_us;       /* when it goes silent, 0 never */
+    share_election election;
+    uint32_t leader;        /* last tick's answer */
+    int64_t sent_us;
+    int heard[NODES];       /* heartbeats of the others waiting for the next poll */
+} node;
+
+static int failures;
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static double uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (rng_state >> 11) / 9007199254740992.0;
+}
+
+static void expect(int ok, const char *scenario, const char *what)
+{
+    if (ok) return;
+    failures++;
+    fprintf(stderr, "%s: %s\n", scenario, what);
+}
+
+static int present(const node *n, int64_t now_us)
+{
+    return now_us >= n->join_us && (!n->leave_us || now_us < n->leave_us);
+}
+
+/**
+ * @brief One poll of every present node, heartbeats reach the others at their next poll unless lost
+ */
+static void step(node *nodes, int count, int64_t now_us, double loss)
+{
+    for (int i = 0; i < count; i++) {
+        node *n = &nodes[i];
+        if (!present(n, now_us)) continue;
+        if (now_us == n->join_us) {
+            share_election_start(&n->election, n->id, now_us);
+            n->sent_us = 0;
+        }
+        for (int j = 0; j < count; j++) {
+            if (n->heard[j]) share_election_heard(&n->election, nodes[j].id, now_us);
+            n->heard[j] = 0;
+        }
+        n->leader = share_election_tick(&n->election, n->role, now_us);
+    }
+    for (int i = 0; i < count; i++) {
+        node *n = &nodes[i];
+        if (!present(n, now_us) || n->leader != n->id || now_us - n->sent_us < SHARE_HEARTBEAT_US) continue;
+        n->sent_us = now_us;
+        for (int j = 0; j < count; j++) {
+            if (j != i && present(&nodes[j], now_us) && uniform() >= loss) nodes[j].heard[i] = 1;
+        }
+    }
+}
+
+/**
+ * @brief The leader every present node follows, 0 if they disagree or one leads besides it.
+ * A node that just joined knows no leader until the next heartbeat, it's left out until then
+ */
+static uint32_t agreed_leader(const node *nodes, int count, int64_t now_us)
+{
+    uint32_t leader = 0;
+    int first = 1;
+    for (int i = 0; i < count; i++) {
+        if (!present(&nodes[i], now_us) || now_us - nodes[i].join_us <= SHARE_HEARTBEAT_US + STEP_US) continue;
+        if (!first && nodes[i].leader != leader) return 0;
+        leader = nodes[i].leader;
+        first = 0;
+    }
+    return leader;
+}
+
+static void set_node(node *n, uint32_t id, uint8_t role, int64_t join_us, int64_t leave_us)
+{
+    memset(n, 0, sizeof(*n));
+    n->id = id;
+    n->role = role;
+    n->join_us = join_us;
+    n->leave_us = leave_us;
+}
+
+/**
+ * @brief Runs until end_us, returns the agreed leader at the end
+ */
+static uint32_t run(node *nodes, int count, int64_t from_us, int64_t end_us)
+{
+    for (int64_t t = from_us; t < end_us; t += STEP_US) step(nodes, count, t, 0);
+    return agreed_leader(nodes, count, end_us - STEP_US);
+}
+
+static void test_started_together(void)
+{
+    node nodes[3];
+    set_node(&nodes[0], 30, SHARE_AUTO, 0, 0);
+    set_node(&nodes[1], 10, SHARE_AUTO, 0, 0);
+    set_node(&nodes[2], 20, SHARE_AUTO, 0, 0);
+    uint32_t leader = run(nodes, 3, 0, SETTLE_US);
+    expect(leader == 10, "started together", "nodes don't agree on the lowest id");
+    /* and it holds */
+    uint32_t held = leader;
+    for (int64_t t = SETTLE_US; t < 10 * SETTLE_US; t += STEP_US) {
+        step(nodes, 3, t, 0);
+        if (agreed_leader(nodes, 3, t) != leader) held = 0;
+    }
+    expect(held == 10, "started together", "leader changed without a loss");
+    printf("started together: all follow %u after %.2f s\n", leader, SETTLE_US / 1e6);
+}
+
+static void test_lower_joins(void)
+{
+    node nodes[3];
+    set_node(&nodes[0], 20, SHARE_AUTO, 0, 0);
+    set_node(&nodes[1], 30, SHARE_AUTO, 0, 0);
+    set_node(&nodes[2], 5, SHARE_AUTO, 2 * SETTLE_US, 0);
+    int kept = 1;
+    for (int64_t t = 0; t < 6 * SETTLE_US; t += STEP_US) {
+        step(nodes, 3, t, 0);
+        if (t >= SETTLE_US && agreed_leader(nodes, 3, t) != 20) kept = 0;
+    }
+    expect(kept, "lower id joins", "the joining node took over or the group split");
+    printf("lower id joins: %u kept the lead, %u follows\n", nodes[0].leader, nodes[2].id);
+}
+
+static void test_leader_leaves(void)
+{
+    node nodes[3];
+    set_node(&nodes[0], 10, SHARE_AUTO, 0, 2 * SETTLE_US);
+    set_node(&nodes[1], 30, SHARE_AUTO, 0, 0);
+    set_node(&nodes[2], 20, SHARE_AUTO, 0, 0);
+    run(nodes, 3, 0, 2 * SETTLE_US);
+    int64_t replaced_us = -1;
+    for (int64_t t = 2 * SETTLE_US; t < 6 * SETTLE_US; t += STEP_US) {
+        step(nodes, 3, t, 0);
+        uint32_t leader = agreed_leader(nodes, 3, t);
+        if (leader && leader != 10 && replaced_us < 0) replaced_us = t - 2 * SETTLE_US;
+        if (!leader || leader == 10) replaced_us = -1;
+    }
+    expect(replaced_us >= 0 && replaced_us <= SETTLE_US, "leader leaves", "not replaced by one node in time");
+    expect(agreed_leader(nodes, 3, 6 * SETTLE_US - STEP_US) == 20, "leader leaves", "not replaced by the lowest id");
+    printf("leader leaves: %u leads alone %.2f s later\n", nodes[2].leader, replaced_us / 1e6);
+}
+
+static void test_follow_only(void)
+{
+    node nodes[3];
+    set_node(&nodes[0], 10, SHARE_FOLLOW, 0, 0);
+    set_node(&nodes[1], 20, SHARE_FOLLOW, 0, 0);
+    set_node(&nodes[2], 30, SHARE_FOLLOW, 0, 0);
+    int led = 0;
+    for (int64_t t = 0; t < 4 * SETTLE_US; t += STEP_US) {
+        step(nodes, 3, t, 0);
+        for (int i = 0; i < 3; i++) led |= nodes[i].leader != 0;
+    }
+    expect(!led, "follow only", "a follow only node led");
+    nodes[2].role = SHARE_AUTO;
+    expect(run(nodes, 3, 4 * SETTLE_US, 6 * SETTLE_US) == 30, "follow only", "the only auto node doesn't lead");
+    printf("follow only: nobody leads until %u may\n", nodes[2].id);
+}
+
+static void test_lossy(void)
+{
+    node nodes[NODES];
+    for (int i = 0; i < NODES; i++) set_node(&nodes[i], 10 * (i + 1), SHARE_AUTO, 0, 0);
+    long agreed = 0, polls = 0, changes = 0;
+    uint32_t last = 0;
+    for (int64_t t = 0; t < LOSSY_RUN_US; t += STEP_US) {
+        step(nodes, NODES, t, LOSS);
+        if (t < SETTLE_US) continue;
+        uint32_t leader = agreed_leader(nodes, NODES, t);
+        agreed += leader != 0;
+        changes += leader != last;
+        last = leader;
+        polls++;
+    }
+    double share = (double)agreed / polls;
+    expect(share >= LOSSY_AGREED_MIN, "lossy", "the group disagreed too often");
+    printf("%.0f%% loss, %d nodes: one leader %.2f%% of %.0f s, %ld changes\n", LOSS * 100, NODES, share * 100,
+           LOSSY_RUN_US / 1e6, changes);
+}
+
+int main(void)
+{
+    test_started_together();
+    test_lower_joins();
+    test_leader_leaves();
+    test_follow_only();
+    test_lossy();
+    if (failures) printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
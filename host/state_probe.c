@@ -0,0 +1,239 @@
+/* Measures what /state saves the app: the round trips, bytes and time of one UI refresh
+ * as four GETs of /room, /rgb, /mode and /prefs, as one GET of /state, and as an ETag
+ * revalidation of /state. Talks plain CoAP over UDP with its own encoder, so the byte
+ * counts are the datagrams on the wire, without IP and UDP headers */
+#include <errno.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_PORT       "5683"
+#define DEFAULT_ROUNDS     (100)
+#define TOKEN_LEN          (4)
+#define MAX_PDU            (1152)
+#define RESPONSE_WAIT_MS   (2000)
+#define MAX_RETRANSMIT     (4)
+
+#define COAP_TYPE_CON      (0)
+#define COAP_TYPE_ACK      (2)
+#define COAP_GET           (0x01)
+#define COAP_CONTENT       (0x45)
+#define COAP_VALID         (0x43)
+#define OPTION_ETAG        (4)
+#define OPTION_URI_PATH    (11)
+#define PAYLOAD_MARKER     (0xFF)
+#define ETAG_MAX           (8)
+
+typedef struct exchange_cost {
+    unsigned round_trips;
+    size_t request_bytes;
+    size_t response_bytes;
+    int64_t elapsed_us;
+} exchange_cost;
+
+static int sock;
+static uint16_t next_mid;
+
+static int64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Appends an option after the one numbered previous, returns the new end or NULL if it doesn't fit
+ */
+static uint8_t *put_option(uint8_t *p, const uint8_t *end, unsigned *previous, unsigned number,
+                           const uint8_t *value, size_t len)
+{
+    unsigned delta = number - *previous;
+    /* deltas and lengths up to 268 are all /state needs */
+    if (delta > 268 || len > 268 || (size_t)(end - p) < 3 + len) return NULL;
+    uint8_t *head = p++;
+    *head = 0;
+    if (delta < 13) {
+        *head |= delta << 4;
+    } else {
+        *head |= 13 << 4;
+        *p++ = delta - 13;
+    }
+    if (len < 13) {
+        *head |= len;
+    } else {
+        *head |= 13;
+        *p++ = len - 13;
+    }
+    memcpy(p, value, len);
+    *previous = number;
+    return p + len;
+}
+
+/**
+ * @brief Encodes a confirmable GET of path, with etag if etag_len isn't 0. Returns the length, 0 if it doesn't fit
+ */
+static size_t encode_get(uint8_t *pdu, size_t size, uint16_t mid, const uint8_t *token,
+                         const char *path, const uint8_t *etag, size_t etag_len)
+{
+    const uint8_t *end = pdu + size;
+    uint8_t *p = pdu;
+    unsigned previous = 0;
+
+    *p++ = 1 << 6 | COAP_TYPE_CON << 4 | TOKEN_LEN;
+    *p++ = COAP_GET;
+    *p++ = mid >> 8;
+    *p++ = mid & 0xFF;
+    memcpy(p, token, TOKEN_LEN);
+    p += TOKEN_LEN;
+    if (etag_len) p = put_option(p, end, &previous, OPTION_ETAG, etag, etag_len);
+    if (p) p = put_option(p, end, &previous, OPTION_URI_PATH, (const uint8_t *)path, strlen(path));
+    return p ? (size_t)(p - pdu) : 0;
+}
+
+/**
+ * @brief Finds the ETag of a response, returns its length or 0 if there is none
+ */
+static size_t find_etag(const uint8_t *pdu, size_t len, uint8_t *etag)
+{
+    size_t pos = 4 + (pdu[0] & 0x0F);
+    unsigned number = 0;
+    while (pos < len && pdu[pos] != PAYLOAD_MARKER) {
+        unsigned delta = pdu[pos] >> 4, opt_len = pdu[pos] & 0x0F;
+        pos++;
+        if (delta == 13) delta = 13 + pdu[pos++];
+        else if (delta == 14) { delta = 269 + (pdu[pos] << 8 | pdu[pos + 1]); pos += 2; }
+        if (opt_len == 13) opt_len = 13 + pdu[pos++];
+        else if (opt_len == 14) { opt_len = 269 + (pdu[pos] << 8 | pdu[pos + 1]); pos += 2; }
+        if (pos + opt_len > len) return 0;
+        number += delta;
+        if (number == OPTION_ETAG && opt_len <= ETAG_MAX) {
+            memcpy(etag, pdu + pos, opt_len);
+            return opt_len;
+        }
+        pos += opt_len;
+    }
+    return 0;
+}
+
+/**
+ * @brief One confirmable GET and its piggybacked response, retransmitted like RFC 7252 does
+ * but with a fixed wait. Adds the datagrams to cost, returns the response code or -1
+ */
+static int get(const char *path, const uint8_t *etag, size_t etag_len, uint8_t *response, size_t *response_len,
+               exchange_cost *cost)
+{
+    uint8_t request[MAX_PDU];
+    uint8_t token[TOKEN_LEN];
+    uint16_t mid = next_mid++;
+    for (int i = 0; i < TOKEN_LEN; i++) token[i] = rand();
+    size_t len = encode_get(request, sizeof(request), mid, token, path, etag, etag_len);
+    if (!len) return -1;
+
+    int64_t started = now_us();
+    for (int attempt = 0; attempt <= MAX_RETRANSMIT; attempt++) {
+        if (send(sock, request, len, 0) != (ssize_t)len) return -1;
+        cost->request_bytes += len;
+        for (;;) {
+            ssize_t got = recv(sock, response, MAX_PDU, 0);
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (got < 0) return -1;
+            /* late answers to earlier attempts are counted but otherwise ignored */
+            cost->response_bytes += got;
+            if (got < 4 + TOKEN_LEN || (response[0] >> 4 & 3) != COAP_TYPE_ACK
+                || (response[2] << 8 | response[3]) != mid || (response[0] & 0x0F) != TOKEN_LEN
+                || memcmp(response + 4, token, TOKEN_LEN) != 0) continue;
+            cost->round_trips++;
+            cost->elapsed_us += now_us() - started;
+            *response_len = got;
+            return response[1];
+        }
+    }
+    return -1;
+}
+
+static void print_cost(const char *name, const exchange_cost *cost, int rounds)
+{
+    printf("%-24s %5.2f round trips, %6.1f bytes out, %6.1f bytes in, %7.0f us\n", name,
+           (double)cost->round_trips / rounds, (double)cost->request_bytes / rounds,
+           (double)cost->response_bytes / rounds, (double)cost->elapsed_us / rounds);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n rounds] host [port]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *four_paths[] = {"room", "rgb", "mode", "prefs"};
+    int rounds = DEFAULT_ROUNDS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') rounds = atoi(optarg);
+        else usage(argv[0]);
+    }
+    if (optind >= argc || rounds < 1) usage(argv[0]);
+    const char *host = argv[optind];
+    const char *port = optind + 1 < argc ? argv[optind + 1] : DEFAULT_PORT;
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *res;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", host);
+        return 1;
+    }
+    sock = socket(res->ai_family, SOCK_DGRAM, 0);
+    struct timeval timeout = {.tv_sec = RESPONSE_WAIT_MS / 1000, .tv_usec = RESPONSE_WAIT_MS % 1000 * 1000};
+    if (sock < 0 || connect(sock, res->ai_addr, res->ai_addrlen) != 0
+        || setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        fprintf(stderr, "Cannot reach %s port %s\n", host, port);
+        return 1;
+    }
+    freeaddrinfo(res);
+    srand(now_us());
+    next_mid = rand();
+
+    exchange_cost four = {0}, state = {0}, revalidate = {0};
+    uint8_t response[MAX_PDU];
+    size_t response_len;
+    uint8_t etag[ETAG_MAX];
+    size_t etag_len = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < 4; i++) {
+            if (get(four_paths[i], NULL, 0, response, &response_len, &four) != COAP_CONTENT) {
+                fprintf(stderr, "GET /%s failed\n", four_paths[i]);
+                return 1;
+            }
+        }
+        if (get("state", NULL, 0, response, &response_len, &state) != COAP_CONTENT) {
+            fprintf(stderr, "GET /state failed\n");
+            return 1;
+        }
+        etag_len = find_etag(response, response_len, etag);
+        if (!etag_len) {
+            fprintf(stderr, "/state has no ETag\n");
+            return 1;
+        }
+        /* the state can change in between, then the server answers 2.05 with the new one */
+        int code = get("state", etag, etag_len, response, &response_len, &revalidate);
+        if (code != COAP_VALID && code != COAP_CONTENT) {
+            fprintf(stderr, "Revalidating /state failed\n");
+            return 1;
+        }
+    }
+
+    printf("%s port %s, %d rounds, per UI refresh:\n", host, port, rounds);
+    print_cost("GET room rgb mode prefs", &four, rounds);
+    print_cost("GET state", &state, rounds);
+    print_cost("GET state, ETag", &revalidate, rounds);
+    close(sock);
+    return 0;
+}
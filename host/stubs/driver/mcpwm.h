@@ -0,0 +1,2 @@
+/* Nothing of the MCPWM driver is used by the host build */
+#pragma once
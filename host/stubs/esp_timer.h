@@ -0,0 +1,6 @@
+/* ESP-IDF high resolution timer for the host build, on the monotonic clock */
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,38 @@
+/* FreeRTOS types for the host build. Critical sections of every portMUX share
+ * one recursive mutex, they only guard short copies */
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define BIT0  (1u << 0)
+#define BIT1  (1u << 1)
+#define BIT2  (1u << 2)
+#define BIT3  (1u << 3)
+#define BIT4  (1u << 4)
+#define BIT5  (1u << 5)
+#define BIT6  (1u << 6)
+#define BIT7  (1u << 7)
+#define BIT8  (1u << 8)
+#define BIT9  (1u << 9)
+#define BIT10 (1u << 10)
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)  vPortExitCritical(mux)
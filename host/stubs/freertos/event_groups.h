@@ -0,0 +1,12 @@
+/* FreeRTOS event groups for the host build, nothing waits on them */
+#pragma once
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef uint32_t EventBits_t;
+typedef struct event_group *EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
@@ -0,0 +1,6 @@
+/* FreeRTOS task calls for the host build, ticks are ms */
+#pragma once
+
+#include "FreeRTOS.h"
+
+void vTaskDelay(TickType_t ticks);
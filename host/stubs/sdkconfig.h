@@ -0,0 +1,6 @@
+/* Config of the host build, the menuconfig values coap_endpoints reads */
+#pragma once
+
+#define CONFIG_LEDS_MDNS_HOSTNAME "LEDSHOST"
+#define CONFIG_LEDS_MDNS_INSTANCE "ALGORYTHM"
+#define CONFIG_COAP_MCAST_GROUP "239.255.42.1"
@@ -0,0 +1,192 @@
+/* Clock sync error under network jitter. Two nodes with crystals off by +40 and -35 ppm
+ * exchange with a reference the way coap_server does: eight requests 100 ms apart, then one
+ * a second. One-way delays are 1.5 ms plus exponential jitter, 5% of legs are held up 20 to
+ * 80 ms by a retry. The reference stamps its answer after a 0.2 to 0.5 ms hold, and the
+ * response handler runs 0 to 0.3 ms after the packet arrives. Each node's synced time is
+ * sampled every 10 ms for an hour, after a minute to lock. Reported per jitter mean: the error
+ * between the nodes and against the reference, and the rates found against the true ones.
+ * Exits 1 if the error between the nodes or a rate misses its bound */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "time_sync.h"
+
+#define NODES              (2)
+#define RUN_US             (3600LL * 1000000)
+#define SETTLE_US          (60LL * 1000000)
+#define STEP_US            (1000)
+#define SAMPLE_US          (10000)
+#define SAMPLES            ((RUN_US - SETTLE_US) / SAMPLE_US)
+#define PENDING            (8)
+#define BASE_DELAY_US      (1500)
+#define SPIKE_CHANCE       (0.05)
+#define SPIKE_MIN_US       (20000)
+#define SPIKE_MAX_US       (80000)
+#define HOLD_MIN_US        (200)
+#define HOLD_MAX_US        (500)
+#define HANDLER_MAX_US     (300)
+#define RATE_BOUND_PPM     (2.0)
+
+typedef struct scenario {
+    double jitter_us;       /* mean of the exponential part of each leg */
+    double p99_bound_us;    /* node to node */
+} scenario;
+
+static const scenario scenarios[] = {
+    {500, 200},
+    {2000, 500},
+    {5000, 1000},
+};
+
+typedef struct exchange {
+    int64_t t1, t2;
+    double done_us;         /* true time the handler runs */
+} exchange;
+
+typedef struct node {
+    double ppm;
+    double boot_us;         /* local clock at true time 0 */
+    time_sync sync;
+    exchange pending[PENDING];
+    int pending_count;
+    int64_t sent_us;
+    int exchanges;
+} node;
+
+static uint64_t rng_state;
+
+static double uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double leg_us(double jitter_us)
+{
+    double us = BASE_DELAY_US - jitter_us * log(uniform());
+    if (uniform() < SPIKE_CHANCE) us += SPIKE_MIN_US + (SPIKE_MAX_US - SPIKE_MIN_US) * uniform();
+    return us;
+}
+
+static int64_t local_us(const node *n, double true_us)
+{
+    return llround(n->boot_us + true_us * (1 + n->ppm * 1e-6));
+}
+
+/* The reference clock is the true time, started well apart from the nodes' */
+static int64_t reference_us(double true_us)
+{
+    return llround(5e9 + true_us);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Mean, 99th percentile and largest of the absolute errors, sorts them
+ */
+static void summarize(double *errors, long count, double *mean, double *p99, double *max)
+{
+    double sum = 0;
+    for (long i = 0; i < count; i++) {
+        errors[i] = fabs(errors[i]);
+        sum += errors[i];
+    }
+    qsort(errors, count, sizeof(double), compare_doubles);
+    *mean = sum / count;
+    *p99 = errors[count * 99 / 100];
+    *max = errors[count - 1];
+}
+
+/**
+ * @brief One hour of exchanges at a jitter, returns 0 if it met its bounds
+ */
+static int run(const scenario *s)
+{
+    static double between[SAMPLES], against[SAMPLES * NODES];
+    node nodes[NODES] = {
+        {.ppm = 40, .boot_us = 3.2e6},
+        {.ppm = -35, .boot_us = 17.9e6},
+    };
+    long samples = 0, used = 0, sent = 0;
+    for (int i = 0; i < NODES; i++) {
+        time_sync_reset(&nodes[i].sync);
+        nodes[i].sent_us = INT64_MIN / 2;
+    }
+
+    for (int64_t t = 0; t < RUN_US; t += STEP_US) {
+        for (int i = 0; i < NODES; i++) {
+            node *n = &nodes[i];
+            /* answers whose handler ran by now, in the order they arrived */
+            for (;;) {
+                int first = -1;
+                for (int p = 0; p < n->pending_count; p++) {
+                    if (n->pending[p].done_us <= t && (first < 0 || n->pending[p].done_us < n->pending[first].done_us))
+                        first = p;
+                }
+                if (first < 0) break;
+                exchange *e = &n->pending[first];
+                used += time_sync_add(&n->sync, e->t1, e->t2, e->t2, local_us(n, e->done_us));
+                *e = n->pending[--n->pending_count];
+            }
+
+            int64_t now = local_us(n, t);
+            int period_ms = n->exchanges < TIME_SYNC_BURST ? TIME_SYNC_BURST_MS : TIME_SYNC_PERIOD_MS;
+            if (now - n->sent_us >= period_ms * 1000LL && n->pending_count < PENDING) {
+                n->sent_us = now;
+                n->exchanges++;
+                sent++;
+                double at_reference = t + leg_us(s->jitter_us) + HOLD_MIN_US + (HOLD_MAX_US - HOLD_MIN_US) * uniform();
+                exchange *e = &n->pending[n->pending_count++];
+                e->t1 = now;
+                e->t2 = reference_us(at_reference);
+                e->done_us = at_reference + leg_us(s->jitter_us) + HANDLER_MAX_US * uniform();
+            }
+        }
+
+        if (t >= SETTLE_US && t % SAMPLE_US == 0) {
+            double errors[NODES];
+            for (int i = 0; i < NODES; i++) {
+                errors[i] = (double)(time_sync_to_reference(&nodes[i].sync, local_us(&nodes[i], t)) - reference_us(t));
+                against[samples * NODES + i] = errors[i];
+            }
+            between[samples++] = errors[0] - errors[1];
+        }
+    }
+
+    double mean, p99, max, ref_mean, ref_p99, ref_max;
+    summarize(between, samples, &mean, &p99, &max);
+    summarize(against, samples * NODES, &ref_mean, &ref_p99, &ref_max);
+    printf("jitter mean %.1f ms: %ld of %ld exchanges used\n", s->jitter_us / 1000, used, sent);
+    printf("  node-node      mean %4.0f us, p99 %4.0f us, max %5.0f us, p99 bound %.0f us\n", mean, p99, max,
+           s->p99_bound_us);
+    printf("  node-reference mean %4.0f us, p99 %4.0f us, max %5.0f us\n", ref_mean, ref_p99, ref_max);
+
+    int ok = p99 <= s->p99_bound_us;
+    for (int i = 0; i < NODES; i++) {
+        /* the offset falls by ppm per local us, local us run 1 + ppm fast */
+        double expected = -nodes[i].ppm / (1 + nodes[i].ppm * 1e-6);
+        double found = nodes[i].sync.drift * 1e6;
+        printf("  node %d rate %+.2f ppm, found %+.2f ppm\n", i, -expected, -found);
+        ok &= fabs(found - expected) <= RATE_BOUND_PPM;
+    }
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        rng_state = 0x9e3779b97f4a7c15ULL + i;
+        failures += run(&scenarios[i]);
+    }
+    if (failures) printf("%d jitter levels missed their bounds\n", failures);
+    return failures ? 1 : 0;
+}
@@ -10,6 +10,8 @@
  */
 
 #include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -17,6 +19,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/queue.h"
 
 #include "nvs_flash.h"
 #include "nvs.h"
@@ -28,12 +31,14 @@
 #include "esp_event.h"
 #include "esp_types.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 
 #include "netdb.h"
 #include "mdns.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "lwip/inet.h"
 
 #include "driver/i2s.h"
 #include "driver/adc.h"
@@ -46,6 +51,26 @@
 
 #include "fft.h"
 
+#include "scene_vm.h"
+#include "frame_player.h"
+
+#include "spectral_hue.h"
+#include "chroma.h"
+#include "mfcc.h"
+#include "classifier.h"
+#include "beat_tracker.h"
+#include "hpss.h"
+#include "spectral_shape.h"
+#include "noise_floor.h"
+#include "band_balance.h"
+#include "multires.h"
+#include "change_detector.h"
+#include "intensity.h"
+#include "adc_linear.h"
+#include "fast_math.h"
+#include "audio_share.h"
+#include "time_sync.h"
+
 #define CORE_0 (BaseType_t)(0)
 #define CORE_1 (BaseType_t)(1)
 
@@ -53,6 +78,53 @@
 #define ESP_WIFI_PASS      CONFIG_ESP_WIFI_PASS
 #define ESP_MAXIMUM_RETRY  CONFIG_ESP_MAXIMUM_RETRY
 
+/* Renderer tick period, matches the 60 Hz LED PWM */
+#define RENDER_TICK_MS     (16)
+
+/* MFCC front end used by the timbre mode */
+#define MFCC_FILTERS       (16)
+#define MFCC_COEFFS        (8)
+#define MFCC_FREQ_LO       (100)
+#define MFCC_FREQ_HI       (8000)
+/* Palette steps per normalized deviation of the first cepstral coefficient */
+#define TIMBRE_PALETTE_GAIN (48)
+
+/* The mood classifier runs once per window, its feature extraction and
+   inference may use at most MOOD_BUDGET_US of CORE_0 per window */
+#define MOOD_WINDOW_US     (1000000)
+#define MOOD_BUDGET_US     (5000)
+/* Prints the features of every mood window, the training input of host/mood_train */
+#define DEBUG_MOOD_FEATURES (0)
+
+/* Beat pulse: intensity jumps to full on a beat and decays by this percentage
+   every renderer tick, down to the floor */
+#define BEAT_PULSE_DECAY   (12)
+#define BEAT_PULSE_FLOOR   (20)
+
+/* audio_multires reads in short hops so the high bands follow transients,
+   the decimated long transform for the low bands reruns every MULTIRES_LONG_HOP samples */
+#define MULTIRES_READ_LEN  (I2S_READ_LEN/4)
+
+/* Frames between logs of the skipped FFT count */
+#define CHANGE_LOG_FRAMES  (1024)
+
+/* 20 * log10(2), amplitude dB per octave of the table log2 */
+#define DB_PER_LOG2        (6.0206f)
+
+/* Longest wait in the CoAP loop, bounds the delay of features notifications */
+#define COAP_NOTIFY_MS     (100)
+
+/* Playback of a new frame batch starts on a multiple of this in reference time and at least
+ * PLAYBACK_LEAD_US away, so synced nodes that get the same upload start it together */
+#define PLAYBACK_ALIGN_US    (500000)
+#define PLAYBACK_LEAD_US     (100000)
+
+/* Group audio goes to this UDP port of the CoAP multicast group. Followers show frames
+ * SHARE_PLAYOUT_US after their capture, which covers the WiFi jitter */
+#define SHARE_PORT           (5690)
+#define SHARE_PLAYOUT_US     (70000)
+#define SHARE_TX_QUEUE       (4)
+
 /* The event group allows multiple bits for each event, but we only care about two events:
  * - we are connected to the AP with an IP
  * - we failed to connect after the maximum amount of retries */
@@ -83,6 +155,11 @@
 */
 #define COAP_LOG_DEFAULT_LEVEL CONFIG_COAP_LOG_DEFAULT_LEVEL
 
+#define COAP_MCAST_GROUP CONFIG_COAP_MCAST_GROUP
+#define COAP_TIME_SOURCE CONFIG_COAP_TIME_SOURCE
+#define COAP_SESSION_TIMEOUT CONFIG_COAP_SESSION_TIMEOUT
+#define COAP_MAX_IDLE_SESSIONS CONFIG_COAP_MAX_IDLE_SESSIONS
+
 const static char *TAG = "LED mDNS CoAP_server";
 
 #ifdef CONFIG_COAP_MBEDTLS_PKI
@@ -108,6 +185,37 @@ extern uint8_t server_key_end[]   asm("_binary_coap_server_key_end");
 static EventGroupHandle_t s_wifi_event_group;
 
 static int s_retry_num = 0;
+// station address in network order, the group id of the node
+static uint32_t s_ip_addr;
+
+/* Latest audio color and intensity, handed from the audio task to the renderer */
+static scene_operands audio_operands;
+
+// raw ADC code to linear code, built from the eFuse characterization at boot
+static uint16_t adc_lut[ADC_CODES];
+
+/* Beat prediction, handed from the audio task to the renderer */
+static int64_t beat_next_us;
+static int64_t beat_period_us;
+static portMUX_TYPE beat_mux = portMUX_INITIALIZER_UNLOCKED;
+// frame batches are played from a one shot esp_timer, so frames land on their time rather than on a renderer tick.
+// The renderer loads a batch into the player the timer doesn't use and swaps them under player_mux
+static frame_player players[2];
+static frame_player *player = &players[0];
+static esp_timer_handle_t player_timer;
+static portMUX_TYPE player_mux = portMUX_INITIALIZER_UNLOCKED;
+// client session to the time source, only used by the CoAP task
+static coap_session_t *time_session;
+/* Group state, only written by the group task. Frames wait in shared_frames until they're due,
+ * the leader's audio task hands frames to the group task through share_tx */
+enum group_state { GROUP_STANDALONE, GROUP_LEADING, GROUP_FOLLOWING };
+static volatile uint8_t group_state = GROUP_STANDALONE;
+static share_jitter shared_frames;
+static portMUX_TYPE share_mux = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t share_tx;
+// band levels of the last spectrum, sent along with the colors
+static uint8_t share_bands[SPECTRUM_BANDS];
+static uint8_t share_seq;
 
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
@@ -126,6 +234,7 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        s_ip_addr = event->ip_info.ip.addr;
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
@@ -204,6 +313,78 @@ void wifi_init_sta(void)
     vEventGroupDelete(s_wifi_event_group);
 }
  
+/**
+ * @brief Asks the time source for its time, the token carries the send time so responses need no bookkeeping
+ */
+static void send_time_request(coap_session_t *session)
+{
+    int64_t sent_us = esp_timer_get_time();
+    coap_pdu_t *pdu = coap_pdu_init(COAP_MESSAGE_NON, COAP_REQUEST_CODE_GET,
+                                    coap_new_message_id(session), coap_session_max_pdu_size(session));
+    if (!pdu) return;
+    coap_add_token(pdu, sizeof(sent_us), (const uint8_t *)&sent_us);
+    coap_add_option(pdu, COAP_OPTION_URI_PATH, strlen(ENDPOINT_STRING[timesync]),
+                    (const uint8_t *)ENDPOINT_STRING[timesync]);
+    if (coap_send(session, pdu) == COAP_INVALID_MID) ESP_LOGE(TAG, "Sending time request failed");
+}
+
+/**
+ * @brief Adds the exchange of a /timesync response to the clock estimate
+ */
+static coap_response_t time_response_handler(coap_session_t *session, const coap_pdu_t *sent,
+                                             const coap_pdu_t *received, const coap_mid_t mid)
+{
+    int64_t received_us = esp_timer_get_time();
+    coap_bin_const_t token = coap_pdu_get_token(received);
+    size_t size;
+    const uint8_t *data;
+
+    // late answers of a previous source are dropped with their session
+    if (session != time_session || token.length != sizeof(int64_t)
+            || coap_pdu_get_code(received) != COAP_RESPONSE_CODE_CONTENT
+            || !coap_get_data(received, &size, &data) || size != sizeof(int64_t)) {
+        return COAP_RESPONSE_OK;
+    }
+    int64_t sent_us;
+    memcpy(&sent_us, token.s, sizeof(sent_us));
+    uint64_t reference_us = 0;
+    for (int i = sizeof(int64_t) - 1; i >= 0; i--) reference_us = reference_us << 8 | data[i];
+
+    // the source stamps its answer once, so it counts as both receive and send time
+    portENTER_CRITICAL(&clock_mux);
+    int was_locked = node_clock.locked;
+    int used = time_sync_add(&node_clock, sent_us, reference_us, reference_us, received_us);
+    int32_t error_us = node_clock.last_error_us;
+    portEXIT_CRITICAL(&clock_mux);
+    if (used && !was_locked) ESP_LOGI(TAG, "Clock locked to time source");
+    ESP_LOGD(TAG, "Time exchange used:%d, error:%d us", used, error_us);
+    return COAP_RESPONSE_OK;
+}
+
+/**
+ * @brief Drops the clock estimate and opens a session to the new time source, if there is one
+ */
+static void change_time_source(coap_context_t *ctx, uint32_t source)
+{
+    if (time_session) {
+        coap_session_release(time_session);
+        time_session = NULL;
+    }
+    portENTER_CRITICAL(&clock_mux);
+    time_sync_reset(&node_clock);
+    portEXIT_CRITICAL(&clock_mux);
+    if (!source) return;
+
+    coap_address_t source_addr;
+    coap_address_init(&source_addr);
+    source_addr.addr.sin.sin_family      = AF_INET;
+    source_addr.addr.sin.sin_addr.s_addr = source;
+    source_addr.addr.sin.sin_port        = htons(COAP_DEFAULT_PORT);
+    source_addr.size = sizeof(source_addr.addr.sin);
+    time_session = coap_new_client_session(ctx, NULL, &source_addr, COAP_PROTO_UDP);
+    if (!time_session) ESP_LOGE(TAG, "coap_new_client_session() for the time source failed");
+}
+
 static void coap_server(void *p)
 {
     BaseType_t core = xPortGetCoreID();
@@ -211,6 +392,20 @@ static void coap_server(void *p)
     coap_context_t *ctx = NULL;
     coap_address_t serv_addr;
     coap_resource_t *resource = NULL;
+    coap_resource_t *features_resource = NULL;
+    coap_resource_t *state_resource = NULL;
+    coap_resource_t *spectrum_resource = NULL;
+    int64_t spectrum_sent_us = 0;
+    uint32_t notified_shape_version = 0;
+    uint32_t notified_state_version = 0;
+    uint32_t time_source_used = 0;
+    uint32_t time_source_version;
+    int64_t time_sent_us = 0;
+    unsigned time_exchanges = 0;
+
+    if (strlen(COAP_TIME_SOURCE)) {
+        time_source_set(TIME_SOURCE_USER, inet_addr(COAP_TIME_SOURCE));
+    }
 
     coap_set_log_level(COAP_LOG_DEFAULT_LEVEL);
 
@@ -229,6 +424,16 @@ static void coap_server(void *p)
             ESP_LOGE(TAG, "coap_new_context() failed");
             continue;
         }
+        /* Let libcoap reassemble block-wise uploads (e.g. scenes) into a single body */
+        coap_context_set_block_mode(ctx, COAP_BLOCK_USE_LIBCOAP | COAP_BLOCK_SINGLE_BODY);
+        /* Phones sleep between requests, an idle DTLS session is kept a while so they carry on
+           without a new handshake. One whose address changed meanwhile does a full handshake,
+           libcoap's mbedTLS server has neither session resumption nor Connection IDs */
+        coap_context_set_session_timeout(ctx, COAP_SESSION_TIMEOUT);
+        coap_context_set_max_idle_sessions(ctx, COAP_MAX_IDLE_SESSIONS);
+#if defined(CONFIG_COAP_MBEDTLS_PSK) || defined(CONFIG_COAP_MBEDTLS_PKI)
+        coap_register_event_handler(ctx, dtls_event_handler);
+#endif /* CONFIG_COAP_MBEDTLS_PSK CONFIG_COAP_MBEDTLS_PKI */
 #ifdef CONFIG_COAP_MBEDTLS_PSK
         /* Need PSK setup before we set up endpoints */
         coap_context_set_psk(ctx, "CoAP",
@@ -322,7 +527,13 @@ static void coap_server(void *p)
             ESP_LOGI(TAG, "Setting up CoAP endpoint:%s, length: %d",
                     endpoint_string->s, endpoint_string->length);
             
-            resource = coap_resource_init(endpoint_string, 0);
+            /* Group requests may set the color, mode and settings of every node in a room at once,
+               nodes don't answer successful ones so the sender isn't flooded */
+            int flags = 0;
+            if (x == rgb || x == mode || x == prefs) {
+                flags = COAP_RESOURCE_FLAGS_HAS_MCAST_SUPPORT | COAP_RESOURCE_FLAGS_LIB_ENA_MCAST_SUPPRESS_2_XX;
+            }
+            resource = coap_resource_init(endpoint_string, flags);
             if (!resource) {
                 ESP_LOGE(TAG, "coap_resource_init() failed");
                 goto clean_up;
@@ -333,18 +544,42 @@ static void coap_server(void *p)
             coap_register_handler(resource, COAP_REQUEST_GET, handlers->get_handlers[x]);
             coap_register_handler(resource, COAP_REQUEST_PUT, handlers->put_handlers[x]);
             coap_register_handler(resource, COAP_REQUEST_DELETE, handlers->del_handlers[x]);
+            coap_register_handler(resource, COAP_REQUEST_PATCH, handlers->patch_handlers[x]);
+            coap_register_handler(resource, COAP_REQUEST_IPATCH, handlers->patch_handlers[x]);
             /* We possibly want to Observe the GETs */
             coap_resource_set_get_observable(resource, 1);
             coap_add_resource(ctx, resource);
+            if (x == features) features_resource = resource;
+            if (x == state) state_resource = resource;
+            if (x == spectrum) {
+                /* live data, a lost notification is superseded by the next one */
+                coap_resource_set_mode(resource, COAP_RESOURCE_FLAGS_NOTIFY_NON);
+                spectrum_resource = resource;
+            }
 
             ESP_LOGI(TAG, "CoAP resource added:%s, length: %d",
                     room_name, strlen(room_name));
             
         }
 
+        if (strlen(COAP_MCAST_GROUP)) {
+            if (coap_join_mcast_group_intf(ctx, COAP_MCAST_GROUP, NULL) == 0) {
+                ESP_LOGI(TAG, "Joined CoAP multicast group %s", COAP_MCAST_GROUP);
+            } else {
+                /* not critical, unicast requests still work */
+                ESP_LOGE(TAG, "Joining CoAP multicast group %s failed", COAP_MCAST_GROUP);
+            }
+        }
+
+        coap_register_response_handler(ctx, time_response_handler);
+        // a new context has no session to the source, open one
+        time_source_get(&time_source_version);
+        time_source_used = time_source_version - 1;
+
         wait_ms = COAP_RESOURCE_CHECK_TIME * 1000;
         while (1) {
-            int result = coap_io_process(ctx, wait_ms);
+            unsigned notify_ms = spectrum_interval_ms < COAP_NOTIFY_MS ? spectrum_interval_ms : COAP_NOTIFY_MS;
+            int result = coap_io_process(ctx, wait_ms < notify_ms ? wait_ms : notify_ms);
             if (result < 0) {
                 break;
             } else if (result && (unsigned)result < wait_ms) {
@@ -355,9 +590,39 @@ static void coap_server(void *p)
                 /* result must have been >= wait_ms, so reset wait_ms */
                 wait_ms = COAP_RESOURCE_CHECK_TIME * 1000;
             }
+            /* Observers are notified from this task only, libcoap isn't thread safe */
+            if (notified_shape_version != shape_version) {
+                notified_shape_version = shape_version;
+                coap_resource_notify_observers(features_resource, NULL);
+            }
+            if (notified_state_version != state_version) {
+                notified_state_version = state_version;
+                coap_resource_notify_observers(state_resource, NULL);
+            }
+            int64_t now_us = esp_timer_get_time();
+            if (now_us - spectrum_sent_us >= spectrum_interval_ms * 1000LL && spectrum_advance()) {
+                spectrum_sent_us = now_us;
+                coap_resource_notify_observers(spectrum_resource, NULL);
+            }
+            uint32_t time_source = time_source_get(&time_source_version);
+            if (time_source_used != time_source_version) {
+                time_source_used = time_source_version;
+                change_time_source(ctx, time_source);
+                time_exchanges = 0;
+            }
+            unsigned time_period_ms = time_exchanges < TIME_SYNC_BURST ? TIME_SYNC_BURST_MS : TIME_SYNC_PERIOD_MS;
+            if (time_session && now_us - time_sent_us >= time_period_ms * 1000LL) {
+                time_sent_us = now_us;
+                time_exchanges++;
+                send_time_request(time_session);
+            }
         }
     }
 clean_up:
+    if (time_session) {
+        coap_session_release(time_session);
+        time_session = NULL;
+    }
     coap_free_context(ctx);
     coap_cleanup();
 
@@ -373,6 +638,12 @@ void nvs_storage_daemon(void *arg)
     ESP_LOGI(TAG, "running nvs on core %d",core);
     EventGroupHandle_t endpoint_events = get_endpoints_event_group();
     color_data color_storage;
+    static uint8_t scene_storage[SCENE_MAX_LEN];
+    size_t scene_storage_len;
+    static uint8_t palette_storage[HUE_STOPS_MAX * 3];
+    size_t palette_storage_len;
+    // what gets saved is a copy of the published config, the writer side copies may be mid update
+    static config_snapshot saved;
     esp_err_t err;
 
     nvs_handle_t handle;
@@ -456,8 +727,120 @@ void nvs_storage_daemon(void *arg)
             default :
                 ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
         }
+
+        /* Read Scene */
+        required_size = sizeof(scene_data);
+        err = nvs_get_blob(handle, "scene", scene_data, &required_size);
+        switch (err) {
+            case ESP_OK:
+                ESP_LOGI(TAG, "Read scene successfuly, bytes: %d\n", required_size);
+                portENTER_CRITICAL(&scene_mux);
+                scene_len = required_size;
+                scene_version++;
+                portEXIT_CRITICAL(&scene_mux);
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP_LOGI(TAG, "No scene stored yet!\n");
+                break;
+            default :
+                ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
+        }
+
+        /* Read Hue Palette */
+        required_size = sizeof(palette_stops);
+        err = nvs_get_blob(handle, "pal", palette_stops, &required_size);
+        switch (err) {
+            case ESP_OK:
+                ESP_LOGI(TAG, "Read palette successfuly, bytes: %d\n", required_size);
+                portENTER_CRITICAL(&palette_mux);
+                palette_len = required_size;
+                palette_version++;
+                portEXIT_CRITICAL(&palette_mux);
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP_LOGI(TAG, "No palette stored yet, using the default one!\n");
+                break;
+            default :
+                ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
+        }
+
+        /* Read Shape Drivers */
+        uint8_t drivers[sizeof(shape_drivers)];
+        required_size = sizeof(drivers);
+        err = nvs_get_blob(handle, "shape", drivers, &required_size);
+        switch (err) {
+            case ESP_OK:
+                if (required_size == sizeof(drivers) && drivers[SHAPE_DRIVER_HUE] < shape_features_size
+                    && drivers[SHAPE_DRIVER_INTENSITY] <= SHAPE_DRIVER_AMPLITUDE) {
+                    ESP_LOGI(TAG, "Read shape drivers successfuly\n");
+                    memcpy(shape_drivers, drivers, sizeof(drivers));
+                } else {
+                    ESP_LOGE(TAG, "Invalid shape drivers stored, using defaults");
+                }
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP_LOGI(TAG, "No shape drivers stored yet!\n");
+                break;
+            default :
+                ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
+        }
+
+        /* Read Band Balance */
+        err = nvs_get_u8(handle, "bal", &band_balance_on);
+        switch (err) {
+            case ESP_OK:
+                ESP_LOGI(TAG, "Read band balance successfuly: %d\n", band_balance_on);
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP_LOGI(TAG, "Band balance not set yet, it's off!\n");
+                break;
+            default :
+                ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
+        }
+
+        /* Read dB Scale */
+        db_scale_storage db_stored;
+        required_size = sizeof(db_stored);
+        err = nvs_get_blob(handle, "db", &db_stored, &required_size);
+        switch (err) {
+            case ESP_OK:
+                if (required_size == sizeof(db_stored) && db_stored.floor_db > db_stored.ceil_db
+                    && db_stored.color_span_db) {
+                    ESP_LOGI(TAG, "Read dB scale successfuly: %d\n", db_stored.on);
+                    db_scale = db_stored;
+                } else {
+                    ESP_LOGE(TAG, "Invalid dB scale stored, using defaults");
+                }
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP_LOGI(TAG, "No dB scale stored yet, it's off!\n");
+                break;
+            default :
+                ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
+        }
+
+        /* Read Group Role */
+        uint8_t role_stored;
+        err = nvs_get_u8(handle, "group", &role_stored);
+        switch (err) {
+            case ESP_OK:
+                if (role_stored <= SHARE_FOLLOW) {
+                    ESP_LOGI(TAG, "Read group role successfuly: %d\n", role_stored);
+                    group_role = role_stored;
+                } else {
+                    ESP_LOGE(TAG, "Invalid group role stored, the node runs on its own");
+                }
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP_LOGI(TAG, "Group role not set yet, the node runs on its own!\n");
+                break;
+            default :
+                ESP_LOGI(TAG, "Error (%s) reading!\n", esp_err_to_name(err));
+        }
     }
     nvs_close(handle);
+    // First snapshot for the audio task, with the color, mode and settings read above
+    config_set_settings(&settings.settings_st);
 
     // Task loop
     for(;;) {
@@ -468,14 +851,15 @@ void nvs_storage_daemon(void *arg)
         if (err != ESP_OK) {
             ESP_LOGI(TAG, "Error (%s) opening NVS handle!\n", esp_err_to_name(err));
         } else {
+            config_copy(&saved);
             // Check updates
             if (xbit & E_RGB_BIT) {
-                color_storage.color.r = rgb_data[COLOR_R_IDX];
-                color_storage.color.g = rgb_data[COLOR_G_IDX];
-                color_storage.color.b = rgb_data[COLOR_B_IDX];
+                color_storage.color.r = saved.rgb[COLOR_R_IDX];
+                color_storage.color.g = saved.rgb[COLOR_G_IDX];
+                color_storage.color.b = saved.rgb[COLOR_B_IDX];
             }
             if (xbit & E_MODE_BIT) {
-                color_storage.color.mode = ctrl_mode;
+                color_storage.color.mode = saved.mode;
             }
             if (xbit & (E_RGB_BIT | E_MODE_BIT)) {
                 // Write
@@ -491,10 +875,10 @@ void nvs_storage_daemon(void *arg)
             }
 
             if (xbit & E_PREF_BIT) {
-                const uint8_t *settingsData = settings.settings_data;
-                size_t len = sizeof(settings.settings_data);
+                const uint8_t *settingsData = (const uint8_t *)&saved.settings;
+                size_t len = sizeof(saved.settings);
                 ESP_LOGI(TAG, "Updating settings in NVS ... bytes: %d",len);
-                err = nvs_set_blob(handle, "setts", &settingsData, len);
+                err = nvs_set_blob(handle, "setts", settingsData, len);
                 if (err != ESP_OK) {
                     ESP_LOGI(TAG, "Failed with err %x\n", err);
                 } else {
@@ -502,6 +886,60 @@ void nvs_storage_daemon(void *arg)
                 }
             }
 
+            if (xbit & E_SCENE_BIT) {
+                portENTER_CRITICAL(&scene_mux);
+                scene_storage_len = scene_len;
+                memcpy(scene_storage, scene_data, scene_len);
+                portEXIT_CRITICAL(&scene_mux);
+                ESP_LOGI(TAG, "Updating scene in NVS ... bytes: %d", scene_storage_len);
+                if (scene_storage_len) {
+                    err = nvs_set_blob(handle, "scene", scene_storage, scene_storage_len);
+                } else {
+                    err = nvs_erase_key(handle, "scene");
+                    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+                }
+                ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
+            }
+
+            if (xbit & E_PALETTE_BIT) {
+                portENTER_CRITICAL(&palette_mux);
+                palette_storage_len = palette_len;
+                memcpy(palette_storage, palette_stops, palette_len);
+                portEXIT_CRITICAL(&palette_mux);
+                ESP_LOGI(TAG, "Updating palette in NVS ... bytes: %d", palette_storage_len);
+                if (palette_storage_len) {
+                    err = nvs_set_blob(handle, "pal", palette_storage, palette_storage_len);
+                } else {
+                    err = nvs_erase_key(handle, "pal");
+                    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+                }
+                ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
+            }
+
+            if (xbit & E_SHAPE_BIT) {
+                ESP_LOGI(TAG, "Updating shape drivers in NVS ... ");
+                err = nvs_set_blob(handle, "shape", saved.shape_drivers, sizeof(saved.shape_drivers));
+                ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
+            }
+
+            if (xbit & E_BALANCE_BIT) {
+                ESP_LOGI(TAG, "Updating band balance in NVS ... ");
+                err = nvs_set_u8(handle, "bal", saved.band_balance_on);
+                ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
+            }
+
+            if (xbit & E_DB_BIT) {
+                ESP_LOGI(TAG, "Updating dB scale in NVS ... ");
+                err = nvs_set_blob(handle, "db", &saved.db_scale, sizeof(saved.db_scale));
+                ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
+            }
+
+            if (xbit & E_GROUP_BIT) {
+                ESP_LOGI(TAG, "Updating group role in NVS ... ");
+                err = nvs_set_u8(handle, "group", group_role);
+                ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
+            }
+
             ESP_LOGI(TAG, "Committing updates in NVS ... ");
             err = nvs_commit(handle);
             ESP_LOGI(TAG, "%s", ((err != ESP_OK) ? "Failed!\n" : "Done\n"));
@@ -510,6 +948,174 @@ void nvs_storage_daemon(void *arg)
     }
 }
 
+/**
+ * @brief Tabulates the calibrated linear code of every raw ADC code
+ */
+static void build_adc_lut(void)
+{
+    esp_adc_cal_characteristics_t adc_chars;
+    esp_adc_cal_value_t source = esp_adc_cal_characterize(I2S_ADC_UNIT, I2S_ADC_ATTEN, ADC_WIDTH_BIT_12,
+        I2S_ADC_DEFAULT_VREF, &adc_chars);
+    ESP_LOGI(TAG, "ADC characterized from %s", source == ESP_ADC_CAL_VAL_EFUSE_TP ? "eFuse two point" :
+        source == ESP_ADC_CAL_VAL_EFUSE_VREF ? "eFuse Vref" : "default Vref");
+    for (int code = 0; code < ADC_CODES; code++) {
+        adc_lut[code] = esp_adc_cal_raw_to_voltage(code, &adc_chars);
+    }
+    adc_linear_normalize(adc_lut);
+}
+
+/**
+ * @brief Intensity of a frame whose peak-to-peak is range above amp_min, linear up to amp_max or between the dB scale limits
+ */
+static uint8_t amplitude_level(const config_snapshot *cfg, int32_t range)
+{
+    const settings_storage *limits = &cfg->settings;
+    if (range <= 0) return 0;
+    if (!cfg->db_scale.on) {
+        return range > limits->amp_max ? 100 : (100*range/limits->amp_max);
+    }
+    // dB below full scale, <= 0
+    float db = DB_PER_LOG2 * fast_log2f_lut((float)(range + limits->amp_min) / (ADC_CODES - 1));
+    float level = (db + cfg->db_scale.floor_db) / (cfg->db_scale.floor_db - cfg->db_scale.ceil_db);
+    return level <= 0 ? 0 : (level >= 1 ? 100 : (uint8_t)(100 * level));
+}
+
+/**
+ * @brief Colors from the band energies relative to the loudest band, as ratios or dB below it.
+ * colors keeps its last value when all bands are silent
+ */
+static void band_colors(const db_scale_storage *scale, FFT_PRECISION red, FFT_PRECISION green, FFT_PRECISION blue,
+                        uint8_t colors[3])
+{
+    FFT_PRECISION bands[3];
+    bands[COLOR_R_IDX] = red;
+    bands[COLOR_G_IDX] = green;
+    bands[COLOR_B_IDX] = blue;
+    FFT_PRECISION band_max = bands[0];
+    for (int c = 1; c < 3; c++) {
+        if (bands[c] > band_max) band_max = bands[c];
+    }
+    if (band_max <= 0) return;
+    float log_max = scale->on ? fast_log2f_lut(band_max) : 0;
+    for (int c = 0; c < 3; c++) {
+        if (!scale->on) {
+            colors[c] = (uint8_t)(255*bands[c]/band_max);
+        } else if (bands[c] <= 0) {
+            colors[c] = 0;
+        } else {
+            float level = 1 - DB_PER_LOG2 * (log_max - fast_log2f_lut(bands[c])) / scale->color_span_db;
+            colors[c] = level <= 0 ? 0 : (uint8_t)(255 * level);
+        }
+    }
+}
+
+/**
+ * @brief Shows an audio derived color, in light_show and audio_beat modes it's handed to the renderer instead
+ */
+static void audio_render(control_mode mode, uint8_t red, uint8_t green, uint8_t blue, uint8_t intensity)
+{
+    if (mode == light_show || mode == audio_beat) {
+        scene_operands ops = {.src = {red, green, blue, (uint8_t)(255*intensity/100)}};
+        audio_operands.all = ops.all;
+        return;
+    }
+    set_rgb(red, green, blue, intensity);
+}
+
+/**
+ * @brief Outputs the color of an audio frame. A group leader sends it to the followers and shows it
+ * together with them, from the jitter buffer
+ */
+static void audio_output(control_mode mode, uint8_t red, uint8_t green, uint8_t blue, uint8_t intensity)
+{
+    if (group_state != GROUP_LEADING) {
+        audio_render(mode, red, green, blue, intensity);
+        return;
+    }
+    share_frame frame = {
+        .capture_us = synced_time_us(),
+        .rgb = {red, green, blue},
+        .intensity = intensity,
+        .seq = share_seq++,
+    };
+    memcpy(frame.bands, share_bands, sizeof(frame.bands));
+    // the leader's clock is the group reference, so its beat prediction is in reference time already
+    portENTER_CRITICAL(&beat_mux);
+    int64_t beat_us = beat_next_us - frame.capture_us;
+    int64_t period_us = beat_period_us;
+    portEXIT_CRITICAL(&beat_mux);
+    if (period_us > 0 && period_us / 1000 <= UINT16_MAX && beat_us / 1000 >= INT16_MIN && beat_us / 1000 <= INT16_MAX) {
+        frame.beat_ms = beat_us / 1000;
+        frame.period_ms = period_us / 1000;
+    }
+    portENTER_CRITICAL(&share_mux);
+    share_jitter_push(&shared_frames, &frame);
+    portEXIT_CRITICAL(&share_mux);
+    // a full queue drops the frame, followers fill the gap with the previous one
+    xQueueSend(share_tx, &frame, 0);
+}
+
+/* Transforms and per mode analysis state of the spectral modes. The intensity only
+   mode doesn't need any of it, so it's released there and rebuilt when leaving */
+typedef struct spectral_state {
+    FFTTransformer * transformer;
+    FFT_PRECISION * fft_input;
+    FFT_PRECISION * magnitudes;
+    HueMap * hue_map;
+    ChromaPlan * chroma_plan;
+    Mfcc * mfcc;
+    BeatTracker * beat_tracker;
+    Hpss * hpss;
+    NoiseFloor * noise;
+    MultiRes * multires;
+} spectral_state;
+
+/**
+ * @brief Releases the spectral state, parts that failed to allocate are NULL
+ */
+static void free_spectral_state(spectral_state *spectral)
+{
+    if (spectral->transformer) free_fft_transformer(spectral->transformer);
+    if (spectral->hue_map) free_hue_map(spectral->hue_map);
+    if (spectral->chroma_plan) free_chroma_plan(spectral->chroma_plan);
+    if (spectral->mfcc) free_mfcc(spectral->mfcc);
+    if (spectral->beat_tracker) free_beat_tracker(spectral->beat_tracker);
+    if (spectral->hpss) free_hpss(spectral->hpss);
+    if (spectral->noise) free_noise_floor(spectral->noise);
+    if (spectral->multires) free_multires(spectral->multires);
+    free(spectral->fft_input);
+    free(spectral->magnitudes);
+    free(spectral);
+}
+
+/**
+ * @brief Allocates the spectral state, NULL if the heap is short
+ */
+static spectral_state *create_spectral_state(void)
+{
+    spectral_state *spectral = calloc(1, sizeof(spectral_state));
+    if (!spectral) return NULL;
+    spectral->transformer = create_fft_transformer((I2S_READ_LEN/2), FFT_SCALED_OUTPUT);
+    spectral->fft_input = (FFT_PRECISION *) malloc((I2S_READ_LEN/2)  * sizeof(FFT_PRECISION));
+    spectral->magnitudes = (FFT_PRECISION *) calloc(FFT_BINS, sizeof(FFT_PRECISION));
+    spectral->hue_map = create_hue_map(FFT_BINS, FFT_BIN_HZ);
+    // the band loop's bins can't resolve semitones, the chroma decimates the raw input for its own transform
+    spectral->chroma_plan = create_chroma_plan(FFT_BIN_HZ * (I2S_READ_LEN/2));
+    spectral->mfcc = create_mfcc(FFT_BINS, FFT_BIN_HZ, MFCC_FILTERS, MFCC_COEFFS, MFCC_FREQ_LO, MFCC_FREQ_HI);
+    spectral->beat_tracker = create_beat_tracker(FFT_BINS);
+    spectral->hpss = create_hpss(FFT_BINS);
+    spectral->noise = create_noise_floor(FFT_BINS);
+    // the bin spacing of the band loop, scaled to a sample rate in the same units as the band edges
+    spectral->multires = create_multires(FFT_BIN_HZ * (I2S_READ_LEN/2));
+    if (!spectral->transformer || !spectral->fft_input || !spectral->magnitudes || !spectral->hue_map
+        || !spectral->chroma_plan || !spectral->mfcc || !spectral->beat_tracker || !spectral->hpss
+        || !spectral->noise || !spectral->multires) {
+        free_spectral_state(spectral);
+        return NULL;
+    }
+    return spectral;
+}
+
 /**
  * @brief I2S ADC mic input
  */
@@ -529,14 +1135,19 @@ void i2s_adc_audio_processing(void*arg)
     // Install and start i2s driver
     i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
     // Init ADC pad
+    adc1_config_channel_atten(I2S_ADC_CHANNEL, I2S_ADC_ATTEN);
     i2s_set_adc_mode(I2S_ADC_UNIT, I2S_ADC_CHANNEL);
+    build_adc_lut();
 
     size_t bytes_read;
     int i2s_read_len = I2S_READ_LEN;
 
     char* i2s_read_buff = (char*) calloc(i2s_read_len, sizeof(char));
-    uint16_t* i2s_proc_buff;
+    // unpacked in place, linear and DC free
+    int16_t* i2s_proc_buff;
+    AdcFrame adc_frame = {0};
     i2s_adc_enable(I2S_NUM_0);
+    int adc_on = 1;
    
 #if DEBUG_MIC_INPUT
     FFT_PRECISION mag_max = 0;
@@ -544,111 +1155,357 @@ void i2s_adc_audio_processing(void*arg)
     int64_t time_processing;
 #endif
     short range = 0;
-    int c, location_max = 0, location_min = 0;
-    FFTTransformer * transformer = create_fft_transformer((I2S_READ_LEN/2), FFT_SCALED_OUTPUT);
-    FFT_PRECISION * fft_input = (FFT_PRECISION *) malloc((I2S_READ_LEN/2)  * sizeof(FFT_PRECISION));
+    spectral_state *spectral = NULL;
+    IntensityFeatures intensity = {0};
+    IntensityMap intensity_map = {0};
+    const config_snapshot *cfg = config_acquire();
+    // audio derived color, kept across frames so audio_hold can show the last one
+    uint8_t colors[3] = {0};
+    intensity_map_build(&intensity_map, cfg->settings.amp_min, cfg->settings.amp_max);
     FFT_PRECISION * rgb_magnitudes;
+    int hpss_hit = 0;
+    SpectralShape shape;
+    uint32_t noise_version = 0;
+    // the user's edges the balance estimate started from and the edges it last published
+    settings_storage user_edges = {0};
+    uint16_t balanced_b_end = 0, balanced_g_end = 0;
+    BandBalance balance;
+    int balancing = 0;
+    uint16_t multires_edges[4] = {0};
+    static float multires_hop[MULTIRES_READ_LEN/2];
+    FFT_PRECISION multires_out[3];
+    ChangeDetector change = {0};
+    FFT_PRECISION band_sums[3] = {0};
+    uint32_t hue_palette_version = 0;
+    int hue_mood = -1;  // mood whose palette is loaded, -1 for the user palette
+    int mood_candidate = -1;
+    MoodFeatures mood_features = {0};
+    int64_t mood_window_start = 0, mood_spent_us = 0;
+    uint16_t hue_freq_lo = 0, hue_freq_hi = 0;
+    static uint8_t hue_stops[HUE_STOPS_MAX * 3];
+    size_t hue_stops_len;
     // Task loop
     for (;;) {
-        if (ctrl_mode == manual || ctrl_mode == off) {
+        // one snapshot per frame, edits through the endpoints show up in the next one
+        cfg = config_acquire();
+        if (cfg->mode == manual || cfg->mode == off || cfg->mode == playback) {
             vTaskDelay(pdMS_TO_TICKS(1000));
 skip_it:    vTaskDelay(pdMS_TO_TICKS(10));
             continue;
         }
+        if (group_state == GROUP_FOLLOWING) {
+            // colors come from the leader, no capture and no analysis
+            if (adc_on) {
+                i2s_adc_disable(I2S_NUM_0);
+                adc_on = 0;
+            }
+            if (spectral) {
+                free_spectral_state(spectral);
+                spectral = NULL;
+            }
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        if (!adc_on) {
+            i2s_adc_enable(I2S_NUM_0);
+            adc_on = 1;
+        }
+        if (cfg->mode == audio_intensity) {
+            // integer only path, the spectral state is released while it runs
+            if (spectral) {
+                free_spectral_state(spectral);
+                spectral = NULL;
+                ESP_LOGI(TAG, "Spectral state released, free heap %u", esp_get_free_heap_size());
+            }
+            i2s_read(I2S_NUM_0, (void*) i2s_read_buff, I2S_READ_LEN, &bytes_read, portMAX_DELAY);
+            i2s_proc_buff = (int16_t*) i2s_read_buff;
+            adc_unpack(adc_lut, (uint16_t*) i2s_read_buff, i2s_proc_buff, bytes_read / 2, &adc_frame);
+            intensity_features(i2s_proc_buff, bytes_read / 2, &intensity);
+            memset(share_bands, 0, sizeof(share_bands));
+            if (intensity_map.amp_min != cfg->settings.amp_min || intensity_map.amp_max != cfg->settings.amp_max)
+                intensity_map_build(&intensity_map, cfg->settings.amp_min, cfg->settings.amp_max);
+            uint8_t level = intensity_map_level(&intensity_map, intensity.peak_to_peak);
+            if (level && cfg->db_scale.on) level = amplitude_level(cfg, intensity.peak_to_peak - cfg->settings.amp_min);
+#if DEBUG_MIC_INPUT
+            printf("Range: %d RMS: %d ZCR: %d\n====\n", intensity.peak_to_peak, intensity.rms, intensity.crossings);
+#endif
+            if (level == 0)
+                audio_output(cfg->mode, 0, 0, 0, 0);
+            else
+                audio_output(cfg->mode, cfg->rgb[COLOR_R_IDX], cfg->rgb[COLOR_G_IDX], cfg->rgb[COLOR_B_IDX], level);
+            goto skip_it;
+        }
+        if (!spectral) {
+            spectral = create_spectral_state();
+            if (!spectral) {
+                ESP_LOGE(TAG, "No heap for the spectral state");
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                continue;
+            }
+            // everything derived from the previous state starts over
+            multires_edges[0] = multires_edges[1] = multires_edges[2] = multires_edges[3] = 0;
+            hue_palette_version = 0;
+            hue_mood = mood_candidate = -1;
+            hue_freq_lo = hue_freq_hi = 0;
+            noise_version = noise_reset_version;
+            change = (ChangeDetector){0};
+        }
 #if DEBUG_MIC_INPUT
         time_processing = esp_timer_get_time();
 #endif
+        i2s_read_len = cfg->mode == audio_multires ? MULTIRES_READ_LEN : I2S_READ_LEN;
         i2s_read(I2S_NUM_0, (void*) i2s_read_buff, i2s_read_len, &bytes_read, portMAX_DELAY);
-        i2s_proc_buff = (uint16_t*) i2s_read_buff;
+        i2s_proc_buff = (int16_t*) i2s_read_buff;
+        adc_unpack(adc_lut, (uint16_t*) i2s_read_buff, i2s_proc_buff, bytes_read / 2, &adc_frame);
 
-        location_max = 0;
-        location_min = 0;
-        for (c = 1; c < (bytes_read / 2); c++) {
-            if (i2s_proc_buff[c] > i2s_proc_buff[location_max])
-                location_max = c;
-            if (i2s_proc_buff[c] < i2s_proc_buff[location_min])
-                location_min = c;
-        }
-
-        range = i2s_proc_buff[location_max] - i2s_proc_buff[location_min];
+        range = adc_frame.hi - adc_frame.lo;
         
-        range -= settings.settings_st.amp_min;
+        range -= cfg->settings.amp_min;
         if (range < 0) range = 0;
 
         // hold the last color at a set intensity when amplitude is below treshold
-        if (range == 0 && ctrl_mode == audio_hold) { 
-            set_rgb(rgb_data[COLOR_R_IDX], rgb_data[COLOR_G_IDX], rgb_data[COLOR_B_IDX], settings.settings_st.hold_mode_int);
+        if (range == 0 && cfg->mode == audio_hold) { 
+            audio_output(cfg->mode, colors[COLOR_R_IDX], colors[COLOR_G_IDX], colors[COLOR_B_IDX], cfg->settings.hold_mode_int);
             goto skip_it;
-        } else if (range == 0 && ctrl_mode != audio_freq) {
-            set_rgb(0, 0, 0, 0);
-            goto skip_it;
-        } else if (range > 0 && ctrl_mode == audio_intensity) {
-            set_rgb(rgb_data[COLOR_R_IDX], rgb_data[COLOR_G_IDX], rgb_data[COLOR_B_IDX], 
-                range > settings.settings_st.amp_max ? 100 : (100*range/settings.settings_st.amp_max));
+        } else if (range == 0 && cfg->mode != audio_freq) {
+            audio_output(cfg->mode, 0, 0, 0, 0);
             goto skip_it;
         }
 
         if ((range/16) == 0) goto skip_it;
 
 #if DEBUG_MIC_INPUT
-        printf("Max: buff[%04d] = %04d.\n", location_max+1, i2s_proc_buff[location_max]);
-        printf("Min: buff[%04d] = %04d.\n", location_min+1, i2s_proc_buff[location_min]);
-        if (i2s_proc_buff[location_min] == 0)
+        printf("Max: %04d Min: %04d Mean: %04d\n", adc_frame.hi, adc_frame.lo, adc_frame.mean);
+        if (adc_frame.lo == 0)
             ESP_LOGE(TAG, "Mic saturated");
         printf("Range: %d\n====\n", range);
 #endif
-        if (ctrl_mode == audio || ctrl_mode == audio_freq || ctrl_mode == audio_hold) {
+        if (cfg->mode == audio_multires) {
+            uint16_t edges[4] = {cfg->settings.freq_b_start, cfg->band_b_end,
+                                 cfg->band_g_end, cfg->settings.freq_r_end};
+            if (memcmp(edges, multires_edges, sizeof(edges)) != 0) {
+                memcpy(multires_edges, edges, sizeof(edges));
+                // blue and green from the long transform, red from the short one
+                multires_set_bands(spectral->multires, multires_edges, 3, multires_edges[2]);
+            }
+
+            int samples = bytes_read / 2;
+            for (int i = 0; i < samples; i++) multires_hop[i] = i2s_proc_buff[i] / 2048.0f;
+            multires_push(spectral->multires, multires_hop, samples);
+            multires_bands(spectral->multires, multires_out);
+
+            if (multires_out[0] > 0 || multires_out[1] > 0 || multires_out[2] > 0) {
+                band_colors(&cfg->db_scale, multires_out[2], multires_out[1], multires_out[0], colors);
+                audio_output(cfg->mode, colors[COLOR_R_IDX], colors[COLOR_G_IDX], colors[COLOR_B_IDX], amplitude_level(cfg, range));
+            }
+        } else if (cfg->mode == audio || cfg->mode == audio_freq || cfg->mode == audio_hold || cfg->mode == light_show
+            || cfg->mode == audio_hue || cfg->mode == audio_chroma || cfg->mode == audio_timbre
+            || cfg->mode == audio_mood || cfg->mode == audio_beat || cfg->mode == audio_hpss
+            || cfg->mode == audio_shape) {
             rgb_magnitudes = (FFT_PRECISION*)calloc(3, sizeof(FFT_PRECISION));
-            for(int i = 0; i < (I2S_READ_LEN/2); i += 1) {
-                fft_input[i] = (i2s_proc_buff[i] - range) / (range/16);
+            // Stationary frames (sustained pads) reuse the last spectrum, frame to frame trackers need every frame
+            int stationary = 0;
+            if (cfg->mode != audio_beat && cfg->mode != audio_hpss) {
+                stationary = change_detector_check(&change, i2s_proc_buff, I2S_READ_LEN/2, range);
+                if (change.frames % CHANGE_LOG_FRAMES == 0) {
+                    ESP_LOGI(TAG, "FFT skipped for %u of %u frames", change.skipped, change.frames);
+                }
             }
+            if (stationary) {
+                memcpy(rgb_magnitudes, band_sums, sizeof(band_sums));
+            } else {
+                for(int i = 0; i < (I2S_READ_LEN/2); i += 1) {
+                    spectral->fft_input[i] = i2s_proc_buff[i] / (FFT_PRECISION)(range/16);
+                }
 
-            // Transform signal
-            fft_forward(transformer, fft_input);
+                // Transform signal
+                fft_forward(spectral->transformer, spectral->fft_input);
 #if DEBUG_MIC_INPUT
-            ESP_LOGI(TAG,"Calculated FFT transform");
-            mag_max = 0;
-            mag_max_freq = 0;
+                ESP_LOGI(TAG,"Calculated FFT transform");
+                mag_max = 0;
+                mag_max_freq = 0;
 #endif
-            // Process output
-            for(int i = 0; i < (I2S_READ_LEN/2); i += 2) {
-                uint16_t freq = 16 * i / 2 * I2S_SAMPLE_RATE / I2S_READ_LEN;
-                FFT_PRECISION cos_comp = fft_input[i];
-                FFT_PRECISION sin_comp = fft_input[i+1];
-                FFT_PRECISION mag = sqrt((cos_comp * cos_comp) + (sin_comp * sin_comp));
-#if DEBUG_MIC_INPUT
-                if (mag > mag_max && freq > 0 && freq < (I2S_SAMPLE_RATE/2)) {
-                    mag_max = mag;
-                    mag_max_freq = freq;
+                // Process output
+                for(int i = 0; i < (I2S_READ_LEN/2); i += 2) {
+                    FFT_PRECISION cos_comp = spectral->fft_input[i];
+                    FFT_PRECISION sin_comp = spectral->fft_input[i+1];
+                    spectral->magnitudes[i/2] = sqrt((cos_comp * cos_comp) + (sin_comp * sin_comp));
+                }
+
+                // Steady noise (fans, HVAC) is tracked per bin and taken out before the bands are summed
+                if (noise_version != noise_reset_version) {
+                    noise_version = noise_reset_version;
+                    noise_floor_reset(spectral->noise);
+                }
+                spectral->noise -> frozen = cfg->noise_frozen;
+                noise_floor_apply(spectral->noise, spectral->magnitudes);
+
+                // edges edited through the endpoints restart the balance estimate
+                if (user_edges.freq_b_start != cfg->settings.freq_b_start
+                    || user_edges.freq_b_end != cfg->settings.freq_b_end
+                    || user_edges.freq_g_end != cfg->settings.freq_g_end
+                    || user_edges.freq_r_end != cfg->settings.freq_r_end) {
+                    user_edges = cfg->settings;
+                    balancing = 0;
+                }
+
+                // Auto balance tracks edge quantiles as fractional bins, an edge at bin e puts the bins below e + 0.5 in the band
+                if (cfg->band_balance_on && cfg->band_bin_hi - cfg->band_bin_lo >= 2) {
+                    if (!balancing) {
+                        balanced_b_end = cfg->band_b_end;
+                        balanced_g_end = cfg->band_g_end;
+                        band_balance_reset(&balance, balanced_b_end / FFT_BIN_HZ - 0.5f,
+                                           balanced_g_end / FFT_BIN_HZ - 0.5f);
+                        balancing = 1;
+                    }
+                    band_balance_add(&balance, spectral->magnitudes, cfg->band_bin_lo, cfg->band_bin_hi);
+                    float b_end = (balance.edge[0] + 0.5f) * FFT_BIN_HZ;
+                    float g_end = (balance.edge[1] + 0.5f) * FFT_BIN_HZ;
+                    // edges are only published once one has moved by more than a bin, the
+                    // writer rebuilds the table and the next frame's snapshot carries it.
+                    // They stay in the snapshot, the user's settings are never written here
+                    if (fabsf(b_end - balanced_b_end) > FFT_BIN_HZ
+                        || fabsf(g_end - balanced_g_end) > FFT_BIN_HZ) {
+                        balanced_b_end = (uint16_t)b_end;
+                        balanced_g_end = (uint16_t)g_end;
+                        config_set_balanced_edges(&user_edges, balanced_b_end, balanced_g_end);
+                        ESP_LOGI(TAG, "Band edges balanced to %d Hz, %d Hz", balanced_b_end, balanced_g_end);
+                    }
+                } else {
+                    balancing = 0;
                 }
+
+                for(int i = 0; i < (I2S_READ_LEN/2); i += 2) {
+                    FFT_PRECISION mag = spectral->magnitudes[i/2];
+#if DEBUG_MIC_INPUT
+                    uint16_t freq = 16 * i / 2 * I2S_SAMPLE_RATE / I2S_READ_LEN;
+                    if (mag > mag_max && freq > 0 && freq < (I2S_SAMPLE_RATE/2)) {
+                        mag_max = mag;
+                        mag_max_freq = freq;
+                    }
 #endif
-                if (settings.settings_st.freq_b_start < freq 
-                && freq < settings.settings_st.freq_b_end) {
-                    rgb_magnitudes[COLOR_B_IDX] += mag;
-                } else if (settings.settings_st.freq_b_end < freq 
-                && freq < settings.settings_st.freq_g_end) {
-                    rgb_magnitudes[COLOR_G_IDX] += mag;
-                } else if (settings.settings_st.freq_g_end < freq 
-                && freq < settings.settings_st.freq_r_end) {
-                    rgb_magnitudes[COLOR_R_IDX] += mag;
+                    uint8_t band = cfg->band_of_bin[i/2];
+                    if (band != BAND_NONE) {
+                        rgb_magnitudes[band] += mag;
+                    }
                 }
-            }
 
-            location_max = 0;
-            for (c = 1; c < 3; c++) {
-                if (rgb_magnitudes[c] > rgb_magnitudes[location_max])
-                    location_max = c;
+                // Shape features are cheap enough to keep the features resource live in every FFT mode
+                int shape_lo = cfg->settings.freq_b_start / FFT_BIN_HZ;
+                int shape_hi = cfg->settings.freq_r_end / FFT_BIN_HZ;
+                if (shape_lo < 1) shape_lo = 1;
+                if (shape_hi > FFT_BINS - 1) shape_hi = FFT_BINS - 1;
+                spectral_shape(spectral->magnitudes, shape_lo, shape_hi, FFT_BIN_HZ, &shape);
+                portENTER_CRITICAL(&shape_mux);
+                shape_features = shape;
+                shape_version++;
+                portEXIT_CRITICAL(&shape_mux);
+                memcpy(band_sums, rgb_magnitudes, sizeof(band_sums));
+
+                // the mailbox never blocks, the CoAP task picks up the newest frame when it notifies
+                SpectrumFrame *spectrum = spectrum_mailbox_back(&spectrum_mailbox);
+                spectrum_frame_quantize(spectrum, rgb_magnitudes, spectral->magnitudes);
+                memcpy(share_bands, spectrum->bands, sizeof(share_bands));
+                spectrum_mailbox_publish(&spectrum_mailbox);
             }
 
-            rgb_data[COLOR_R_IDX] = (uint8_t)(255*rgb_magnitudes[COLOR_R_IDX]/rgb_magnitudes[location_max]);
-            rgb_data[COLOR_G_IDX] = (uint8_t)(255*rgb_magnitudes[COLOR_G_IDX]/rgb_magnitudes[location_max]);
-            rgb_data[COLOR_B_IDX] = (uint8_t)(255*rgb_magnitudes[COLOR_B_IDX]/rgb_magnitudes[location_max]);
+            if (cfg->mode == audio_beat) {
+                beat_tracker_add(spectral->beat_tracker, spectral->magnitudes, esp_timer_get_time());
+                portENTER_CRITICAL(&beat_mux);
+                beat_next_us = spectral->beat_tracker->next_beat_us;
+                beat_period_us = spectral->beat_tracker->period_us;
+                portEXIT_CRITICAL(&beat_mux);
+            } else if (cfg->mode == audio_mood) {
+                // Features and inference have a fixed CPU budget per window, frames over budget are left out
+                int64_t started = esp_timer_get_time();
+                if (mood_spent_us < MOOD_BUDGET_US) {
+                    mfcc_forward(spectral->mfcc, spectral->magnitudes);
+                    mood_features_add(&mood_features, spectral->mfcc, rgb_magnitudes);
+                }
+                if (started - mood_window_start >= MOOD_WINDOW_US) {
+                    float features[CLASSIFIER_FEATURES];
+                    int8_t quantized[CLASSIFIER_FEATURES];
+                    int32_t scores[moods_size];
+                    int frames = mood_features_take(&mood_features, features);
+#if DEBUG_MOOD_FEATURES
+                    printf("mood features: ");
+                    for (int i = 0; i < CLASSIFIER_FEATURES; i++) printf(i ? ",%.4f" : "%.4f", features[i]);
+                    printf("\n");
+#endif
+                    if (frames) {
+                        classifier_quantize(&mood_model, features, quantized);
+                        int mood = classifier_forward(&mood_model, quantized, scores);
+                        // switch palettes only after two windows agree
+                        if (mood == mood_candidate && mood != hue_mood) {
+                            hue_map_set_palette(spectral->hue_map, mood_palettes[mood][0], sizeof(mood_palettes[mood]));
+                            hue_mood = mood;
+                        }
+                        mood_candidate = mood;
+                    }
+                    mood_spent_us += esp_timer_get_time() - started;
+                    ESP_LOGI(TAG, "mood: %d, %d frames, CPU %lld us of %d us budget",
+                             mood_candidate, frames, mood_spent_us, MOOD_BUDGET_US);
+                    mood_window_start = started;
+                    mood_spent_us = 0;
+                } else {
+                    mood_spent_us += esp_timer_get_time() - started;
+                }
+            } else if (cfg->mode == audio_hue || cfg->mode == audio_chroma || cfg->mode == audio_timbre
+                       || cfg->mode == audio_hpss || cfg->mode == audio_shape) {
+                // Palette and range changes are rare, the per frame work is table lookups only
+                if (hue_palette_version != cfg->palette_version || hue_mood != -1) {
+                    portENTER_CRITICAL(&palette_mux);
+                    hue_stops_len = palette_len;
+                    memcpy(hue_stops, palette_stops, palette_len);
+                    portEXIT_CRITICAL(&palette_mux);
+                    hue_palette_version = cfg->palette_version;
+                    if (hue_stops_len == 0 || hue_map_set_palette(spectral->hue_map, hue_stops, hue_stops_len) != 0)
+                        hue_map_default_palette(spectral->hue_map);
+                    hue_mood = mood_candidate = -1;
+                }
+            }
+            if (cfg->mode == audio_hpss) {
+                hpss_hit = hpss_forward(spectral->hpss, spectral->magnitudes);
+            }
+            if (cfg->mode == audio_hue || cfg->mode == audio_mood || cfg->mode == audio_hpss) {
+                if (hue_freq_lo != cfg->settings.freq_b_start
+                    || hue_freq_hi != cfg->settings.freq_r_end) {
+                    hue_freq_lo = cfg->settings.freq_b_start;
+                    hue_freq_hi = cfg->settings.freq_r_end;
+                    hue_map_set_range(spectral->hue_map, hue_freq_lo, hue_freq_hi);
+                }
+                // hue follows the sustained tones only, hits would make it jump around
+                hue_map_color(spectral->hue_map, spectral_peak(spectral->hue_map, cfg->mode == audio_hpss ? spectral->hpss -> harmonic : spectral->magnitudes),
+                              colors);
+            } else if (cfg->mode == audio_shape) {
+                float level = spectral_shape_level(&shape, cfg->shape_drivers[SHAPE_DRIVER_HUE],
+                    cfg->settings.freq_b_start, cfg->settings.freq_r_end);
+                memcpy(colors, spectral->hue_map->palette[(int)(level * (HUE_PALETTE_LEN - 1))], sizeof(colors));
+            } else if (cfg->mode == audio_chroma) {
+                // pitch classes take 12 evenly spaced palette colors, the chroma follows its own transform
+                int pitch_class = chroma_push(spectral->chroma_plan, i2s_proc_buff, bytes_read / 2);
+                memcpy(colors, spectral->hue_map->palette[pitch_class * HUE_PALETTE_LEN / CHROMA_BINS], sizeof(colors));
+            } else if (cfg->mode == audio_timbre) {
+                // brighter than usual timbre moves up the palette, duller moves down
+                mfcc_forward(spectral->mfcc, spectral->magnitudes);
+                int idx = HUE_PALETTE_LEN / 2 + (int)(TIMBRE_PALETTE_GAIN * mfcc_normalized(spectral->mfcc, 1));
+                idx = idx < 0 ? 0 : (idx > HUE_PALETTE_LEN - 1 ? HUE_PALETTE_LEN - 1 : idx);
+                memcpy(colors, spectral->hue_map->palette[idx], sizeof(colors));
+            } else {
+                band_colors(&cfg->db_scale, rgb_magnitudes[COLOR_R_IDX], rgb_magnitudes[COLOR_G_IDX], rgb_magnitudes[COLOR_B_IDX], colors);
+            }
 
-            if (ctrl_mode == audio_freq) {
-                set_rgb(rgb_data[COLOR_R_IDX], rgb_data[COLOR_G_IDX], rgb_data[COLOR_B_IDX], 100);   
+            if (cfg->mode == audio_freq) {
+                audio_output(cfg->mode, colors[COLOR_R_IDX], colors[COLOR_G_IDX], colors[COLOR_B_IDX], 100);   
+            } else if (cfg->mode == audio_hpss && hpss_hit) {
+                // strobe on percussive hits
+                audio_output(cfg->mode, 255, 255, 255, 100);
+            } else if (cfg->mode == audio_shape && cfg->shape_drivers[SHAPE_DRIVER_INTENSITY] != SHAPE_DRIVER_AMPLITUDE) {
+                float level = spectral_shape_level(&shape, cfg->shape_drivers[SHAPE_DRIVER_INTENSITY],
+                    cfg->settings.freq_b_start, cfg->settings.freq_r_end);
+                audio_output(cfg->mode, colors[COLOR_R_IDX], colors[COLOR_G_IDX], colors[COLOR_B_IDX], (uint8_t)(100 * level));
             } else {
-                set_rgb(rgb_data[COLOR_R_IDX], rgb_data[COLOR_G_IDX], rgb_data[COLOR_B_IDX], 
-                    range > settings.settings_st.amp_max ? 100 : (100*range/settings.settings_st.amp_max));   
+                audio_output(cfg->mode, colors[COLOR_R_IDX], colors[COLOR_G_IDX], colors[COLOR_B_IDX], amplitude_level(cfg, range));
             }            
 
             free(rgb_magnitudes);
@@ -663,13 +1520,269 @@ skip_it:    vTaskDelay(pdMS_TO_TICKS(10));
         vTaskDelay(pdMS_TO_TICKS(1));
     }
 
-    i2s_adc_disable(I2S_NUM_0);
+    if (adc_on) i2s_adc_disable(I2S_NUM_0);
     free(i2s_read_buff);
-    free_fft_transformer(transformer);
+    if (spectral) free_spectral_state(spectral);
     i2s_read_buff = NULL;
     vTaskDelete(NULL);
 }
 
+/**
+ * @brief Shows the frames that are due and arms the timer for the next one
+ */
+static void player_timer_cb(void *arg)
+{
+    int64_t now_us = synced_time_us();
+    portENTER_CRITICAL(&player_mux);
+    int64_t next_us = frame_player_advance(player, now_us);
+    uint8_t red = player->rgb[COLOR_R_IDX], green = player->rgb[COLOR_G_IDX], blue = player->rgb[COLOR_B_IDX];
+    uint8_t intensity = player->intensity;
+    portEXIT_CRITICAL(&player_mux);
+
+    if (config_mode() != playback) return;
+    set_rgb(red, green, blue, intensity);
+    if (next_us >= 0) {
+        // the rates of the two clocks differ by ppm, close enough for a wait
+        int64_t wait_us = next_us - synced_time_us();
+        esp_timer_start_once(player_timer, wait_us > 0 ? wait_us : 1);
+    }
+}
+
+/**
+ * @brief Sends one packet to the group
+ */
+static void group_send(int sock, const struct sockaddr_in *group_addr, uint8_t flags, const share_frame *frame)
+{
+    uint8_t packet[SHARE_PACKET_LEN];
+    size_t len = share_encode(packet, ntohl(s_ip_addr), flags, frame);
+    if (sendto(sock, packet, len, 0, (const struct sockaddr *)group_addr, sizeof(*group_addr)) < 0) {
+        ESP_LOGD(TAG, "Group send failed, errno %d", errno);
+    }
+}
+
+/**
+ * @brief Elects the group leader and moves audio frames between the leader and the followers.
+ * Leaders send every frame and a heartbeat when there are none, nodes that hear no leader
+ * for a second take over. Followers sync their clock to the leader, frames are timed in it
+ */
+static void group_link(void *arg)
+{
+    if (!strlen(COAP_MCAST_GROUP)) {
+        ESP_LOGI(TAG, "No multicast group, group audio is off");
+        vTaskDelete(NULL);
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    struct sockaddr_in group_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(SHARE_PORT),
+        .sin_addr.s_addr = inet_addr(COAP_MCAST_GROUP),
+    };
+    struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(SHARE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct ip_mreq mreq = {
+        .imr_multiaddr.s_addr = group_addr.sin_addr.s_addr,
+        .imr_interface.s_addr = htonl(INADDR_ANY),
+    };
+    uint8_t ttl = 1;
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = SHARE_POLL_MS * 1000};
+    if (sock < 0 || bind(sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0
+            || setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0
+            || setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0
+            || setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        ESP_LOGE(TAG, "Group socket setup failed, errno %d", errno);
+        if (sock >= 0) close(sock);
+        vTaskDelete(NULL);
+    }
+
+    share_election election;
+    uint8_t role = SHARE_OFF;
+    uint32_t source = 0;
+    int64_t sent_us = 0;
+    for (;;) {
+        uint8_t packet[SHARE_PACKET_LEN + 1];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+        int64_t now_us = esp_timer_get_time();
+        share_frame frame;
+
+        if (role != group_role) {
+            role = group_role;
+            share_election_start(&election, ntohl(s_ip_addr), now_us);
+            source = 0;
+            // out of the group the time source is the user's again
+            if (role == SHARE_OFF) time_source_set(TIME_SOURCE_GROUP, TIME_SOURCE_RELEASED);
+        }
+        if (role == SHARE_OFF) {
+            group_state = GROUP_STANDALONE;
+            while (xQueueReceive(share_tx, &frame, 0) == pdTRUE);
+            continue;
+        }
+
+        uint32_t leader_id;
+        uint8_t flags;
+        if (len > 0 && share_decode(packet, len, &leader_id, &flags, &frame) == SHARE_OK
+                && share_election_heard(&election, leader_id, now_us)) {
+            if (source != from.sin_addr.s_addr) {
+                source = from.sin_addr.s_addr;
+                time_source_set(TIME_SOURCE_GROUP, source);
+            }
+            if (flags & SHARE_FLAG_AUDIO) {
+                // until the clock is locked to the leader, frames count from their arrival.
+                // The CoAP task adds exchanges on its own, read the estimate as synced_time_us does
+                int64_t local_us = esp_timer_get_time();
+                portENTER_CRITICAL(&clock_mux);
+                int locked = node_clock.locked;
+                int64_t arrival_us = time_sync_to_reference(&node_clock, local_us);
+                portEXIT_CRITICAL(&clock_mux);
+                if (!locked) frame.capture_us = arrival_us;
+                portENTER_CRITICAL(&share_mux);
+                share_jitter_push(&shared_frames, &frame);
+                portEXIT_CRITICAL(&share_mux);
+            }
+        }
+
+        uint8_t state = share_election_tick(&election, role, now_us) == election.self_id ? GROUP_LEADING : GROUP_FOLLOWING;
+        if (state != group_state) {
+            ESP_LOGI(TAG, "Group %s", state == GROUP_LEADING ? "leader" : "follower");
+            if (state == GROUP_LEADING) {
+                // the leader's clock is the reference of the group
+                source = 0;
+                time_source_set(TIME_SOURCE_GROUP, 0);
+            }
+            portENTER_CRITICAL(&share_mux);
+            share_jitter_reset(&shared_frames);
+            portEXIT_CRITICAL(&share_mux);
+            group_state = state;
+        }
+
+        while (xQueueReceive(share_tx, &frame, 0) == pdTRUE) {
+            if (state != GROUP_LEADING) continue;
+            group_send(sock, &group_addr, SHARE_FLAG_AUDIO, &frame);
+            sent_us = now_us;
+        }
+        if (state == GROUP_LEADING && now_us - sent_us >= SHARE_HEARTBEAT_US) {
+            frame = (share_frame){0};
+            group_send(sock, &group_addr, 0, &frame);
+            sent_us = now_us;
+        }
+    }
+}
+
+/**
+ * @brief Renders scenes and beat pulses at a fixed tick, scenes get a bounded instruction budget per tick
+ */
+void led_renderer(void *arg)
+{
+    static scene_vm vm;
+    static uint8_t batch[FRAMES_MAX_LEN];
+    uint32_t loaded_version = 0;
+    int64_t beat_fired_us = 0;
+    int pulse = BEAT_PULSE_FLOOR;
+    uint32_t played_version = 0;
+    int playing = 0;
+    TickType_t last_wake = xTaskGetTickCount();
+
+    scene_vm_load(&vm, NULL, 0);
+    const esp_timer_create_args_t player_timer_args = {
+        .callback = player_timer_cb,
+        .name = "frames"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&player_timer_args, &player_timer));
+    // Task loop
+    for (;;) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(RENDER_TICK_MS));
+        control_mode mode = config_mode();
+        if (mode == playback) {
+            // a new batch starts over, the timer then takes it from the first frame.
+            // Frames are timed in reference time so synced nodes play them together
+            if (!playing || played_version != frames_version) {
+                esp_timer_stop(player_timer);
+                int64_t start_us = synced_time_us() + PLAYBACK_LEAD_US;
+                start_us += (PLAYBACK_ALIGN_US - start_us % PLAYBACK_ALIGN_US) % PLAYBACK_ALIGN_US;
+                // only the copy holds off the CoAP task, the batch is checked and loaded outside the locks
+                portENTER_CRITICAL(&frames_mux);
+                size_t batch_len = frames_len;
+                memcpy(batch, frames_data, batch_len);
+                played_version = frames_version;
+                portEXIT_CRITICAL(&frames_mux);
+                frame_player *idle = player == &players[0] ? &players[1] : &players[0];
+                int err = frame_player_load(idle, batch, batch_len, start_us);
+                portENTER_CRITICAL(&player_mux);
+                player = idle;
+                portEXIT_CRITICAL(&player_mux);
+                ESP_LOGI(TAG, "Loaded frames version %d, result: %d", played_version, err);
+                playing = 1;
+                // the first frame runs on the timer task too, so the callback never runs twice at
+                // once: esp_timer_stop() doesn't wait for one in flight, and one that re-armed the
+                // timer meanwhile is stopped again so the new batch starts right away
+                if (esp_timer_start_once(player_timer, 1) != ESP_OK) {
+                    esp_timer_stop(player_timer);
+                    esp_timer_start_once(player_timer, 1);
+                }
+            }
+            continue;
+        }
+        if (playing) {
+            esp_timer_stop(player_timer);
+            playing = 0;
+        }
+        // in a group every node shows the leader's frames a playout delay after their capture
+        if (group_state != GROUP_STANDALONE && mode != manual && mode != off) {
+            int64_t due_us = synced_time_us() - SHARE_PLAYOUT_US;
+            share_frame frame;
+            portENTER_CRITICAL(&share_mux);
+            int due = share_jitter_pop(&shared_frames, due_us, &frame);
+            portEXIT_CRITICAL(&share_mux);
+            if (due) audio_render(mode, frame.rgb[COLOR_R_IDX], frame.rgb[COLOR_G_IDX], frame.rgb[COLOR_B_IDX], frame.intensity);
+            if (due && group_state == GROUP_FOLLOWING) {
+                portENTER_CRITICAL(&beat_mux);
+                beat_next_us = frame.capture_us + frame.beat_ms * 1000LL;
+                beat_period_us = frame.period_ms * 1000LL;
+                portEXIT_CRITICAL(&beat_mux);
+            }
+        }
+        if (mode == audio_beat) {
+            scene_operands ops = {.all = audio_operands.all};
+            // group beats are timed like the frames, a playout delay behind the reference clock
+            int64_t now = group_state == GROUP_STANDALONE ? esp_timer_get_time() : synced_time_us() - SHARE_PLAYOUT_US;
+            portENTER_CRITICAL(&beat_mux);
+            int64_t beat = beat_next_us;
+            int64_t period = beat_period_us;
+            portEXIT_CRITICAL(&beat_mux);
+            // the prediction can lag behind between audio frames, extrapolate to the latest due beat
+            if (period > 0) {
+                while (beat + period <= now) beat += period;
+                if (beat <= now && beat > beat_fired_us) {
+                    beat_fired_us = beat;
+                    pulse = 100;
+                }
+            }
+            set_rgb(ops.src[SCENE_SRC_AUDIO_R], ops.src[SCENE_SRC_AUDIO_G], ops.src[SCENE_SRC_AUDIO_B],
+                    pulse * ops.src[SCENE_SRC_AUDIO_INT] / 100);
+            pulse -= pulse * BEAT_PULSE_DECAY / 100;
+            if (pulse < BEAT_PULSE_FLOOR) pulse = BEAT_PULSE_FLOOR;
+            continue;
+        }
+        if (mode != light_show) continue;
+
+        if (loaded_version != scene_version) {
+            portENTER_CRITICAL(&scene_mux);
+            int err = scene_vm_load(&vm, scene_data, scene_len);
+            loaded_version = scene_version;
+            portEXIT_CRITICAL(&scene_mux);
+            ESP_LOGI(TAG, "Loaded scene version %d, result: %d", loaded_version, err);
+        }
+
+        scene_operands ops = {.all = audio_operands.all};
+        scene_vm_tick(&vm, &ops, SCENE_TICK_BUDGET);
+        set_rgb(vm.rgb[COLOR_R_IDX], vm.rgb[COLOR_G_IDX], vm.rgb[COLOR_B_IDX], vm.intensity);
+    }
+}
+
 void app_main(void)
 {    
     //Initialize NVS
@@ -681,10 +1794,14 @@ void app_main(void)
     ESP_ERROR_CHECK(err);
 
     wifi_init_sta();
+    share_jitter_reset(&shared_frames);
+    share_tx = xQueueCreate(SHARE_TX_QUEUE, sizeof(share_frame));
 
     xTaskCreatePinnedToCore(nvs_storage_daemon, "nvs_storage_daemon", 4096, NULL, 5, NULL, CORE_1);
     xTaskCreatePinnedToCore(coap_server, "coap_server", 8 * 1024, NULL, 5, NULL, CORE_1);
     xTaskCreatePinnedToCore(i2s_adc_audio_processing, "i2s_adc_audio_processing", 4096, NULL, 5, NULL, CORE_0);
+    xTaskCreatePinnedToCore(led_renderer, "led_renderer", 2048, NULL, 6, NULL, CORE_1);
+    xTaskCreatePinnedToCore(group_link, "group_link", 3072, NULL, 5, NULL, CORE_1);
 
     mcpwm_gpio_init_config();
 }